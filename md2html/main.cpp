@@ -54,9 +54,9 @@ int main(int argc, char **argv)
             QFile html(htmlFileName);
 
             if (html.open(QIODevice::WriteOnly)) {
-                const auto content = MD::toHtml(doc);
+                MD::HtmlIODeviceSink sink(&html);
 
-                html.write(content.toUtf8());
+                MD::toHtml(doc, sink);
 
                 html.close();
             } else {
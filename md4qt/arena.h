@@ -0,0 +1,200 @@
+/*
+    SPDX-FileCopyrightText: 2022-2024 Igor Mironchik <igor.mironchik@gmail.com>
+    SPDX-License-Identifier: MIT
+*/
+
+#ifndef MD4QT_MD_ARENA_H_INCLUDED
+#define MD4QT_MD_ARENA_H_INCLUDED
+
+// md4qt include.
+#include "utils.h"
+
+// C++ include.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace MD
+{
+
+//
+// Arena
+//
+
+//! Monotonic memory arena. Allocated memory is not released separately,
+//! it's released at once on destruction of the arena. Allocation is thread-safe.
+class Arena final
+{
+public:
+    explicit Arena(std::size_t blockSize = 64 * 1024)
+        : m_blockSize(blockSize)
+    {
+    }
+
+    ~Arena() = default;
+
+    //! \return Pointer to the memory of the given size with the given alignment.
+    void *allocate(std::size_t size,
+                   std::size_t alignment)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto padding = paddingFor(alignment);
+
+        if (!m_pos || padding + size > m_left) {
+            const auto blockSize = std::max(m_blockSize, size + alignment);
+
+            m_blocks.emplace_back(new char[blockSize]);
+            m_pos = m_blocks.back().get();
+            m_left = blockSize;
+            m_reserved += blockSize;
+
+            padding = paddingFor(alignment);
+        }
+
+        void *res = m_pos + padding;
+
+        m_pos += padding + size;
+        m_left -= padding + size;
+
+        return res;
+    }
+
+    //! \return Count of bytes reserved by the arena.
+    std::size_t reservedSize() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        return m_reserved;
+    }
+
+private:
+    std::size_t paddingFor(std::size_t alignment) const
+    {
+        return (alignment - reinterpret_cast<std::uintptr_t>(m_pos) % alignment) % alignment;
+    }
+
+private:
+    MD_DISABLE_COPY(Arena)
+
+    //! Size of one block of memory.
+    std::size_t m_blockSize;
+    //! Blocks of memory.
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    //! Free memory in the last block.
+    char *m_pos = nullptr;
+    //! Size of free memory in the last block.
+    std::size_t m_left = 0;
+    //! Count of reserved bytes.
+    std::size_t m_reserved = 0;
+    //! Mutex.
+    mutable std::mutex m_mutex;
+}; // class Arena
+
+//
+// ArenaAllocator
+//
+
+//! Allocator that allocates memory in an arena. An allocator holds the arena,
+//! so objects allocated with std::allocate_shared() keep the arena alive.
+template<class T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(std::shared_ptr<Arena> arena)
+        : m_arena(std::move(arena))
+    {
+    }
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U> &other)
+        : m_arena(other.arena())
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, std::size_t)
+    {
+    }
+
+    //! \return Arena.
+    const std::shared_ptr<Arena> &arena() const
+    {
+        return m_arena;
+    }
+
+private:
+    std::shared_ptr<Arena> m_arena;
+}; // class ArenaAllocator
+
+template<class T, class U>
+inline bool operator==(const ArenaAllocator<T> &l, const ArenaAllocator<U> &r)
+{
+    return l.arena() == r.arena();
+}
+
+template<class T, class U>
+inline bool operator!=(const ArenaAllocator<T> &l, const ArenaAllocator<U> &r)
+{
+    return !(l == r);
+}
+
+//! \return Arena used for allocation of items in the current thread.
+inline std::shared_ptr<Arena> &currentArena()
+{
+    static thread_local std::shared_ptr<Arena> arena;
+
+    return arena;
+}
+
+//
+// ArenaScope
+//
+
+//! Set the arena for allocation of items in the current thread for the lifetime of the scope.
+class ArenaScope final
+{
+public:
+    explicit ArenaScope(std::shared_ptr<Arena> arena)
+        : m_prev(std::move(currentArena()))
+    {
+        currentArena() = std::move(arena);
+    }
+
+    ~ArenaScope()
+    {
+        currentArena() = std::move(m_prev);
+    }
+
+private:
+    MD_DISABLE_COPY(ArenaScope)
+
+    std::shared_ptr<Arena> m_prev;
+}; // class ArenaScope
+
+//! \return New item, allocated in the current arena if it's set.
+template<class T, class... Args>
+inline std::shared_ptr<T> makeItem(Args &&...args)
+{
+    const auto &arena = currentArena();
+
+    if (arena) {
+        return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<Args>(args)...);
+    } else {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+}
+
+} /* namespace MD */
+
+#endif // MD4QT_MD_ARENA_H_INCLUDED
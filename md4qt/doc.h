@@ -10,7 +10,11 @@
 #include "utils.h"
 
 // C++ include.
+#include <algorithm>
 #include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace MD
 {
@@ -145,6 +149,157 @@ inline bool operator==(const WithPosition &l, const WithPosition &r)
             l.endLine() == r.endLine());
 }
 
+//
+// SourceOffsets
+//
+
+//! Byte offsets of lines of a source file in UTF-8. Converts positions of items,
+//! where columns are in UTF-16 code units, into byte offsets in the source, and back.
+class SourceOffsets final
+{
+public:
+    SourceOffsets() = default;
+    ~SourceOffsets() = default;
+
+    //! \return Count of bytes of UTF-8 encoding of the given UTF-16 code unit.
+    //! A surrogate pair is counted as 2 + 2 bytes.
+    static long long int utf8Length(char16_t c)
+    {
+        return (c < 0x80 ? 1 : (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF) ? 2 : 3));
+    }
+
+    //! \return Count of bytes of UTF-8 encoding of the given UTF-16 text.
+    static long long int utf8Length(const char16_t *data,
+                                    long long int length)
+    {
+        long long int res = 0;
+
+        for (long long int i = 0; i < length; ++i) {
+            res += utf8Length(data[i]);
+        }
+
+        return res;
+    }
+
+    //! Append next line.
+    void appendLine(
+        //! Byte offset of the start of the line in the source.
+        long long int offset,
+        //! Text of the line in UTF-16.
+        const char16_t *data,
+        //! Length of the line in UTF-16 code units.
+        long long int length)
+    {
+        m_lines.push_back({offset, length, m_wide.size()});
+
+        long long int extra = 0;
+
+        for (long long int i = 0; i < length; ++i) {
+            if (data[i] >= 0x80) {
+                extra += utf8Length(data[i]) - 1;
+                m_wide.push_back({i, extra});
+            }
+        }
+    }
+
+    //! \return Count of lines.
+    long long int linesCount() const
+    {
+        return static_cast<long long int>(m_lines.size());
+    }
+
+    //! \return Byte offset of the start of the given line, -1 if there is no such line.
+    long long int lineOffset(long long int line) const
+    {
+        return (line >= 0 && line < linesCount() ? m_lines[line].m_offset : -1);
+    }
+
+    //! \return Byte offset of the character at the given position, -1 if there is no such line.
+    //! A column after the last character of the line gives the offset of the end of the line.
+    long long int offset(long long int line,
+                         long long int column) const
+    {
+        if (line < 0 || line >= linesCount()) {
+            return -1;
+        }
+
+        const auto &l = m_lines[line];
+        column = std::clamp(column, 0ll, l.m_length);
+
+        const auto first = m_wide.cbegin() + l.m_firstWide;
+        const auto last = (line + 1 < linesCount() ? m_wide.cbegin() + m_lines[line + 1].m_firstWide : m_wide.cend());
+        const auto it = std::lower_bound(first, last, column, [](const Wide &w, long long int c) {
+            return w.m_column < c;
+        });
+
+        return l.m_offset + column + (it != first ? std::prev(it)->m_extra : 0);
+    }
+
+    //! \return Range of bytes [first, second) in the source occupied by the item with the given position,
+    //! {-1, -1} if the position is not valid.
+    std::pair<long long int, long long int> range(const WithPosition &pos) const
+    {
+        const auto start = offset(pos.startLine(), pos.startColumn());
+        const auto end = offset(pos.endLine(), pos.endColumn() + 1);
+
+        return (start < 0 || end < 0 || pos.startColumn() < 0 || pos.endColumn() < 0 ?
+                    std::make_pair(-1ll, -1ll) : std::make_pair(start, end));
+    }
+
+    //! \return Position of the character at the given byte offset, where start and end are the same.
+    //! An offset within a line break gives the column after the last character of the line.
+    //! Position is not valid if the offset is before the first line.
+    WithPosition position(long long int offset) const
+    {
+        const auto lineIt = std::upper_bound(m_lines.cbegin(), m_lines.cend(), offset, [](long long int o, const Line &l) {
+            return o < l.m_offset;
+        });
+
+        if (lineIt == m_lines.cbegin()) {
+            return {};
+        }
+
+        const long long int line = std::distance(m_lines.cbegin(), lineIt) - 1;
+        long long int first = 0;
+        long long int last = m_lines[line].m_length;
+
+        // The last column which starts not after the offset.
+        while (first < last) {
+            const auto middle = first + (last - first + 1) / 2;
+
+            if (this->offset(line, middle) <= offset) {
+                first = middle;
+            } else {
+                last = middle - 1;
+            }
+        }
+
+        return {first, line, first, line};
+    }
+
+private:
+    //! Line.
+    struct Line {
+        //! Byte offset of the start of the line.
+        long long int m_offset = 0;
+        //! Length of the line in UTF-16 code units.
+        long long int m_length = 0;
+        //! Index of the first not ASCII character of the line in m_wide.
+        std::size_t m_firstWide = 0;
+    };
+
+    //! Not ASCII character.
+    struct Wide {
+        //! Column of the character.
+        long long int m_column = 0;
+        //! Count of extra bytes in the line till the end of this character.
+        long long int m_extra = 0;
+    };
+
+    std::vector<Line> m_lines;
+    std::vector<Wide> m_wide;
+}; // class SourceOffsets
+
 template<class Trait>
 class Document;
 
@@ -366,7 +521,10 @@ public:
     {
         MD_UNUSED(doc)
 
-        return std::make_shared<Anchor<Trait>>(m_label);
+        auto a = std::make_shared<Anchor<Trait>>(m_label);
+        a->setSourceOffsets(m_sourceOffsets);
+
+        return a;
     }
 
     ItemType type() const override
@@ -379,10 +537,23 @@ public:
         return m_label;
     }
 
+    //! \return Byte offsets of lines of the file this anchor starts,
+    //! null if the parser didn't record them.
+    const std::shared_ptr<const SourceOffsets> &sourceOffsets() const
+    {
+        return m_sourceOffsets;
+    }
+
+    void setSourceOffsets(std::shared_ptr<const SourceOffsets> offsets)
+    {
+        m_sourceOffsets = std::move(offsets);
+    }
+
 private:
     MD_DISABLE_COPY(Anchor)
 
     typename Trait::String m_label;
+    std::shared_ptr<const SourceOffsets> m_sourceOffsets;
 }; // class Anchor
 
 //
@@ -1613,8 +1784,18 @@ public:
         return d;
     }
 
+#ifdef MD4QT_HASHED_LABELS
+    //! Map of labels to items, hash-based.
+    template<class T>
+    using LabelsMap = std::unordered_map<typename Trait::String, T, typename Trait::StringHash>;
+#else
+    //! Map of labels to items.
+    template<class T>
+    using LabelsMap = typename Trait::template Map<typename Trait::String, T>;
+#endif
+
     using FootnoteSharedPointer = std::shared_ptr<Footnote<Trait>>;
-    using Footnotes = typename Trait::template Map<typename Trait::String, FootnoteSharedPointer>;
+    using Footnotes = LabelsMap<FootnoteSharedPointer>;
 
     const Footnotes &footnotesMap() const
     {
@@ -1627,7 +1808,7 @@ public:
     }
 
     using LinkSharedPointer = std::shared_ptr<Link<Trait>>;
-    using LabeledLinks = typename Trait::template Map<typename Trait::String, LinkSharedPointer>;
+    using LabeledLinks = LabelsMap<LinkSharedPointer>;
 
     const LabeledLinks &labeledLinks() const
     {
@@ -1640,7 +1821,7 @@ public:
     }
 
     using HeadingSharedPointer = std::shared_ptr<Heading<Trait>>;
-    using LabeledHeadings = typename Trait::template Map<typename Trait::String, HeadingSharedPointer>;
+    using LabeledHeadings = LabelsMap<HeadingSharedPointer>;
 
     const LabeledHeadings &labeledHeadings() const
     {
@@ -1652,6 +1833,11 @@ public:
         m_labeledHeadings.insert({label, h});
     }
 
+    void removeLabeledHeading(const typename Trait::String &label)
+    {
+        m_labeledHeadings.erase(label);
+    }
+
 private:
     Footnotes m_footnotes;
     LabeledLinks m_labeledLinks;
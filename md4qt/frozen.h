@@ -0,0 +1,1114 @@
+/*
+    SPDX-FileCopyrightText: 2022-2024 Igor Mironchik <igor.mironchik@gmail.com>
+    SPDX-License-Identifier: MIT
+*/
+
+#ifndef MD4QT_MD_FROZEN_H_INCLUDED
+#define MD4QT_MD_FROZEN_H_INCLUDED
+
+// md4qt include.
+#include "arena.h"
+#include "doc.h"
+#include "html.h"
+
+// C++ include.
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace MD
+{
+
+//
+// FrozenNode
+//
+
+//! Record of one item in the frozen document.
+struct FrozenNode {
+    //! Type of the item.
+    ItemType m_type = ItemType::Document;
+    //! Start column.
+    std::int32_t m_startColumn = -1;
+    //! Start line.
+    std::int32_t m_startLine = -1;
+    //! End column.
+    std::int32_t m_endColumn = -1;
+    //! End line.
+    std::int32_t m_endLine = -1;
+    //! Index of the first node after the subtree of this node.
+    std::int32_t m_next = 0;
+    //! Offset of the item's data in the data array, -1 if the item doesn't have data.
+    std::int32_t m_data = -1;
+}; // struct FrozenNode
+
+namespace details
+{
+
+template<class Trait>
+class Freezer;
+
+template<class Trait>
+class Thawer;
+
+} /* namespace details */
+
+//
+// FrozenDocument
+//
+
+//! Read-only document stored in flat arrays. Items are stored in pre-order, children
+//! of a node are placed right after it, and a node knows where its subtree ends. Strings
+//! of all items are stored in one text buffer. Footnotes and labeled links that are not
+//! a part of the document's tree are stored after the subtree of the document.
+//!
+//! Children of the node are iterated like this:
+//!
+//! for (auto c = doc.firstChild(i); c != -1; c = doc.nextSibling(i, c)) {}
+//!
+//! Children of Heading is its text, children of Link are its paragraph and image,
+//! children of Image is its paragraph, children of Table are rows, children of TableRow are cells.
+template<class Trait>
+class FrozenDocument final
+{
+public:
+    FrozenDocument() = default;
+    ~FrozenDocument() = default;
+
+    using Nodes = std::vector<FrozenNode>;
+    using Labels = typename Trait::template Vector<std::pair<typename Trait::String, long long int>>;
+
+    //! \return Is this document empty?
+    bool isEmpty() const
+    {
+        return (m_nodes.empty() || m_nodes.front().m_next <= 1);
+    }
+
+    //! \return All nodes.
+    const Nodes &nodes() const
+    {
+        return m_nodes;
+    }
+
+    //! \return Node at the given index.
+    const FrozenNode &node(long long int i) const
+    {
+        return m_nodes.at(i);
+    }
+
+    //! \return Type of the item.
+    ItemType type(long long int i) const
+    {
+        return m_nodes.at(i).m_type;
+    }
+
+    //! \return Index of the first child of the node, -1 if the node doesn't have children.
+    long long int firstChild(long long int i) const
+    {
+        return (i + 1 < m_nodes.at(i).m_next ? i + 1 : -1);
+    }
+
+    //! \return Index of the next sibling of the child in the parent, -1 if it's the last child.
+    long long int nextSibling(long long int parent, long long int child) const
+    {
+        const long long int n = m_nodes.at(child).m_next;
+
+        return (n < m_nodes.at(parent).m_next ? n : -1);
+    }
+
+    //! \return Text of Text, LineBreak, FootnoteRef, RawHtml, Code, Math, Link or Image.
+    typename Trait::String text(long long int i) const
+    {
+        return (isItemWithOpts(type(i)) ? string(m_nodes.at(i).m_data + 2) : typename Trait::String());
+    }
+
+    //! \return URL of Link or Image.
+    typename Trait::String url(long long int i) const
+    {
+        switch (type(i)) {
+        case ItemType::Link:
+        case ItemType::Image:
+            return string(extraData(i));
+
+        default:
+            return {};
+        }
+    }
+
+    //! \return Syntax of Code or Math.
+    typename Trait::String syntax(long long int i) const
+    {
+        switch (type(i)) {
+        case ItemType::Code:
+        case ItemType::Math:
+            return string(extraData(i));
+
+        default:
+            return {};
+        }
+    }
+
+    //! \return ID of FootnoteRef.
+    typename Trait::String id(long long int i) const
+    {
+        return (type(i) == ItemType::FootnoteRef ? string(extraData(i)) : typename Trait::String());
+    }
+
+    //! \return Label of Heading or Anchor.
+    typename Trait::String label(long long int i) const
+    {
+        switch (type(i)) {
+        case ItemType::Heading:
+            return string(m_nodes.at(i).m_data + 2);
+
+        case ItemType::Anchor:
+            return string(m_nodes.at(i).m_data);
+
+        default:
+            return {};
+        }
+    }
+
+    //! \return Level of Heading.
+    int level(long long int i) const
+    {
+        return (type(i) == ItemType::Heading ? m_data.at(m_nodes.at(i).m_data) : 0);
+    }
+
+    //! \return Count of columns of Table.
+    int columnsCount(long long int i) const
+    {
+        return (type(i) == ItemType::Table ? m_data.at(m_nodes.at(i).m_data) : 0);
+    }
+
+    //! \return Text options of the item.
+    int opts(long long int i) const
+    {
+        return (isItemWithOpts(type(i)) ? m_data.at(m_nodes.at(i).m_data) : TextWithoutFormat);
+    }
+
+    //! \return Footnotes, ID and index of the footnote's node.
+    const Labels &footnotes() const
+    {
+        return m_footnotes;
+    }
+
+    //! \return Labeled links, label and index of the link's node.
+    const Labels &labeledLinks() const
+    {
+        return m_labeledLinks;
+    }
+
+    //! \return Labeled headings, label and index of the heading's node.
+    const Labels &labeledHeadings() const
+    {
+        return m_labeledHeadings;
+    }
+
+private:
+    friend class details::Freezer<Trait>;
+    friend class details::Thawer<Trait>;
+
+    static bool isItemWithOpts(ItemType t)
+    {
+        switch (t) {
+        case ItemType::Text:
+        case ItemType::LineBreak:
+        case ItemType::FootnoteRef:
+        case ItemType::RawHtml:
+        case ItemType::Code:
+        case ItemType::Math:
+        case ItemType::Link:
+        case ItemType::Image:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    //! \return String stored at the given offset in the data array.
+    typename Trait::String string(long long int at) const
+    {
+        return m_text.sliced(m_data.at(at), m_data.at(at + 1));
+    }
+
+    //! \return Position stored at the given offset in the data array.
+    WithPosition position(long long int at) const
+    {
+        return {m_data.at(at), m_data.at(at + 1), m_data.at(at + 2), m_data.at(at + 3)};
+    }
+
+    //! \return Offset of the data that follows styles of the item with options.
+    long long int extraData(long long int i) const
+    {
+        long long int at = m_nodes.at(i).m_data + 4;
+
+        at += 1 + m_data.at(at) * 5;
+        at += 1 + m_data.at(at) * 5;
+
+        return at;
+    }
+
+private:
+    //! Nodes.
+    Nodes m_nodes;
+    //! Data of items. Items with options start with options, flags, text and styles.
+    std::vector<std::int32_t> m_data;
+    //! Text buffer.
+    typename Trait::String m_text;
+    //! Footnotes.
+    Labels m_footnotes;
+    //! Labeled links.
+    Labels m_labeledLinks;
+    //! Labeled headings.
+    Labels m_labeledHeadings;
+}; // class FrozenDocument
+
+namespace details
+{
+
+//
+// Freezer
+//
+
+//! Builder of frozen document.
+template<class Trait>
+class Freezer final
+{
+public:
+    explicit Freezer(FrozenDocument<Trait> &f)
+        : m_f(f)
+    {
+    }
+
+    void freeze(std::shared_ptr<Document<Trait>> doc)
+    {
+        add(doc.get());
+
+        for (const auto &fn : doc->footnotesMap()) {
+            m_f.m_footnotes.push_back({fn.first, index(fn.second.get())});
+        }
+
+        for (const auto &l : doc->labeledLinks()) {
+            m_f.m_labeledLinks.push_back({l.first, index(l.second.get())});
+        }
+
+        for (const auto &h : doc->labeledHeadings()) {
+            m_f.m_labeledHeadings.push_back({h.first, index(h.second.get())});
+        }
+
+        m_f.m_nodes.shrink_to_fit();
+        m_f.m_data.shrink_to_fit();
+    }
+
+private:
+    //! \return Index of the already frozen item or freeze it.
+    long long int index(Item<Trait> *item)
+    {
+        const auto it = m_indexes.find(item);
+
+        return (it != m_indexes.cend() ? it->second : add(item));
+    }
+
+    long long int add(Item<Trait> *item)
+    {
+        const long long int idx = m_f.m_nodes.size();
+
+        FrozenNode n;
+        n.m_type = item->type();
+        n.m_startColumn = static_cast<std::int32_t>(item->startColumn());
+        n.m_startLine = static_cast<std::int32_t>(item->startLine());
+        n.m_endColumn = static_cast<std::int32_t>(item->endColumn());
+        n.m_endLine = static_cast<std::int32_t>(item->endLine());
+
+        m_f.m_nodes.push_back(n);
+
+        const auto data = static_cast<std::int32_t>(m_f.m_data.size());
+
+        switch (item->type()) {
+        case ItemType::Heading: {
+            auto h = static_cast<Heading<Trait> *>(item);
+            m_indexes.insert({item, idx});
+
+            addInt(h->level());
+            addInt(h->text() ? 1 : 0);
+            addString(h->label());
+            addPosition(h->labelPos());
+            addDelims(h->delims());
+
+            if (h->text()) {
+                add(h->text().get());
+            }
+        } break;
+
+        case ItemType::Text:
+        case ItemType::LineBreak: {
+            auto t = static_cast<Text<Trait> *>(item);
+
+            addItemWithOpts(t, (t->isSpaceBefore() ? 1 : 0) | (t->isSpaceAfter() ? 2 : 0), t->text());
+        } break;
+
+        case ItemType::FootnoteRef: {
+            auto f = static_cast<FootnoteRef<Trait> *>(item);
+
+            addItemWithOpts(f, (f->isSpaceBefore() ? 1 : 0) | (f->isSpaceAfter() ? 2 : 0), f->text());
+            addString(f->id());
+            addPosition(f->idPos());
+        } break;
+
+        case ItemType::RawHtml: {
+            auto h = static_cast<RawHtml<Trait> *>(item);
+
+            addItemWithOpts(h, 0, h->text());
+        } break;
+
+        case ItemType::Code:
+        case ItemType::Math: {
+            auto c = static_cast<Code<Trait> *>(item);
+
+            addItemWithOpts(c, (c->isInline() ? 1 : 0) | (c->isFensedCode() ? 2 : 0), c->text());
+            addString(c->syntax());
+            addPosition(c->syntaxPos());
+            addPosition(c->startDelim());
+            addPosition(c->endDelim());
+        } break;
+
+        case ItemType::Link: {
+            auto l = static_cast<Link<Trait> *>(item);
+            m_indexes.insert({item, idx});
+
+            addLinkBase(l, (l->p() ? 1 : 0) | (l->img() ? 2 : 0));
+
+            if (l->p()) {
+                add(l->p().get());
+            }
+
+            if (l->img()) {
+                add(l->img().get());
+            }
+        } break;
+
+        case ItemType::Image: {
+            auto i = static_cast<Image<Trait> *>(item);
+
+            addLinkBase(i, (i->p() ? 1 : 0));
+
+            if (i->p()) {
+                add(i->p().get());
+            }
+        } break;
+
+        case ItemType::Blockquote: {
+            auto b = static_cast<Blockquote<Trait> *>(item);
+
+            addDelims(b->delims());
+            addItems(b);
+        } break;
+
+        case ItemType::ListItem: {
+            auto l = static_cast<ListItem<Trait> *>(item);
+
+            addInt(l->listType());
+            addInt(l->orderedListPreState());
+            addInt(l->startNumber());
+            addInt((l->isTaskList() ? 1 : 0) | (l->isChecked() ? 2 : 0));
+            addPosition(l->delim());
+            addPosition(l->taskDelim());
+            addItems(l);
+        } break;
+
+        case ItemType::Table: {
+            auto t = static_cast<Table<Trait> *>(item);
+
+            addInt(t->columnsCount());
+
+            for (int i = 0; i < t->columnsCount(); ++i) {
+                addInt(t->columnAlignment(i));
+            }
+
+            for (const auto &r : t->rows()) {
+                add(r.get());
+            }
+        } break;
+
+        case ItemType::TableRow: {
+            for (const auto &c : static_cast<TableRow<Trait> *>(item)->cells()) {
+                add(c.get());
+            }
+        } break;
+
+        case ItemType::Footnote: {
+            auto f = static_cast<Footnote<Trait> *>(item);
+
+            addPosition(f->idPos());
+            addItems(f);
+        } break;
+
+        case ItemType::Anchor:
+            addString(static_cast<Anchor<Trait> *>(item)->label());
+            break;
+
+        case ItemType::Paragraph:
+        case ItemType::List:
+        case ItemType::TableCell:
+        case ItemType::Document:
+            addItems(static_cast<Block<Trait> *>(item));
+            break;
+
+        default:
+            break;
+        }
+
+        auto &node = m_f.m_nodes[idx];
+
+        if (static_cast<long long int>(m_f.m_data.size()) > data) {
+            node.m_data = data;
+        }
+
+        node.m_next = static_cast<std::int32_t>(m_f.m_nodes.size());
+
+        return idx;
+    }
+
+    void addItems(Block<Trait> *b)
+    {
+        for (const auto &i : b->items()) {
+            add(i.get());
+        }
+    }
+
+    void addInt(long long int v)
+    {
+        m_f.m_data.push_back(static_cast<std::int32_t>(v));
+    }
+
+    void addString(const typename Trait::String &s)
+    {
+        addInt(m_f.m_text.size());
+        addInt(s.size());
+
+        m_f.m_text.push_back(s);
+    }
+
+    void addPosition(const WithPosition &p)
+    {
+        addInt(p.startColumn());
+        addInt(p.startLine());
+        addInt(p.endColumn());
+        addInt(p.endLine());
+    }
+
+    void addDelims(const typename Trait::template Vector<WithPosition> &delims)
+    {
+        addInt(delims.size());
+
+        for (const auto &d : delims) {
+            addPosition(d);
+        }
+    }
+
+    void addStyles(const typename ItemWithOpts<Trait>::Styles &styles)
+    {
+        addInt(styles.size());
+
+        for (const auto &s : styles) {
+            addInt(s.style());
+            addPosition(s);
+        }
+    }
+
+    void addItemWithOpts(ItemWithOpts<Trait> *i,
+                         int flags,
+                         const typename Trait::String &text)
+    {
+        addInt(i->opts());
+        addInt(flags);
+        addString(text);
+        addStyles(i->openStyles());
+        addStyles(i->closeStyles());
+    }
+
+    void addLinkBase(LinkBase<Trait> *l,
+                     int flags)
+    {
+        addItemWithOpts(l, flags, l->text());
+        addString(l->url());
+        addPosition(l->textPos());
+        addPosition(l->urlPos());
+    }
+
+private:
+    //! Frozen document.
+    FrozenDocument<Trait> &m_f;
+    //! Indexes of headings and links, these items may be referenced by labels.
+    std::unordered_map<Item<Trait> *, long long int> m_indexes;
+}; // class Freezer
+
+//
+// Thawer
+//
+
+//! Builder of document from frozen document.
+template<class Trait>
+class Thawer final
+{
+public:
+    explicit Thawer(const FrozenDocument<Trait> &f)
+        : m_f(f)
+    {
+    }
+
+    std::shared_ptr<Document<Trait>> thaw()
+    {
+        auto doc = std::make_shared<Document<Trait>>();
+
+        if (m_f.m_nodes.empty()) {
+            return doc;
+        }
+
+        applyPositions(doc.get(), 0);
+        addItems(doc.get(), 0);
+
+        for (const auto &fn : m_f.m_footnotes) {
+            doc->insertFootnote(fn.first, std::static_pointer_cast<Footnote<Trait>>(item(fn.second)));
+        }
+
+        for (const auto &l : m_f.m_labeledLinks) {
+            doc->insertLabeledLink(l.first, std::static_pointer_cast<Link<Trait>>(item(l.second)));
+        }
+
+        for (const auto &h : m_f.m_labeledHeadings) {
+            doc->insertLabeledHeading(h.first, std::static_pointer_cast<Heading<Trait>>(item(h.second)));
+        }
+
+        return doc;
+    }
+
+private:
+    //! \return Already created item or create it.
+    std::shared_ptr<Item<Trait>> item(long long int i)
+    {
+        const auto it = m_items.find(i);
+
+        return (it != m_items.cend() ? it->second : create(i));
+    }
+
+    std::shared_ptr<Item<Trait>> create(long long int i)
+    {
+        const auto &n = m_f.m_nodes.at(i);
+        const long long int d = n.m_data;
+        std::shared_ptr<Item<Trait>> res;
+
+        switch (n.m_type) {
+        case ItemType::Heading: {
+            auto h = makeItem<Heading<Trait>>();
+            h->setLevel(m_f.m_data.at(d));
+            h->setLabel(m_f.string(d + 2));
+            h->setLabelPos(m_f.position(d + 4));
+            h->setDelims(delims(d + 8));
+            h->setText(m_f.m_data.at(d + 1) ? std::static_pointer_cast<Paragraph<Trait>>(create(i + 1)) : nullptr);
+            m_items.insert({i, h});
+            res = h;
+        } break;
+
+        case ItemType::Text: {
+            auto t = makeItem<Text<Trait>>();
+            applyText(t.get(), i);
+            res = t;
+        } break;
+
+        case ItemType::LineBreak: {
+            auto t = makeItem<LineBreak<Trait>>();
+            applyText(t.get(), i);
+            res = t;
+        } break;
+
+        case ItemType::FootnoteRef: {
+            const auto extra = m_f.extraData(i);
+            auto f = makeItem<FootnoteRef<Trait>>(m_f.string(extra));
+            applyText(f.get(), i);
+            f->setIdPos(m_f.position(extra + 2));
+            res = f;
+        } break;
+
+        case ItemType::RawHtml: {
+            auto h = makeItem<RawHtml<Trait>>();
+            applyItemWithOpts(h.get(), i);
+            h->setText(m_f.string(d + 2));
+            res = h;
+        } break;
+
+        case ItemType::Code:
+        case ItemType::Math: {
+            std::shared_ptr<Code<Trait>> c;
+
+            if (n.m_type == ItemType::Math) {
+                c = makeItem<Math<Trait>>();
+            } else {
+                c = makeItem<Code<Trait>>(typename Trait::String(), false, false);
+            }
+
+            const auto extra = m_f.extraData(i);
+            applyItemWithOpts(c.get(), i);
+            c->setText(m_f.string(d + 2));
+            c->setInline(m_f.m_data.at(d + 1) & 1);
+            c->setFensedCode(m_f.m_data.at(d + 1) & 2);
+            c->setSyntax(m_f.string(extra));
+            c->setSyntaxPos(m_f.position(extra + 2));
+            c->setStartDelim(m_f.position(extra + 6));
+            c->setEndDelim(m_f.position(extra + 10));
+            res = c;
+        } break;
+
+        case ItemType::Link: {
+            auto l = makeItem<Link<Trait>>();
+            applyLinkBase(l.get(), i);
+
+            auto c = i + 1;
+
+            if (m_f.m_data.at(d + 1) & 1) {
+                l->setP(std::static_pointer_cast<Paragraph<Trait>>(create(c)));
+                c = m_f.m_nodes.at(c).m_next;
+            } else {
+                l->setP(nullptr);
+            }
+
+            l->setImg(m_f.m_data.at(d + 1) & 2 ? std::static_pointer_cast<Image<Trait>>(create(c)) : nullptr);
+            m_items.insert({i, l});
+            res = l;
+        } break;
+
+        case ItemType::Image: {
+            auto img = makeItem<Image<Trait>>();
+            applyLinkBase(img.get(), i);
+            img->setP(m_f.m_data.at(d + 1) & 1 ? std::static_pointer_cast<Paragraph<Trait>>(create(i + 1)) : nullptr);
+            res = img;
+        } break;
+
+        case ItemType::Blockquote: {
+            auto b = makeItem<Blockquote<Trait>>();
+            b->delims() = delims(d);
+            addItems(b.get(), i);
+            res = b;
+        } break;
+
+        case ItemType::ListItem: {
+            auto l = makeItem<ListItem<Trait>>();
+            l->setListType(static_cast<typename ListItem<Trait>::ListType>(m_f.m_data.at(d)));
+            l->setOrderedListPreState(static_cast<typename ListItem<Trait>::OrderedListPreState>(m_f.m_data.at(d + 1)));
+            l->setStartNumber(m_f.m_data.at(d + 2));
+            l->setTaskList(m_f.m_data.at(d + 3) & 1);
+            l->setChecked(m_f.m_data.at(d + 3) & 2);
+            l->setDelim(m_f.position(d + 4));
+            l->setTaskDelim(m_f.position(d + 8));
+            addItems(l.get(), i);
+            res = l;
+        } break;
+
+        case ItemType::List: {
+            auto l = makeItem<List<Trait>>();
+            addItems(l.get(), i);
+            res = l;
+        } break;
+
+        case ItemType::Table: {
+            auto t = makeItem<Table<Trait>>();
+
+            for (int c = 0; c < m_f.m_data.at(d); ++c) {
+                t->setColumnAlignment(c, static_cast<typename Table<Trait>::Alignment>(m_f.m_data.at(d + 1 + c)));
+            }
+
+            for (auto r = m_f.firstChild(i); r != -1; r = m_f.nextSibling(i, r)) {
+                t->appendRow(std::static_pointer_cast<TableRow<Trait>>(create(r)));
+            }
+
+            res = t;
+        } break;
+
+        case ItemType::TableRow: {
+            auto r = makeItem<TableRow<Trait>>();
+
+            for (auto c = m_f.firstChild(i); c != -1; c = m_f.nextSibling(i, c)) {
+                r->appendCell(std::static_pointer_cast<TableCell<Trait>>(create(c)));
+            }
+
+            res = r;
+        } break;
+
+        case ItemType::TableCell: {
+            auto c = makeItem<TableCell<Trait>>();
+            addItems(c.get(), i);
+            res = c;
+        } break;
+
+        case ItemType::Paragraph: {
+            auto p = makeItem<Paragraph<Trait>>();
+            addItems(p.get(), i);
+            res = p;
+        } break;
+
+        case ItemType::Footnote: {
+            auto f = makeItem<Footnote<Trait>>();
+            f->setIdPos(m_f.position(d));
+            addItems(f.get(), i);
+            res = f;
+        } break;
+
+        case ItemType::Anchor:
+            res = makeItem<Anchor<Trait>>(m_f.string(d));
+            break;
+
+        case ItemType::PageBreak:
+            res = makeItem<PageBreak<Trait>>();
+            break;
+
+        case ItemType::HorizontalLine:
+            res = makeItem<HorizontalLine<Trait>>();
+            break;
+
+        default:
+            return {};
+        }
+
+        applyPositions(res.get(), i);
+
+        return res;
+    }
+
+    void addItems(Block<Trait> *b,
+                  long long int i)
+    {
+        for (auto c = m_f.firstChild(i); c != -1; c = m_f.nextSibling(i, c)) {
+            auto item = create(c);
+
+            if (item) {
+                b->appendItem(item);
+            }
+        }
+    }
+
+    void applyPositions(Item<Trait> *item,
+                        long long int i)
+    {
+        const auto &n = m_f.m_nodes.at(i);
+
+        item->applyPositions({n.m_startColumn, n.m_startLine, n.m_endColumn, n.m_endLine});
+    }
+
+    typename Trait::template Vector<WithPosition> delims(long long int at) const
+    {
+        typename Trait::template Vector<WithPosition> res;
+
+        for (int i = 0; i < m_f.m_data.at(at); ++i) {
+            res.push_back(m_f.position(at + 1 + i * 4));
+        }
+
+        return res;
+    }
+
+    typename ItemWithOpts<Trait>::Styles styles(long long int at) const
+    {
+        typename ItemWithOpts<Trait>::Styles res;
+
+        for (int i = 0; i < m_f.m_data.at(at); ++i) {
+            const auto p = m_f.position(at + 2 + i * 5);
+
+            res.push_back({m_f.m_data.at(at + 1 + i * 5), p.startColumn(), p.startLine(), p.endColumn(), p.endLine()});
+        }
+
+        return res;
+    }
+
+    void applyItemWithOpts(ItemWithOpts<Trait> *item,
+                           long long int i)
+    {
+        const long long int d = m_f.m_nodes.at(i).m_data;
+
+        item->setOpts(m_f.m_data.at(d));
+        item->openStyles() = styles(d + 4);
+        item->closeStyles() = styles(d + 5 + m_f.m_data.at(d + 4) * 5);
+    }
+
+    void applyText(Text<Trait> *t,
+                   long long int i)
+    {
+        const long long int d = m_f.m_nodes.at(i).m_data;
+
+        applyItemWithOpts(t, i);
+        t->setText(m_f.string(d + 2));
+        t->setSpaceBefore(m_f.m_data.at(d + 1) & 1);
+        t->setSpaceAfter(m_f.m_data.at(d + 1) & 2);
+    }
+
+    void applyLinkBase(LinkBase<Trait> *l,
+                       long long int i)
+    {
+        const auto extra = m_f.extraData(i);
+
+        applyItemWithOpts(l, i);
+        l->setText(m_f.string(m_f.m_nodes.at(i).m_data + 2));
+        l->setUrl(m_f.string(extra));
+        l->setTextPos(m_f.position(extra + 2));
+        l->setUrlPos(m_f.position(extra + 6));
+    }
+
+private:
+    //! Frozen document.
+    const FrozenDocument<Trait> &m_f;
+    //! Created headings and links, these items may be referenced by labels.
+    std::unordered_map<long long int, std::shared_ptr<Item<Trait>>> m_items;
+}; // class Thawer
+
+} /* namespace details */
+
+//! \return Frozen copy of the document. User-defined items are stored without data
+//! and are not restored on thaw().
+template<class Trait>
+inline FrozenDocument<Trait> freeze(std::shared_ptr<Document<Trait>> doc)
+{
+    FrozenDocument<Trait> f;
+
+    details::Freezer<Trait> freezer(f);
+    freezer.freeze(doc);
+
+    return f;
+}
+
+//! \return Document restored from the frozen document.
+template<class Trait>
+inline std::shared_ptr<Document<Trait>> thaw(const FrozenDocument<Trait> &doc)
+{
+    details::Thawer<Trait> thawer(doc);
+
+    return thawer.thaw();
+}
+
+//! Function type for algorithms on frozen document. Argument is an index of the node.
+using FrozenItemFunctor = std::function<void(long long int)>;
+
+namespace details
+{
+
+//
+// FrozenAlgoWalker
+//
+
+//! Walker for algorithms on frozen document, walks through items like AlgoVisitor.
+template<class Trait>
+class FrozenAlgoWalker final
+{
+public:
+    FrozenAlgoWalker(const FrozenDocument<Trait> &doc,
+                     unsigned int mnl,
+                     const typename Trait::template Vector<ItemType> &t,
+                     FrozenItemFunctor f)
+        : m_doc(doc)
+        , m_maxNestingLevel(mnl)
+        , m_types(t)
+        , m_func(f)
+    {
+    }
+
+    void walk()
+    {
+        if (m_doc.nodes().empty()) {
+            return;
+        }
+
+        onChildren(0, Container::Document, 1);
+
+        for (const auto &f : m_doc.footnotes()) {
+            onItem(f.second, 1);
+        }
+    }
+
+private:
+    //! Kind of container, it defines what items are visited in it.
+    enum class Container { Document, Block, Paragraph, TableCell, List }; // enum class Container
+
+    static bool accepted(ItemType t,
+                         Container c)
+    {
+        if (static_cast<int>(t) >= static_cast<int>(ItemType::UserDefined)) {
+            return true;
+        }
+
+        if (c == Container::List) {
+            return t == ItemType::ListItem;
+        }
+
+        switch (t) {
+        case ItemType::PageBreak:
+            return false;
+
+        case ItemType::Anchor:
+            return c == Container::Document;
+
+        case ItemType::LineBreak:
+            return c == Container::Paragraph;
+
+        default:
+            return true;
+        }
+    }
+
+    bool allowed(ItemType t,
+                 unsigned int level) const
+    {
+        return ((m_maxNestingLevel == 0 || level <= m_maxNestingLevel) &&
+                std::find(m_types.cbegin(), m_types.cend(), t) != m_types.cend());
+    }
+
+    bool nextAllowed(unsigned int level) const
+    {
+        return (m_maxNestingLevel == 0 || level + 1 <= m_maxNestingLevel);
+    }
+
+    void onChildren(long long int parent,
+                    Container c,
+                    unsigned int level)
+    {
+        for (auto i = m_doc.firstChild(parent); i != -1; i = m_doc.nextSibling(parent, i)) {
+            if (accepted(m_doc.type(i), c)) {
+                onItem(i, level);
+            }
+        }
+    }
+
+    void onItem(long long int i,
+                unsigned int level)
+    {
+        if (allowed(m_doc.type(i), level)) {
+            m_func(i);
+        }
+
+        if (!nextAllowed(level)) {
+            return;
+        }
+
+        switch (m_doc.type(i)) {
+        case ItemType::Paragraph:
+            onChildren(i, Container::Paragraph, level + 1);
+            break;
+
+        case ItemType::Heading: {
+            const auto p = m_doc.firstChild(i);
+
+            if (p != -1 && m_doc.firstChild(p) != -1) {
+                onItem(p, level + 1);
+            }
+        } break;
+
+        case ItemType::Blockquote:
+        case ItemType::ListItem:
+        case ItemType::Footnote:
+            onChildren(i, Container::Block, level + 1);
+            break;
+
+        case ItemType::List:
+            onChildren(i, Container::List, level + 1);
+            break;
+
+        case ItemType::Table:
+            onTable(i, level);
+            break;
+
+        case ItemType::Link: {
+            long long int p = -1;
+            long long int img = -1;
+
+            for (auto c = m_doc.firstChild(i); c != -1; c = m_doc.nextSibling(i, c)) {
+                (m_doc.type(c) == ItemType::Image ? img : p) = c;
+            }
+
+            if (img != -1 && !m_doc.url(img).isEmpty()) {
+                onItem(img, level + 1);
+            } else if (p != -1 && m_doc.firstChild(p) != -1) {
+                onItem(p, level + 1);
+            }
+        } break;
+
+        default:
+            break;
+        }
+    }
+
+    void onTable(long long int t,
+                 unsigned int level)
+    {
+        const auto header = m_doc.firstChild(t);
+
+        if (header == -1 || m_doc.columnsCount(t) == 0) {
+            return;
+        }
+
+        int columns = 0;
+
+        for (auto c = m_doc.firstChild(header); c != -1; c = m_doc.nextSibling(header, c)) {
+            onChildren(c, Container::TableCell, level + 1);
+
+            ++columns;
+        }
+
+        for (auto r = m_doc.nextSibling(t, header); r != -1; r = m_doc.nextSibling(t, r)) {
+            int i = 0;
+
+            for (auto c = m_doc.firstChild(r); c != -1; c = m_doc.nextSibling(r, c)) {
+                onChildren(c, Container::TableCell, level + 1);
+
+                ++i;
+
+                if (i == columns) {
+                    break;
+                }
+            }
+        }
+    }
+
+private:
+    const FrozenDocument<Trait> &m_doc;
+    unsigned int m_maxNestingLevel = 0;
+    const typename Trait::template Vector<ItemType> &m_types;
+    FrozenItemFunctor m_func = {};
+}; // class FrozenAlgoWalker
+
+} /* namespace details */
+
+//! Calls function for each item in the frozen document with the given type.
+//! Items are visited in the same order as forEach() visits items of the document.
+template<class Trait>
+inline void forEach(
+    //! Vector of item's types to be processed.
+    const typename Trait::template Vector<ItemType> &types,
+    //! Frozen document.
+    const FrozenDocument<Trait> &doc,
+    //! Functor object.
+    FrozenItemFunctor func,
+    //! Maximun nesting level.
+    //! 0 means infinity, 1 - only top level items...
+    unsigned int maxNestingLevel = 0)
+{
+    details::FrozenAlgoWalker<Trait> w(doc, maxNestingLevel, types, func);
+
+    w.walk();
+}
+
+//! Convert frozen document to HTML. Document is restored with thaw() for the time of conversion.
+template<class Trait>
+typename Trait::String
+toHtml(const FrozenDocument<Trait> &doc,
+       bool wrapInBodyTag = true,
+       const typename Trait::String &hrefForRefBackImage = {},
+       bool wrapInArticle = true,
+       unsigned int threadsCount = 1)
+{
+    return toHtml(thaw(doc), wrapInBodyTag, hrefForRefBackImage, wrapInArticle, threadsCount);
+}
+
+} /* namespace MD */
+
+#endif // MD4QT_MD_FROZEN_H_INCLUDED
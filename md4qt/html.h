@@ -8,16 +8,169 @@
 
 // md4qt include.
 #include "doc.h"
+#include "traits.h"
 #include "visitor.h"
 
 // C++ include.
 #include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
+#include <vector>
+
+#ifdef MD4QT_QT_SUPPORT
+
+// Qt include.
+#include <QIODevice>
+
+#endif // MD4QT_QT_SUPPORT
+
+#if defined(__AVX2__)
+
+// Intrinsics include.
+#include <immintrin.h>
+
+#endif // __AVX2__
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#define MD4QT_HTML_SSE2
+
+// Intrinsics include.
+#include <emmintrin.h>
+
+#endif // SSE2
+
+#ifdef _MSC_VER
+
+// Intrinsics include.
+#include <intrin.h>
+
+#endif // _MSC_VER
 
 namespace MD
 {
 
+//
+// HtmlSink
+//
+
+//! Receiver of HTML in UTF-8.
+class HtmlSink
+{
+public:
+    HtmlSink() = default;
+    virtual ~HtmlSink() = default;
+
+    //! Write chunk of HTML.
+    virtual void write(const char *data, long long int size) = 0;
+
+    //! Write string literal.
+    template<std::size_t N>
+    void write(const char (&literal)[N])
+    {
+        write(literal, N - 1);
+    }
+
+private:
+    MD_DISABLE_COPY(HtmlSink)
+}; // class HtmlSink
+
+//
+// HtmlStreamSink
+//
+
+//! Writes HTML to std::ostream.
+class HtmlStreamSink final : public HtmlSink
+{
+public:
+    explicit HtmlStreamSink(std::ostream &stream)
+        : m_stream(stream)
+    {
+    }
+
+    ~HtmlStreamSink() override = default;
+
+    using HtmlSink::write;
+
+    void write(const char *data, long long int size) override
+    {
+        m_stream.write(data, size);
+    }
+
+private:
+    MD_DISABLE_COPY(HtmlStreamSink)
+
+    std::ostream &m_stream;
+}; // class HtmlStreamSink
+
+//
+// HtmlCallbackSink
+//
+
+//! Passes chunks of HTML to the function.
+class HtmlCallbackSink final : public HtmlSink
+{
+public:
+    explicit HtmlCallbackSink(std::function<void(const char *, long long int)> func)
+        : m_func(std::move(func))
+    {
+    }
+
+    ~HtmlCallbackSink() override = default;
+
+    using HtmlSink::write;
+
+    void write(const char *data, long long int size) override
+    {
+        m_func(data, size);
+    }
+
+private:
+    MD_DISABLE_COPY(HtmlCallbackSink)
+
+    std::function<void(const char *, long long int)> m_func;
+}; // class HtmlCallbackSink
+
+#ifdef MD4QT_QT_SUPPORT
+
+//
+// HtmlIODeviceSink
+//
+
+//! Writes HTML to QIODevice.
+class HtmlIODeviceSink final : public HtmlSink
+{
+public:
+    explicit HtmlIODeviceSink(QIODevice *device)
+        : m_device(device)
+    {
+    }
+
+    ~HtmlIODeviceSink() override = default;
+
+    using HtmlSink::write;
+
+    void write(const char *data, long long int size) override
+    {
+        m_device->write(data, size);
+    }
+
+private:
+    MD_DISABLE_COPY(HtmlIODeviceSink)
+
+    QIODevice *m_device;
+}; // class HtmlIODeviceSink
+
+#endif // MD4QT_QT_SUPPORT
+
 namespace details
 {
 
@@ -50,6 +203,161 @@ typename Trait::String prepareTextForHtml(const typename Trait::String &t)
     return tmp;
 }
 
+//! \return Index of the lowest set bit.
+inline int lowestSetBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward(&idx, mask);
+
+    return static_cast<int>(idx);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+//! \return Position of the first '&', '<' or '>' in UTF-16 data starting with pos,
+//! or size if there is no such character.
+inline long long int findHtmlSpecialChar(const char16_t *data, long long int pos, long long int size)
+{
+#ifdef __AVX2__
+    {
+        const auto amp = _mm256_set1_epi16(u'&');
+        const auto lt = _mm256_set1_epi16(u'<');
+        const auto gt = _mm256_set1_epi16(u'>');
+
+        for (; pos + 16 <= size; pos += 16) {
+            const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+            const auto m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, amp), _mm256_cmpeq_epi16(v, lt)),
+                                           _mm256_cmpeq_epi16(v, gt));
+            const auto mask = static_cast<unsigned int>(_mm256_movemask_epi8(m));
+
+            if (mask) {
+                return pos + lowestSetBit(mask) / 2;
+            }
+        }
+    }
+#endif // __AVX2__
+
+#ifdef MD4QT_HTML_SSE2
+    {
+        const auto amp = _mm_set1_epi16(u'&');
+        const auto lt = _mm_set1_epi16(u'<');
+        const auto gt = _mm_set1_epi16(u'>');
+
+        for (; pos + 8 <= size; pos += 8) {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+            const auto m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, amp), _mm_cmpeq_epi16(v, lt)),
+                                        _mm_cmpeq_epi16(v, gt));
+            const auto mask = static_cast<unsigned int>(_mm_movemask_epi8(m));
+
+            if (mask) {
+                return pos + lowestSetBit(mask) / 2;
+            }
+        }
+    }
+#endif // MD4QT_HTML_SSE2
+
+    for (; pos < size; ++pos) {
+        switch (data[pos]) {
+        case u'&':
+        case u'<':
+        case u'>':
+            return pos;
+
+        default:
+            break;
+        }
+    }
+
+    return size;
+}
+
+//! Escape UTF-16 data for HTML in one pass, starting with the first special character
+//! at pos. Runs of characters without special ones are passed to append() at once.
+template<class Append>
+inline void escapeHtml(const char16_t *data, long long int pos, long long int size, Append append)
+{
+    long long int start = 0;
+
+    while (pos < size) {
+        append(data + start, pos - start);
+
+        switch (data[pos]) {
+        case u'&':
+            append(u"&amp;", 5);
+            break;
+
+        case u'<':
+            append(u"&lt;", 4);
+            break;
+
+        default:
+            append(u"&gt;", 4);
+            break;
+        }
+
+        start = pos + 1;
+        pos = findHtmlSpecialChar(data, start, size);
+    }
+
+    append(data + start, size - start);
+}
+
+#ifdef MD4QT_QT_SUPPORT
+
+template<>
+inline QString prepareTextForHtml<QStringTrait>(const QString &t)
+{
+    const auto data = reinterpret_cast<const char16_t *>(t.utf16());
+    const long long int size = t.size();
+    const auto pos = findHtmlSpecialChar(data, 0, size);
+
+    if (pos == size) {
+        return t;
+    }
+
+    QString res;
+    res.reserve(size + size / 8 + 4);
+
+    escapeHtml(data, pos, size, [&res](const char16_t *d, long long int n) {
+        res.append(reinterpret_cast<const QChar *>(d), n);
+    });
+
+    return res;
+}
+
+#endif // MD4QT_QT_SUPPORT
+
+#ifdef MD4QT_ICU_STL_SUPPORT
+
+template<>
+inline UnicodeString prepareTextForHtml<UnicodeStringTrait>(const UnicodeString &t)
+{
+    const char16_t *data = t.getBuffer();
+    const long long int size = t.length();
+    const auto pos = findHtmlSpecialChar(data, 0, size);
+
+    if (pos == size) {
+        return t;
+    }
+
+    UnicodeString res;
+
+    // Reserve capacity.
+    if (res.getBuffer(static_cast<int32_t>(size + size / 8 + 4))) {
+        res.releaseBuffer(0);
+    }
+
+    escapeHtml(data, pos, size, [&res](const char16_t *d, long long int n) {
+        res.append(d, 0, static_cast<int32_t>(n));
+    });
+
+    return res;
+}
+
+#endif // MD4QT_ICU_STL_SUPPORT
+
 template<class Trait>
 typename Trait::String tableAlignmentToHtml(typename Table<Trait>::Alignment a)
 {
@@ -94,7 +402,7 @@ public:
         m_isWrappedInArticle = wrappedInArticle;
 
         m_html.clear();
-        m_fns.clear();
+        clearFootnotes();
 
         this->process(doc);
 
@@ -103,7 +411,149 @@ public:
         return m_html;
     }
 
+    //! Write HTML to the sink. HTML is written by chunks during conversion,
+    //! so HTML of the whole document is not kept in memory.
+    void writeHtml(std::shared_ptr<Document<Trait>> doc,
+                   HtmlSink &sink,
+                   const typename Trait::String &hrefForRefBackImage,
+                   bool wrappedInArticle = true)
+    {
+        m_sink = &sink;
+
+        const auto rest = toHtml(doc, hrefForRefBackImage, wrappedInArticle);
+
+        m_sink = nullptr;
+
+        m_utf8.clear();
+        Trait::appendUtf8(m_utf8, rest);
+        sink.write(m_utf8.data(), m_utf8.size());
+    }
+
+    //! Convert document to HTML rendering ranges of top-level items concurrently.
+    //! 1 means to render in the calling thread, 0 means to use as many threads as
+    //! hardware supports. The result is the same as of toHtml().
+    typename Trait::String toHtmlConcurrently(std::shared_ptr<Document<Trait>> doc,
+                                              const typename Trait::String &hrefForRefBackImage,
+                                              bool wrappedInArticle,
+                                              unsigned int threadsCount)
+    {
+        static const long long int c_minItemsInSegment = 16;
+
+        const long long int itemsCount = doc->items().size();
+        const long long int threads = (threadsCount ? threadsCount :
+            std::max(1u, std::thread::hardware_concurrency()));
+        const long long int count = std::min(threads, itemsCount / c_minItemsInSegment);
+
+        if (count < 2) {
+            return toHtml(doc, hrefForRefBackImage, wrappedInArticle);
+        }
+
+        m_isWrappedInArticle = wrappedInArticle;
+
+        m_html.clear();
+        clearFootnotes();
+
+        this->setDocument(doc);
+
+        // References to footnotes are numbered in order of appearance, so footnotes
+        // before each segment are collected without HTML first.
+        struct Segment {
+            long long int m_first = 0;
+            long long int m_last = 0;
+            typename Trait::template Vector<FootnoteRefStuff> m_fns;
+            std::unordered_map<typename Trait::String, long long int, typename Trait::StringHash> m_fnsIndexes;
+        };
+
+        std::vector<Segment> segments;
+
+        m_justCollectFootnoteRefs = true;
+
+        for (long long int i = 0, first = 0; i < count; ++i) {
+            const auto last = first + itemsCount / count + (i < itemsCount % count ? 1 : 0);
+
+            segments.push_back({first, last, m_fns, m_fnsIndexes});
+
+            this->processItems(first, last);
+
+            first = last;
+        }
+
+        m_justCollectFootnoteRefs = false;
+
+        continueFootnoteRefsNumbering();
+
+        auto renderSegment = [&](Segment &segment) {
+            auto worker = makeWorker();
+            worker->m_isWrappedInArticle = wrappedInArticle;
+            worker->m_doc = doc;
+            worker->m_anchors = this->m_anchors;
+            worker->m_fns = std::move(segment.m_fns);
+            worker->m_fnsIndexes = std::move(segment.m_fnsIndexes);
+            worker->continueFootnoteRefsNumbering();
+            worker->processItems(segment.m_first, segment.m_last);
+
+            return std::move(worker->m_html);
+        };
+
+        std::vector<std::future<typename Trait::String>> results;
+
+        // First segment is rendered in the current thread, so skip it.
+        for (auto it = std::next(segments.begin()), last = segments.end(); it != last; ++it) {
+            results.push_back(std::async(std::launch::async, renderSegment, std::ref(*it)));
+        }
+
+        m_html = renderSegment(segments.front());
+
+        for (auto &r : results) {
+            m_html.push_back(r.get());
+        }
+
+        onFootnotes(hrefForRefBackImage);
+
+        return m_html;
+    }
+
 protected:
+    //! Write collected HTML to the sink, if HTML is written to the sink and enough of it is collected.
+    void flushHtml()
+    {
+        static const long long int chunkSize = 16 * 1024;
+
+        if (m_sink && static_cast<long long int>(m_html.size()) >= chunkSize) {
+            m_utf8.clear();
+            Trait::appendUtf8(m_utf8, m_html);
+            m_sink->write(m_utf8.data(), m_utf8.size());
+            m_html.clear();
+        }
+    }
+
+    void onTopLevelItemProcessed(Item<Trait> *) override
+    {
+        flushHtml();
+    }
+
+    //! \return New visitor of the same kind that renders a part of the document in toHtmlConcurrently().
+    virtual std::unique_ptr<HtmlVisitor<Trait>> makeWorker() const
+    {
+        return std::make_unique<HtmlVisitor<Trait>>();
+    }
+
+    //! Clear collected footnotes.
+    void clearFootnotes()
+    {
+        m_fns.clear();
+        m_fnsIndexes.clear();
+        m_dontIncrementFootnoteCount = false;
+    }
+
+    //! Continue numbering of references to footnotes from collected counts of references.
+    void continueFootnoteRefsNumbering()
+    {
+        for (auto &f : m_fns) {
+            f.m_current = f.m_count - 1;
+        }
+    }
+
     virtual void openStyle(const typename ItemWithOpts<Trait>::Styles &styles)
     {
         for (const auto &s : styles) {
@@ -481,7 +931,7 @@ protected:
             url = lit->second->url();
         }
 
-        if (std::find(this->m_anchors.cbegin(), this->m_anchors.cend(), url) != this->m_anchors.cend()) {
+        if (this->m_anchors.find(url) != this->m_anchors.cend()) {
             url = Trait::latin1ToString("#") + url;
         } else if (url.startsWith(Trait::latin1ToString("#")) &&
                    this->m_doc->labeledHeadings().find(url) == this->m_doc->labeledHeadings().cend()) {
@@ -547,9 +997,8 @@ protected:
         const auto fit = this->m_doc->footnotesMap().find(ref->id());
 
         if (fit != this->m_doc->footnotesMap().cend()) {
-            const auto r = std::find_if(m_fns.begin(), m_fns.end(), [&ref](const auto &stuff) {
-                return ref->id() == stuff.m_id;
-            });
+            const auto r = m_fnsIndexes.find(ref->id());
+            const bool isNew = (r == m_fnsIndexes.cend());
 
             if (!m_justCollectFootnoteRefs) {
                 openStyle(ref->openStyles());
@@ -562,17 +1011,19 @@ protected:
                 m_html.push_back(Trait::latin1ToString("-"));
             }
 
-            if (r == m_fns.end()) {
+            if (isNew) {
                 if (!m_justCollectFootnoteRefs) {
                     m_html.push_back(Trait::latin1ToString("1"));
                 }
             } else {
+                auto &stuff = m_fns[r->second];
+
                 if (!m_justCollectFootnoteRefs) {
-                    m_html.push_back(Trait::latin1ToString(std::to_string(++(r->m_current)).c_str()));
+                    m_html.push_back(Trait::latin1ToString(std::to_string(++(stuff.m_current)).c_str()));
                 }
 
                 if (!m_dontIncrementFootnoteCount) {
-                    ++(r->m_count);
+                    ++(stuff.m_count);
                 }
             }
 
@@ -580,14 +1031,15 @@ protected:
                 m_html.push_back(Trait::latin1ToString("\">"));
             }
 
-            if (r == m_fns.end()) {
+            if (isNew) {
                 if (!m_justCollectFootnoteRefs) {
                     m_html.push_back(Trait::latin1ToString(std::to_string(m_fns.size() + 1).c_str()));
                 }
 
+                m_fnsIndexes.insert({ref->id(), static_cast<long long int>(m_fns.size())});
                 m_fns.push_back({ref->id(), 1, 0});
             } else if (!m_justCollectFootnoteRefs)
-                m_html.push_back(Trait::latin1ToString(std::to_string(std::distance(m_fns.begin(), r) + 1).c_str()));
+                m_html.push_back(Trait::latin1ToString(std::to_string(r->second + 1).c_str()));
 
             if (!m_justCollectFootnoteRefs) {
                 m_html.push_back(Trait::latin1ToString("</a></sup>"));
@@ -663,51 +1115,64 @@ protected:
             m_html.push_back(Trait::latin1ToString("<section class=\"footnotes\"><ol>"));
         }
 
-        int i = 1;
+        // Count of references is needed only for back references, they are counted
+        // before footnotes are written, as footnotes may refer to each other.
+        if (!hrefForRefBackImage.isEmpty()) {
+            const auto count = static_cast<long long int>(m_fns.size());
+            m_justCollectFootnoteRefs = true;
 
-        const auto tmpm_fns = m_fns;
-        m_justCollectFootnoteRefs = true;
-
-        for (const auto &id : tmpm_fns) {
-            const auto fit = this->m_doc->footnotesMap().find(id.m_id);
+            for (long long int i = 0; i < count; ++i) {
+                const auto fit = this->m_doc->footnotesMap().find(m_fns[i].m_id);
 
-            if (fit != this->m_doc->footnotesMap().cend()) {
-                this->onFootnote(fit->second.get());
+                if (fit != this->m_doc->footnotesMap().cend()) {
+                    this->onFootnote(fit->second.get());
+                }
             }
+
+            m_justCollectFootnoteRefs = false;
         }
 
-        m_justCollectFootnoteRefs = false;
         m_dontIncrementFootnoteCount = true;
 
-        for (const auto &id : m_fns) {
+        // Footnotes may be added while footnotes are written.
+        for (long long int i = 0; i < static_cast<long long int>(m_fns.size()); ++i) {
+            const auto id = m_fns[i].m_id;
+
             m_html.push_back(Trait::latin1ToString("<li id=\""));
-            m_html.push_back(id.m_id);
+            m_html.push_back(id);
             m_html.push_back(Trait::latin1ToString("\">"));
-            ++i;
 
-            const auto fit = this->m_doc->footnotesMap().find(id.m_id);
+            const auto fit = this->m_doc->footnotesMap().find(id);
 
             if (fit != this->m_doc->footnotesMap().cend()) {
                 this->onFootnote(fit->second.get());
 
                 if (!hrefForRefBackImage.isEmpty()) {
-                    typename Trait::String backRef;
-                    long long int backRefPos = m_html.endsWith(Trait::latin1ToString("</p>")) ? 4 : 0;
-
-                    for (long long int i = 1; i <= id.m_count; ++i) {
-                        backRef.push_back(Trait::latin1ToString("<a href=\"#ref-"));
-                        backRef.push_back(id.m_id);
-                        backRef.push_back(Trait::latin1ToString("-"));
-                        backRef.push_back(Trait::latin1ToString(std::to_string(i).c_str()));
-                        backRef.push_back(Trait::latin1ToString("\"><img src=\""));
-                        backRef.push_back(hrefForRefBackImage);
-                        backRef.push_back(Trait::latin1ToString("\" /></a>"));
+                    // Back references are placed into the last paragraph.
+                    const bool inParagraph = m_html.endsWith(Trait::latin1ToString("</p>"));
+
+                    if (inParagraph) {
+                        m_html.remove(m_html.length() - 4, 4);
+                    }
+
+                    for (long long int j = 1; j <= m_fns[i].m_count; ++j) {
+                        m_html.push_back(Trait::latin1ToString("<a href=\"#ref-"));
+                        m_html.push_back(id);
+                        m_html.push_back(Trait::latin1ToString("-"));
+                        m_html.push_back(Trait::latin1ToString(std::to_string(j).c_str()));
+                        m_html.push_back(Trait::latin1ToString("\"><img src=\""));
+                        m_html.push_back(hrefForRefBackImage);
+                        m_html.push_back(Trait::latin1ToString("\" /></a>"));
                     }
 
-                    m_html.insert(m_html.length() - backRefPos, backRef);
+                    if (inParagraph) {
+                        m_html.push_back(Trait::latin1ToString("</p>"));
+                    }
                 }
 
                 m_html.push_back(Trait::latin1ToString("</li>"));
+
+                flushHtml();
             }
         }
 
@@ -724,6 +1189,10 @@ protected:
     bool m_dontIncrementFootnoteCount = false;
     //! Is this HTML wrapped in artcile tag?
     bool m_isWrappedInArticle = true;
+    //! Sink where HTML is written by chunks.
+    HtmlSink *m_sink = nullptr;
+    //! Buffer for UTF-8.
+    std::string m_utf8;
 
     struct FootnoteRefStuff {
         typename Trait::String m_id;
@@ -733,8 +1202,244 @@ protected:
 
     //! Vector of processed footnotes references.
     typename Trait::template Vector<FootnoteRefStuff> m_fns;
+    //! Indexes of footnotes in m_fns.
+    std::unordered_map<typename Trait::String, long long int, typename Trait::StringHash> m_fnsIndexes;
 }; // class HtmlVisitor
 
+//
+// CachingHtmlVisitor
+//
+
+//! HTML visitor that keeps HTML of top-level items between conversions and
+//! converts again only items that were changed.
+template<class Trait>
+class CachingHtmlVisitor : public HtmlVisitor<Trait>
+{
+public:
+    CachingHtmlVisitor() = default;
+    ~CachingHtmlVisitor() override = default;
+
+    //! State of footnotes when reference to footnote is met.
+    struct FootnoteRefState {
+        //! ID of footnote.
+        typename Trait::String m_id;
+        //! Index of footnote.
+        long long int m_index = 0;
+        //! Count of references to this footnote before, 0 if it's the first one.
+        long long int m_count = 0;
+
+        bool operator==(const FootnoteRefState &other) const
+        {
+            return (m_index == other.m_index && m_count == other.m_count && m_id == other.m_id);
+        }
+    };
+
+    //! HTML of top-level item.
+    struct Fragment {
+        //! Item, kept alive so another item can't get its address.
+        std::shared_ptr<Item<Trait>> m_item;
+        //! References to footnotes in the item.
+        std::vector<FootnoteRefState> m_refs;
+        //! HTML.
+        typename Trait::String m_html;
+    };
+
+    //! Convert document to HTML, HTML of top-level items is available with fragments().
+    //! HTML of items that are the same objects as in the previous conversion, like
+    //! not changed items after Parser::reparse(), is reused if references to footnotes
+    //! in them are numbered the same way and labels of the document are the same.
+    void render(std::shared_ptr<Document<Trait>> doc,
+                const typename Trait::String &hrefForRefBackImage,
+                bool wrappedInArticle)
+    {
+        this->m_isWrappedInArticle = wrappedInArticle;
+
+        this->m_html.clear();
+        this->clearFootnotes();
+
+        this->setDocument(doc);
+
+        auto context = documentContext(wrappedInArticle);
+        const bool sameContext = (context == m_context);
+        m_context = std::move(context);
+
+        std::unordered_map<Item<Trait> *, long long int> old;
+
+        if (sameContext) {
+            for (long long int i = 0; i < static_cast<long long int>(m_fragments.size()); ++i) {
+                old.insert({m_fragments[i].m_item.get(), i});
+            }
+        }
+
+        std::vector<Fragment> fragments;
+        fragments.reserve(doc->items().size());
+        m_changed.clear();
+
+        for (long long int i = 0; i < static_cast<long long int>(doc->items().size()); ++i) {
+            const auto &item = doc->items().at(i);
+            const auto it = old.find(item.get());
+
+            if (it != old.cend() && m_fragments[it->second].m_item == item &&
+                reuseFootnoteRefs(m_fragments[it->second].m_refs)) {
+                fragments.push_back(std::move(m_fragments[it->second]));
+            } else {
+                m_refs.clear();
+                m_logFootnoteRefs = true;
+
+                this->processItems(i, i + 1);
+
+                m_logFootnoteRefs = false;
+
+                fragments.push_back({item, std::move(m_refs), std::move(this->m_html)});
+                this->m_html.clear();
+                m_changed.push_back(i);
+            }
+        }
+
+        m_fragments = std::move(fragments);
+
+        this->onFootnotes(hrefForRefBackImage);
+
+        m_footnotesHtml = std::move(this->m_html);
+        this->m_html.clear();
+    }
+
+    //! \return HTML of top-level items from the last conversion.
+    const std::vector<Fragment> &fragments() const
+    {
+        return m_fragments;
+    }
+
+    //! \return Indexes of top-level items that were converted in the last conversion.
+    const std::vector<long long int> &changed() const
+    {
+        return m_changed;
+    }
+
+    //! \return HTML of footnotes from the last conversion.
+    const typename Trait::String &footnotesHtml() const
+    {
+        return m_footnotesHtml;
+    }
+
+    //! Drop all kept HTML.
+    void clear()
+    {
+        m_fragments.clear();
+        m_changed.clear();
+        m_context.clear();
+        m_footnotesHtml = {};
+    }
+
+protected:
+    void onFootnoteRef(
+        //! Footnote reference.
+        FootnoteRef<Trait> *ref) override
+    {
+        if (m_logFootnoteRefs &&
+            this->m_doc->footnotesMap().find(ref->id()) != this->m_doc->footnotesMap().cend()) {
+            m_refs.push_back(footnoteRefState(ref->id()));
+        }
+
+        HtmlVisitor<Trait>::onFootnoteRef(ref);
+    }
+
+    //! \return Current state of footnotes for reference to the given footnote.
+    FootnoteRefState footnoteRefState(const typename Trait::String &id) const
+    {
+        const auto it = this->m_fnsIndexes.find(id);
+
+        if (it == this->m_fnsIndexes.cend()) {
+            return {id, static_cast<long long int>(this->m_fns.size()), 0};
+        } else {
+            return {id, it->second, this->m_fns.at(it->second).m_count};
+        }
+    }
+
+    //! Account references to footnotes of the item with kept HTML, like it was converted.
+    //! \return Whether references are numbered the same way as before.
+    bool reuseFootnoteRefs(const std::vector<FootnoteRefState> &refs)
+    {
+        for (long long int i = 0; i < static_cast<long long int>(refs.size()); ++i) {
+            if (!(footnoteRefState(refs[i].m_id) == refs[i])) {
+                // Roll back accounted references.
+                for (long long int j = i - 1; j >= 0; --j) {
+                    if (refs[j].m_count == 0) {
+                        this->m_fnsIndexes.erase(refs[j].m_id);
+                        this->m_fns.pop_back();
+                    } else {
+                        auto &f = this->m_fns[refs[j].m_index];
+                        --f.m_count;
+                        --f.m_current;
+                    }
+                }
+
+                return false;
+            }
+
+            if (refs[i].m_count == 0) {
+                this->m_fnsIndexes.insert({refs[i].m_id, static_cast<long long int>(this->m_fns.size())});
+                this->m_fns.push_back({refs[i].m_id, 1, 0});
+            } else {
+                auto &f = this->m_fns[refs[i].m_index];
+                ++f.m_count;
+                ++f.m_current;
+            }
+        }
+
+        return true;
+    }
+
+    //! \return Everything in the document, besides top-level items, that changes HTML of items.
+    typename Trait::template Vector<typename Trait::String> documentContext(bool wrappedInArticle) const
+    {
+        typename Trait::template Vector<typename Trait::String> context;
+
+        context.push_back(Trait::latin1ToString(wrappedInArticle ? "article" : ""));
+
+        for (const auto &i : this->m_doc->items()) {
+            if (i->type() == ItemType::Anchor) {
+                context.push_back(static_cast<Anchor<Trait> *>(i.get())->label());
+            }
+        }
+
+        context.push_back(Trait::latin1ToString(std::to_string(this->m_doc->labeledLinks().size()).c_str()));
+
+        for (const auto &l : this->m_doc->labeledLinks()) {
+            context.push_back(l.first);
+            context.push_back(l.second->url());
+        }
+
+        context.push_back(Trait::latin1ToString(std::to_string(this->m_doc->labeledHeadings().size()).c_str()));
+
+        for (const auto &h : this->m_doc->labeledHeadings()) {
+            context.push_back(h.first);
+        }
+
+        context.push_back(Trait::latin1ToString(std::to_string(this->m_doc->footnotesMap().size()).c_str()));
+
+        for (const auto &f : this->m_doc->footnotesMap()) {
+            context.push_back(f.first);
+        }
+
+        return context;
+    }
+
+protected:
+    //! HTML of top-level items.
+    std::vector<Fragment> m_fragments;
+    //! Indexes of converted items.
+    std::vector<long long int> m_changed;
+    //! HTML of footnotes.
+    typename Trait::String m_footnotesHtml;
+    //! Labels of the document of the last conversion.
+    typename Trait::template Vector<typename Trait::String> m_context;
+    //! References to footnotes in the item being converted.
+    std::vector<FootnoteRefState> m_refs;
+    //! Log references to footnotes?
+    bool m_logFootnoteRefs = false;
+}; // class CachingHtmlVisitor
+
 } /* namespace details */
 
 template<class Trait>
@@ -742,7 +1447,9 @@ typename Trait::String
 toHtml(std::shared_ptr<Document<Trait>> doc,
        bool wrapInBodyTag = true,
        const typename Trait::String &hrefForRefBackImage = {},
-       bool wrapInArticle = true)
+       bool wrapInArticle = true,
+       //! Count of threads for rendering, 0 means to use as many threads as hardware supports.
+       unsigned int threadsCount = 1)
 {
     typename Trait::String html;
 
@@ -756,7 +1463,7 @@ toHtml(std::shared_ptr<Document<Trait>> doc,
 
     details::HtmlVisitor<Trait> visitor;
 
-    html.push_back(visitor.toHtml(doc, hrefForRefBackImage, wrapInArticle));
+    html.push_back(visitor.toHtmlConcurrently(doc, hrefForRefBackImage, wrapInArticle, threadsCount));
 
     if (wrapInArticle) {
         html.push_back(Trait::latin1ToString("</article>\n"));
@@ -769,6 +1476,117 @@ toHtml(std::shared_ptr<Document<Trait>> doc,
     return html;
 }
 
+//! Write HTML of the document to the sink in UTF-8. Wrapping tags are written as
+//! is, and HTML of the document is written by chunks during conversion.
+template<class Trait>
+void
+toHtml(std::shared_ptr<Document<Trait>> doc,
+       HtmlSink &sink,
+       bool wrapInBodyTag = true,
+       const typename Trait::String &hrefForRefBackImage = {},
+       bool wrapInArticle = true)
+{
+    if (wrapInBodyTag) {
+        sink.write("<!DOCTYPE html>\n<html><head></head><body>\n");
+    }
+
+    if (wrapInArticle) {
+        sink.write("<article class=\"markdown-body\">");
+    }
+
+    details::HtmlVisitor<Trait> visitor;
+
+    visitor.writeHtml(doc, sink, hrefForRefBackImage, wrapInArticle);
+
+    if (wrapInArticle) {
+        sink.write("</article>\n");
+    }
+
+    if (wrapInBodyTag) {
+        sink.write("</body></html>\n");
+    }
+}
+
+//
+// HtmlCache
+//
+
+//! Converter of document to HTML that keeps HTML of top-level items between conversions,
+//! so after Parser::reparse() only changed items are converted again. Items are recognized
+//! by identity, so items should not be changed in place, or the cache should be cleared.
+template<class Trait>
+class HtmlCache final
+{
+public:
+    HtmlCache() = default;
+    ~HtmlCache() = default;
+
+    //! \return HTML of the document, the same as of MD::toHtml().
+    typename Trait::String toHtml(std::shared_ptr<Document<Trait>> doc,
+                                  bool wrapInBodyTag = true,
+                                  const typename Trait::String &hrefForRefBackImage = {},
+                                  bool wrapInArticle = true)
+    {
+        m_visitor.render(doc, hrefForRefBackImage, wrapInArticle);
+
+        typename Trait::String html;
+
+        if (wrapInBodyTag) {
+            html.push_back(Trait::latin1ToString("<!DOCTYPE html>\n<html><head></head><body>\n"));
+        }
+
+        if (wrapInArticle) {
+            html.push_back(Trait::latin1ToString("<article class=\"markdown-body\">"));
+        }
+
+        for (const auto &f : m_visitor.fragments()) {
+            html.push_back(f.m_html);
+        }
+
+        html.push_back(m_visitor.footnotesHtml());
+
+        if (wrapInArticle) {
+            html.push_back(Trait::latin1ToString("</article>\n"));
+        }
+
+        if (wrapInBodyTag) {
+            html.push_back(Trait::latin1ToString("</body></html>\n"));
+        }
+
+        return html;
+    }
+
+    //! \return Indexes of top-level items that were converted by the last toHtml(),
+    //! other items have the same HTML as before.
+    const std::vector<long long int> &changedItems() const
+    {
+        return m_visitor.changed();
+    }
+
+    //! \return HTML of the top-level item with the given index from the last toHtml().
+    const typename Trait::String &itemHtml(long long int idx) const
+    {
+        return m_visitor.fragments().at(idx).m_html;
+    }
+
+    //! \return HTML of footnotes from the last toHtml().
+    const typename Trait::String &footnotesHtml() const
+    {
+        return m_visitor.footnotesHtml();
+    }
+
+    //! Drop all kept HTML.
+    void clear()
+    {
+        m_visitor.clear();
+    }
+
+private:
+    MD_DISABLE_COPY(HtmlCache)
+
+    details::CachingHtmlVisitor<Trait> m_visitor;
+}; // class HtmlCache
+
 } /* namespace MD */
 
 #endif // MD4QT_MD_HTML_HPP_INCLUDED
@@ -0,0 +1,257 @@
+/*
+    SPDX-FileCopyrightText: 2022-2024 Igor Mironchik <igor.mironchik@gmail.com>
+    SPDX-License-Identifier: MIT
+*/
+
+#ifndef MD4QT_MD_LIMITS_H_INCLUDED
+#define MD4QT_MD_LIMITS_H_INCLUDED
+
+// md4qt include.
+#include "utils.h"
+
+// C++ include.
+#include <atomic>
+#include <chrono>
+
+namespace MD
+{
+
+//
+// ParserLimits
+//
+
+//! Limits of resources used by parser. Zero value means no limit.
+//! When a limit is reached parser doesn't fail, but treats excess
+//! markup as text.
+struct ParserLimits {
+    //! Maximum depth of nesting of blockquotes and lists. Deeper
+    //! blockquotes and lists are parsed as paragraphs.
+    long long int m_maxNestingDepth = 0;
+    //! Maximum count of inline delimiters (emphases, brackets, backticks,
+    //! and so on) in one paragraph. Delimiters after it are text.
+    long long int m_maxDelimiters = 0;
+    //! Maximum size of one file in characters. Rest of the file is ignored.
+    long long int m_maxDocumentSize = 0;
+    //! Maximum time of parsing. When it's over, inline markup that was
+    //! not parsed yet is text.
+    std::chrono::milliseconds m_maxTime = std::chrono::milliseconds(0);
+    //! Maximum count of processed inline delimiters in all paragraphs.
+    //! When it's over, inline markup of next paragraphs is text.
+    long long int m_maxSteps = 0;
+
+    //! \return Is any limit set?
+    bool
+    isSet() const
+    {
+        return (m_maxNestingDepth > 0 || m_maxDelimiters > 0 || m_maxDocumentSize > 0 ||
+                m_maxTime.count() > 0 || m_maxSteps > 0);
+    }
+}; // struct ParserLimits
+
+//! Limit of parsing.
+enum ParserLimit {
+    //! No limit.
+    NoLimit = 0,
+    //! Depth of nesting of blockquotes and lists.
+    NestingDepthLimit = 1,
+    //! Count of inline delimiters in a paragraph.
+    DelimitersLimit = 2,
+    //! Size of a file.
+    DocumentSizeLimit = 4,
+    //! Time of parsing.
+    TimeLimit = 8,
+    //! Count of processed inline delimiters.
+    StepsLimit = 16
+}; // enum ParserLimit
+
+//
+// LimitsState
+//
+
+//! State of limits during parsing. Can be used from many threads.
+class LimitsState final
+{
+public:
+    LimitsState()
+    {
+        reset({});
+    }
+
+    ~LimitsState() = default;
+
+    //! Start to track new parsing with the given limits.
+    void
+    reset(const ParserLimits &limits)
+    {
+        m_limits = limits;
+        m_start = std::chrono::steady_clock::now();
+        m_reached.store(NoLimit, std::memory_order_relaxed);
+        m_steps.store(0, std::memory_order_relaxed);
+    }
+
+    //! \return Limits.
+    const ParserLimits &
+    limits() const
+    {
+        return m_limits;
+    }
+
+    //! \return Reached limits, combination of ParserLimit flags.
+    int
+    reached() const
+    {
+        return m_reached.load(std::memory_order_relaxed);
+    }
+
+    //! Mark the limit as reached.
+    void
+    setReached(ParserLimit l)
+    {
+        m_reached.fetch_or(l, std::memory_order_relaxed);
+    }
+
+    //! \return Whether the time of parsing is over.
+    bool
+    isTimeOver()
+    {
+        if (reached() & TimeLimit) {
+            return true;
+        }
+
+        if (m_limits.m_maxTime.count() > 0 &&
+            std::chrono::steady_clock::now() - m_start > m_limits.m_maxTime) {
+            setReached(TimeLimit);
+
+            return true;
+        }
+
+        return false;
+    }
+
+    //! Account processing of the given count of steps.
+    //! \return Whether the budget of time and steps allows to process them.
+    bool
+    consume(long long int steps)
+    {
+        if ((reached() & StepsLimit) || isTimeOver()) {
+            return false;
+        }
+
+        if (m_limits.m_maxSteps > 0 &&
+            m_steps.fetch_add(steps, std::memory_order_relaxed) + steps > m_limits.m_maxSteps) {
+            setReached(StepsLimit);
+
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    MD_DISABLE_COPY(LimitsState)
+
+    //! Limits.
+    ParserLimits m_limits;
+    //! Start of parsing.
+    std::chrono::steady_clock::time_point m_start = {};
+    //! Reached limits.
+    std::atomic<int> m_reached;
+    //! Count of processed steps.
+    std::atomic<long long int> m_steps;
+}; // class LimitsState
+
+//! \return State of limits of parsing in the current thread, may be null.
+inline LimitsState *&
+currentLimits()
+{
+    static thread_local LimitsState *limits = nullptr;
+
+    return limits;
+}
+
+namespace details
+{
+
+//! \return Depth of nesting of blockquotes and lists in the current thread.
+inline long long int &
+nestingDepth()
+{
+    static thread_local long long int depth = 0;
+
+    return depth;
+}
+
+} /* namespace details */
+
+//
+// LimitsScope
+//
+
+//! Set state of limits of parsing in the current thread for the lifetime
+//! of the scope. Null state switches limits off.
+class LimitsScope final
+{
+public:
+    explicit LimitsScope(LimitsState *limits)
+        : m_prev(currentLimits())
+        , m_prevDepth(details::nestingDepth())
+    {
+        currentLimits() = limits;
+        details::nestingDepth() = 0;
+    }
+
+    ~LimitsScope()
+    {
+        currentLimits() = m_prev;
+        details::nestingDepth() = m_prevDepth;
+    }
+
+private:
+    MD_DISABLE_COPY(LimitsScope)
+
+    LimitsState *m_prev = nullptr;
+    long long int m_prevDepth = 0;
+}; // class LimitsScope
+
+//
+// NestingScope
+//
+
+//! Increase depth of nesting of blockquotes and lists in the current
+//! thread for the lifetime of the scope.
+class NestingScope final
+{
+public:
+    NestingScope()
+    {
+        ++details::nestingDepth();
+    }
+
+    ~NestingScope()
+    {
+        --details::nestingDepth();
+    }
+
+    //! \return Whether the depth is allowed. If not, reaching of the limit is marked.
+    bool
+    isAllowed() const
+    {
+        auto limits = currentLimits();
+
+        if (limits && limits->limits().m_maxNestingDepth > 0 &&
+            details::nestingDepth() > limits->limits().m_maxNestingDepth) {
+            limits->setReached(NestingDepthLimit);
+
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    MD_DISABLE_COPY(NestingScope)
+}; // class NestingScope
+
+} /* namespace MD */
+
+#endif // MD4QT_MD_LIMITS_H_INCLUDED
@@ -7,8 +7,11 @@
 #define MD4QT_MD_PARSER_HPP_INCLUDED
 
 // md4qt include.
+#include "arena.h"
 #include "doc.h"
 #include "entities_map.h"
+#include "limits.h"
+#include "timings.h"
 #include "traits.h"
 #include "utils.h"
 
@@ -17,6 +20,7 @@
 // Qt include.
 #include <QDir>
 #include <QFile>
+#include <QStringDecoder>
 #include <QTextStream>
 
 #endif // MD4QT_QT_SUPPORT
@@ -32,12 +36,20 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
+#include <future>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <set>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace MD
@@ -91,6 +103,35 @@ lastNonSpacePos(const typename Trait::String &line)
     return i;
 } // lastNonSpacePos
 
+//! Lookup table of ASCII characters that may start a line of something other than a paragraph.
+struct BlockStartChars {
+    constexpr BlockStartChars()
+        : m_table()
+    {
+        for (const char c : {'#', '>', '[', '`', '~', '-', '+', '*'}) {
+            m_table[static_cast<unsigned char>(c)] = true;
+        }
+
+        for (char c = '0'; c <= '9'; ++c) {
+            m_table[static_cast<unsigned char>(c)] = true;
+        }
+    }
+
+    bool m_table[128];
+}; // struct BlockStartChars
+
+inline constexpr BlockStartChars s_blockStartChars = {};
+
+//! \return Can a line with the given first non-space character be anything but a paragraph's text?
+template<class Trait>
+inline bool
+canStartBlock(const typename Trait::Char &ch)
+{
+    const auto c = static_cast<unsigned int>(ch.unicode());
+
+    return (c < 128 && s_blockStartChars.m_table[c]);
+} // canStartBlock
+
 //! \return Starting sequence of the same characters.
 template<class Trait>
 inline typename Trait::String
@@ -223,6 +264,8 @@ struct MdLineData {
     using CommentDataMap = std::map<long long int, CommentData>;
     // std::pair< closed, valid >
     CommentDataMap m_htmlCommentData = {};
+    //! Byte offset of the start of the line in the source, -1 if it's not recorded.
+    long long int m_byteOffset = -1;
 }; // struct MdLineData
 
 //
@@ -858,6 +901,133 @@ styleToTextOption(Style s)
     }
 }
 
+//
+// EmphasisRun
+//
+
+//! Run of emphasis or strikethrough delimiters of a paragraph.
+struct EmphasisRun {
+    //! Line and position of the first delimiter of the run.
+    long long int m_line = -1;
+    long long int m_pos = -1;
+    //! Length of the run.
+    long long int m_len = 0;
+    //! 0 - strikethrough, 1 - "*", 2 - "_".
+    int m_type = -1;
+    bool m_canOpen = false;
+    bool m_canClose = false;
+    //! Lengths of closed styles, from the innermost. Closing delimiters are at the start of the run.
+    std::vector<long long int> m_closes = {};
+    //! Lengths of opened styles, from the outermost. Opening delimiters are at the end of the run.
+    std::vector<long long int> m_opens = {};
+}; // struct EmphasisRun
+
+//! Match runs of emphasis and strikethrough delimiters with the "process emphasis" procedure
+//! of CommonMark. Lower bounds of searches of openers are kept for each type of the closer,
+//! whether it can open and its length modulo 3, so each delimiter is skipped a bounded
+//! number of times. Strikethrough is matched by runs of equal length, like GFM does.
+inline void
+resolveEmphasisRuns(std::vector<EmphasisRun> &runs)
+{
+    const auto count = static_cast<long long int>(runs.size());
+
+    std::vector<long long int> prev(count), next(count), remaining(count);
+
+    for (long long int i = 0; i < count; ++i) {
+        prev[i] = i - 1;
+        next[i] = i + 1;
+        remaining[i] = runs[i].m_len;
+    }
+
+    const auto remove = [&](long long int i) {
+        if (prev[i] >= 0) {
+            next[prev[i]] = next[i];
+        }
+
+        if (next[i] < count) {
+            prev[next[i]] = prev[i];
+        }
+    };
+
+    long long int openersBottom[3][2][3];
+
+    for (auto &t : openersBottom) {
+        for (auto &o : t) {
+            std::fill(std::begin(o), std::end(o), -1);
+        }
+    }
+
+    for (long long int closer = 0; closer < count;) {
+        auto &c = runs[closer];
+
+        if (!c.m_canClose) {
+            closer = next[closer];
+
+            continue;
+        }
+
+        auto &bottom = openersBottom[c.m_type][c.m_canOpen ? 1 : 0][c.m_len % 3];
+        auto opener = prev[closer];
+
+        for (; opener > bottom; opener = prev[opener]) {
+            const auto &o = runs[opener];
+
+            if (o.m_canOpen && o.m_type == c.m_type) {
+                if (c.m_type == 0) {
+                    if (o.m_len == c.m_len) {
+                        break;
+                    }
+                } else if (!((c.m_canOpen || o.m_canClose) && c.m_len % 3 != 0 &&
+                             (o.m_len + c.m_len) % 3 == 0)) {
+                    // Rule of multiples of 3. Look at CommonMark 0.30 example 411.
+                    break;
+                }
+            }
+        }
+
+        if (opener > bottom) {
+            const auto use = (c.m_type == 0 ? c.m_len :
+                (remaining[closer] >= 2 && remaining[opener] >= 2 ? 2 : 1));
+
+            remaining[opener] -= use;
+            remaining[closer] -= use;
+
+            runs[opener].m_opens.push_back(use);
+            c.m_closes.push_back(use);
+
+            // Delimiters between the opener and the closer can't match anymore.
+            next[opener] = closer;
+            prev[closer] = opener;
+
+            if (!remaining[opener]) {
+                remove(opener);
+            }
+
+            if (!remaining[closer]) {
+                const auto n = next[closer];
+
+                remove(closer);
+
+                closer = n;
+            }
+        } else {
+            bottom = prev[closer];
+
+            const auto n = next[closer];
+
+            if (!c.m_canOpen) {
+                remove(closer);
+            }
+
+            closer = n;
+        }
+    }
+
+    for (auto &r : runs) {
+        std::reverse(r.m_opens.begin(), r.m_opens.end());
+    }
+}
+
 //
 // TextPluginFunc
 //
@@ -902,6 +1072,33 @@ struct TextParsingOpts {
     bool m_wasRefLink = false;
     bool m_checkLineOnNewType = false;
     bool m_firstInParagraph = true;
+    //! Resolved runs of emphasis delimiters, sorted by position, of delimiters from
+    //! m_emphasisFrom (inclusive) to m_emphasisTo (exclusive).
+    std::vector<EmphasisRun> m_emphasisRuns = {};
+    std::pair<long long int, long long int> m_emphasisFrom = {-1, -1};
+    std::pair<long long int, long long int> m_emphasisTo = {-1, -1};
+    //! Texts of links that contain other links, shared with parsing of nested link texts,
+    //! so text of each nested link is parsed only once.
+    std::shared_ptr<std::unordered_set<typename Trait::String, typename Trait::StringHash>> m_textsWithLinks = {};
+    //! Distances from opening square brackets (line and position) to the closing ones, or to the
+    //! end of delimiters if there is no closing bracket. Valid while the last line of text is
+    //! m_linkTextEndsLine.
+    std::map<std::pair<long long int, long long int>, long long int> m_linkTextEnds = {};
+    long long int m_linkTextEndsLine = -1;
+    //! Position of the nearest ">" delimiter after the m_greaterSearchFrom position,
+    //! {-1, -1} if there is no such delimiter.
+    std::pair<long long int, long long int> m_nearestGreater = {-1, -1};
+    std::pair<long long int, long long int> m_greaterSearchFrom = {-1, -1};
+
+    //! Ends of link destinations (not in "<>") starting at each position of the line, and
+    //! depths of parentheses before each position.
+    struct LinkDestinations {
+        long long int m_line = -1;
+        std::vector<long long int> m_ends = {};
+        std::vector<long long int> m_depths = {};
+    };
+
+    LinkDestinations m_linkDestinations = {};
 
     struct TextData {
         typename Trait::String m_str;
@@ -913,16 +1110,27 @@ struct TextParsingOpts {
 
     std::vector<TextData> m_rawTextData = {};
 
-    inline void
-    concatenateAuxText(long long int start, long long int end)
+    //! Concatenate raw text data from start to end (exclusive) into the item at position "to",
+    //! all items before "to" are already concatenated. Items are moved in place, so
+    //! concatenation of all groups of a paragraph is linear. \return Position of the next item.
+    inline long long int
+    concatenateAuxText(long long int start, long long int end, long long int to)
     {
-        if (start < end && (end - start > 1)) {
-            for (auto i = start + 1; i < end; ++i) {
-                m_rawTextData[start].m_str += m_rawTextData[i].m_str;
-            }
+        end = std::min(end, static_cast<long long int>(m_rawTextData.size()));
+
+        if (start >= end) {
+            return to;
+        }
+
+        if (to != start) {
+            m_rawTextData[to] = std::move(m_rawTextData[start]);
+        }
 
-            m_rawTextData.erase(m_rawTextData.cbegin() + start + 1, m_rawTextData.cbegin() + end);
+        for (auto i = start + 1; i < end; ++i) {
+            m_rawTextData[to].m_str += m_rawTextData[i].m_str;
         }
+
+        return to + 1;
     }
 
     enum class Detected { Nothing = 0, Table = 1, HTML = 2, List = 3, Code = 4 }; // enum class Detected
@@ -950,7 +1158,8 @@ struct TextParsingOpts {
     long long int m_lastTextPos = -1;
     int m_columnsCount = -1;
     int m_opts = TextWithoutFormat;
-    std::vector<std::pair<Style, long long int>> m_styles = {};
+    //! Opened styles with text options of the style and of all styles opened before it.
+    std::vector<std::pair<Style, int>> m_styles = {};
     typename ItemWithOpts<Trait>::Styles m_openStyles = {};
     std::shared_ptr<ItemWithOpts<Trait>> m_lastItemWithStyle = nullptr;
 }; // struct TextParsingOpts
@@ -1280,7 +1489,7 @@ processGitHubAutolinkExtension(std::shared_ptr<Paragraph<Trait>> p,
                                 ++ti;
                             }
 
-                            std::shared_ptr<Link<Trait>> lnk(new Link<Trait>);
+                            auto lnk = makeItem<Link<Trait>>();
                             lnk->setStartColumn(po.m_fr.m_data.at(s.m_line).first.virginPos(s.m_pos + j));
                             lnk->setStartLine(po.m_fr.m_data.at(s.m_line).second.m_lineNumber);
                             lnk->setEndColumn(
@@ -1318,7 +1527,7 @@ processGitHubAutolinkExtension(std::shared_ptr<Paragraph<Trait>> p,
                                 po.m_rawTextData.insert(po.m_rawTextData.cbegin() + idx, s);
                                 ++ret;
 
-                                auto t = std::make_shared<Text<Trait>>();
+                                auto t = makeItem<Text<Trait>>();
                                 t->setStartColumn(po.m_fr.m_data[s.m_line].first.virginPos(s.m_pos));
                                 t->setStartLine(po.m_fr.m_data.at(s.m_line).second.m_lineNumber);
                                 t->setEndLine(po.m_fr.m_data.at(s.m_line).second.m_lineNumber);
@@ -1421,6 +1630,32 @@ public:
         //! style delimiters, but one closing delimiter is in the middle.
         bool fullyOptimizeParagraphs = true);
 
+    //! Parse edited text reusing top-level blocks of the previous document that were not
+    //! affected by the edit. Blocks around the edit are parsed again, and line numbers of
+    //! blocks after the edit are shifted. If reference links or footnotes were defined in
+    //! the edited region, or the document is not a result of parsing of one stream, the
+    //! whole text is parsed again.
+    //!
+    //! \return Parsed Markdown document. This can be the given document changed in place.
+    std::shared_ptr<Document<Trait>>
+    reparse(
+        //! Document previously returned by parse() for the text before the edit.
+        std::shared_ptr<Document<Trait>> doc,
+        //! Stream with the whole text after the edit.
+        typename Trait::TextStream &stream,
+        //! Absolute path to the root folder for the document.
+        const typename Trait::String &path,
+        //! This argument needed only for anchor.
+        const typename Trait::String &fileName,
+        //! First edited line, it's the same in the text before and after the edit.
+        long long int firstLine,
+        //! Last edited line in the text before the edit, firstLine - 1 if lines were only inserted.
+        long long int lastLine,
+        //! Last edited line in the text after the edit, firstLine - 1 if lines were only removed.
+        long long int newLastLine,
+        //! Make full optimization, or just semi one.
+        bool fullyOptimizeParagraphs = true);
+
     //! Add text plugin.
     void
     addTextPlugin(
@@ -1445,13 +1680,198 @@ public:
         m_textPlugins.erase(id);
     }
 
+    //! Set whether files should be read through memory mapping. In this mode
+    //! a file is mapped into memory, decoded at once and split into lines directly
+    //! from the decoded buffer, without intermediate stream buffers.
+    //! Has effect only with QStringTrait, and only for files, not for streams.
+    //! If the file can't be mapped, it will be read as usual.
+    void
+    setMemoryMappedInput(bool on = true)
+    {
+        m_memoryMappedInput = on;
+    }
+
+    //! \return Whether files are read through memory mapping.
+    bool
+    isMemoryMappedInput() const
+    {
+        return m_memoryMappedInput;
+    }
+
+    //! Set whether byte offsets of lines in UTF-8 should be recorded while reading.
+    //! If recorded, they are available through Anchor::sourceOffsets() of the anchor
+    //! that starts each file in the document, and positions of items can be converted
+    //! into ranges of bytes in the source. With QStringTrait offsets are of UTF-8
+    //! encoding of the decoded text, so they match the source if it's in UTF-8 without
+    //! byte order mark. Zero characters in lines are not taken into account in columns.
+    void
+    setRecordByteOffsets(bool on = true)
+    {
+        m_byteOffsets = on;
+    }
+
+    //! \return Whether byte offsets of lines are recorded while reading.
+    bool
+    isRecordByteOffsets() const
+    {
+        return m_byteOffsets;
+    }
+
+    //! Set whether items of parsed documents should be allocated in a memory arena.
+    //! In this mode all items of one document are allocated in one monotonic arena,
+    //! that is released when the last item of the document is destroyed. Items are
+    //! still accessed through std::shared_ptr, so the API of the document is the same.
+    void
+    setArenaAllocation(bool on = true)
+    {
+        m_arenaAllocation = on;
+    }
+
+    //! \return Whether items of parsed documents are allocated in a memory arena.
+    bool
+    isArenaAllocation() const
+    {
+        return m_arenaAllocation;
+    }
+
+    //! Set whether time spent in phases of parsing should be measured.
+    void
+    setCollectPhaseTimings(bool on = true)
+    {
+        m_collectPhaseTimings = on;
+    }
+
+    //! \return Whether time spent in phases of parsing is measured.
+    bool
+    isCollectPhaseTimings() const
+    {
+        return m_collectPhaseTimings;
+    }
+
+    //! \return Time spent in phases of the last parsing, if measurement was switched on.
+    const PhaseTimings &
+    phaseTimings() const
+    {
+        return m_phaseTimings;
+    }
+
+    //! Set limits of resources used by parsing. By default there are no limits.
+    //! Limits are useful for untrusted input, when a limit is reached excess markup
+    //! is parsed as text, and the reached limit is reported by reachedLimits().
+    void
+    setLimits(const ParserLimits &limits)
+    {
+        m_limits = limits;
+    }
+
+    //! \return Limits of resources used by parsing.
+    const ParserLimits &
+    limits() const
+    {
+        return m_limits;
+    }
+
+    //! \return Limits reached during the last parsing, combination of ParserLimit flags.
+    int
+    reachedLimits() const
+    {
+        return m_limitsState.reached();
+    }
+
+    //! Set count of threads that may be used for parsing. 1 (default) means that
+    //! everything is parsed in the calling thread, 0 means to use as many threads
+    //! as hardware supports.
+    //!
+    //! When more than one thread allowed, after collecting of reference links
+    //! top-level blocks of big documents are parsed concurrently, and in recursive
+    //! mode linked files are parsed concurrently too. The result is the same as with
+    //! one thread. Text plugins should be thread-safe in this mode.
+    void
+    setThreadsCount(unsigned int count)
+    {
+        m_threadsCount = count;
+    }
+
+    //! \return Count of threads that may be used for parsing.
+    unsigned int
+    threadsCount() const
+    {
+        return m_threadsCount;
+    }
+
+    //! \return Count of links to files skipped during the last recursive parsing,
+    //! because the file was already parsed, is already in the queue, or can't be read.
+    long long int
+    skippedFilesCount() const
+    {
+        return m_skippedFilesCount;
+    }
+
 private:
+    //! Queue of files to parse in recursive mode, with constant-time check
+    //! of presence of a file in it.
+    class LinksQueue
+    {
+    public:
+        bool
+        isEmpty() const
+        {
+            return m_ids.empty();
+        }
+
+        bool
+        contains(long long int id) const
+        {
+            return (m_counts.find(id) != m_counts.cend());
+        }
+
+        const std::deque<long long int> &
+        ids() const
+        {
+            return m_ids;
+        }
+
+        void
+        push(long long int id)
+        {
+            m_ids.push_back(id);
+            ++m_counts[id];
+        }
+
+        long long int
+        pop()
+        {
+            const auto id = m_ids.front();
+            m_ids.pop_front();
+
+            const auto it = m_counts.find(id);
+
+            if (--it->second == 0) {
+                m_counts.erase(it);
+            }
+
+            return id;
+        }
+
+    private:
+        std::deque<long long int> m_ids;
+        std::unordered_map<long long int, long long int> m_counts;
+    }; // class LinksQueue
+
     void
     parseFile(const typename Trait::String &fileName,
               bool recursive,
               std::shared_ptr<Document<Trait>> doc,
               const typename Trait::StringList &ext,
-              typename Trait::StringList *parentLinks = nullptr);
+              LinksQueue *parentLinks = nullptr);
+
+    //! Read lines of the given file. \return Whether the file was read.
+    bool
+    readFile(const typename Trait::String &fileName,
+             const typename Trait::StringList &ext,
+             typename MdBlock<Trait>::Data &data,
+             typename Trait::String &workingPath,
+             typename Trait::String &name) const;
 
     void
     parseStream(typename Trait::TextStream &stream,
@@ -1460,7 +1880,40 @@ private:
                 bool recursive,
                 std::shared_ptr<Document<Trait>> doc,
                 const typename Trait::StringList &ext,
-                typename Trait::StringList *parentLinks = nullptr);
+                LinksQueue *parentLinks = nullptr);
+
+    void
+    parseData(typename MdBlock<Trait>::Data &data,
+              const typename Trait::String &workingPath,
+              const typename Trait::String &fileName,
+              bool recursive,
+              std::shared_ptr<Document<Trait>> doc,
+              const typename Trait::StringList &ext,
+              LinksQueue *parentLinks = nullptr);
+
+    //! Parse one file into the given document. \return Full path of the file.
+    typename Trait::String
+    parseDocument(typename MdBlock<Trait>::Data &data,
+                  const typename Trait::String &workingPath,
+                  const typename Trait::String &fileName,
+                  std::shared_ptr<Document<Trait>> doc,
+                  typename Trait::StringList &linksToParse);
+
+    void
+    parseLinks(const typename Trait::StringList &links,
+               bool recursive,
+               std::shared_ptr<Document<Trait>> doc,
+               const typename Trait::StringList &ext,
+               LinksQueue *parentLinks);
+
+    //! \return Identifier of the given path of file, new one if the path wasn't met before.
+    long long int
+    fileId(const typename Trait::String &path);
+
+    //! Concurrently parse all files reachable from the given links into m_crawledFiles.
+    void
+    crawlLinks(const typename Trait::StringList &links,
+               const typename Trait::StringList &ext);
 
     void
     clearCache();
@@ -1611,7 +2064,9 @@ private:
                                   bool collectRefLinks,
                                   bool ignoreLineBreak,
                                   RawHtmlBlock<Trait> &html,
-                                  bool inLink);
+                                  bool inLink,
+                                  std::shared_ptr<std::unordered_set<typename Trait::String,
+                                      typename Trait::StringHash>> textsWithLinks = {});
 
     RawHtmlBlock<Trait>
     parse(StringListStream<Trait> &stream,
@@ -1641,8 +2096,36 @@ private:
         BlockType m_type = BlockType::EmptyLine;
         BlockType m_lineType = BlockType::Unknown;
         BlockType m_prevLineType = BlockType::Unknown;
+        bool m_top = false;
     }; // struct ParserContext
 
+    void
+    parseSplittedBlock(ParserContext &ctx,
+                       MdBlock<Trait> &data,
+                       std::shared_ptr<Block<Trait>> parent,
+                       std::shared_ptr<Document<Trait>> doc,
+                       typename Trait::StringList &linksToParse,
+                       const typename Trait::String &workingPath,
+                       const typename Trait::String &fileName,
+                       bool collectRefLinks,
+                       bool top,
+                       bool dontProcessLastFreeHtml);
+
+    std::vector<std::pair<long long int, long long int>>
+    splitToSegments(long long int blocksCount) const;
+
+    void
+    parseSplittedInParallel(ParserContext &ctx,
+                            const std::vector<std::pair<long long int, long long int>> &segments,
+                            std::shared_ptr<Block<Trait>> parent,
+                            std::shared_ptr<Document<Trait>> doc,
+                            typename Trait::StringList &linksToParse,
+                            const typename Trait::String &workingPath,
+                            const typename Trait::String &fileName,
+                            bool collectRefLinks,
+                            bool top,
+                            bool dontProcessLastFreeHtml);
+
     void
     parseFragment(ParserContext &ctx,
                   std::shared_ptr<Block<Trait>> parent,
@@ -1806,6 +2289,19 @@ private:
     Delims
     collectDelimiters(const typename MdBlock<Trait>::Data &fr);
 
+    //! \return Is the delimiter of inline markup? Horizontal lines and setext
+    //! headings split paragraphs, so they are not.
+    static bool
+    isInlineDelimiter(const Delimiter &d)
+    {
+        return (d.m_type != Delimiter::HorizontalLine && d.m_type != Delimiter::H1 &&
+                d.m_type != Delimiter::H2);
+    }
+
+    //! Remove inline delimiters that exceed limits of parsing, so they are text.
+    void
+    limitDelimiters(Delims &delims);
+
     std::pair<typename Trait::String, bool>
     readHtmlTag(typename Delims::const_iterator it, TextParsingOpts<Trait> &po);
 
@@ -1941,12 +2437,6 @@ private:
         return start;
     }
 
-    void
-    createStyles(std::vector<std::pair<Style, long long int>> &s,
-                 long long int l,
-                 typename Delimiter::DelimiterType t,
-                 long long int &count);
-
     bool
     isSequence(typename Delims::const_iterator it,
                long long int itLine,
@@ -1968,23 +2458,10 @@ private:
     checkEmphasisSequence(const std::vector<std::pair<std::pair<long long int, bool>, int>> &s,
                           size_t idx);
 
-    std::vector<std::pair<std::pair<long long int, bool>, int>>
-    fixSequence(const std::vector<std::pair<std::pair<long long int, bool>, int>> &s);
-
-    std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>>
-    closedSequences(const std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>> &vars,
-                    size_t idx);
-
-    std::vector<std::pair<Style, long long int>>
-    createStyles(const std::vector<std::pair<std::pair<long long int, bool>, int>> &s,
-                 size_t i,
-                 typename Delimiter::DelimiterType t,
-                 long long int &count);
-
-    std::tuple<bool, std::vector<std::pair<Style, long long int>>, long long int, long long int>
-    isStyleClosed(typename Delims::const_iterator it,
-                  typename Delims::const_iterator last,
-                  TextParsingOpts<Trait> &po);
+    void
+    collectEmphasisRuns(typename Delims::const_iterator it,
+                        typename Delims::const_iterator last,
+                        TextParsingOpts<Trait> &po);
 
     typename Delims::const_iterator
     incrementIterator(typename Delims::const_iterator it,
@@ -1992,8 +2469,7 @@ private:
                       long long int count);
 
     typename Delims::const_iterator
-    checkForStyle(typename Delims::const_iterator first,
-                  typename Delims::const_iterator it,
+    checkForStyle(typename Delims::const_iterator it,
                   typename Delims::const_iterator last,
                   TextParsingOpts<Trait> &po);
 
@@ -2034,9 +2510,44 @@ private:
     friend struct PrivateAccess;
 
 private:
-    typename Trait::StringList m_parsedFiles;
+    //! File parsed by crawler in recursive mode.
+    struct CrawledFile {
+        //! Document of the file, null if the file can't be read.
+        std::shared_ptr<Document<Trait>> m_doc;
+        //! Links from the file.
+        typename Trait::StringList m_links;
+        //! Full path of the file.
+        typename Trait::String m_path;
+        //! Whether this result was already appended to the main document.
+        bool m_used = false;
+    };
+
+    //! State of a file in recursive mode.
+    enum class FileState {
+        NotParsed,
+        Parsed,
+        //! File can't be read.
+        Failed
+    };
+
+    //! Identifiers of files met in recursive mode.
+    std::unordered_map<typename Trait::String, long long int, typename Trait::StringHash> m_fileIds;
+    //! Paths of files by their identifiers.
+    std::vector<typename Trait::String> m_filePaths;
+    //! States of files by their identifiers.
+    std::vector<FileState> m_filesState;
+    long long int m_skippedFilesCount = 0;
+    typename Trait::template Map<typename Trait::String, CrawledFile> m_crawledFiles;
     TextPluginsMap<Trait> m_textPlugins;
     bool m_fullyOptimizeParagraphs = true;
+    bool m_memoryMappedInput = false;
+    bool m_byteOffsets = false;
+    bool m_arenaAllocation = false;
+    bool m_collectPhaseTimings = false;
+    PhaseTimings m_phaseTimings;
+    unsigned int m_threadsCount = 1;
+    ParserLimits m_limits;
+    LimitsState m_limitsState;
 
     MD_DISABLE_COPY(Parser)
 }; // class Parser
@@ -2053,6 +2564,15 @@ Parser<Trait>::parse(const typename Trait::String &fileName,
                      bool fullyOptimizeParagraphs)
 {
     m_fullyOptimizeParagraphs = fullyOptimizeParagraphs;
+    m_skippedFilesCount = 0;
+
+    ArenaScope arena(m_arenaAllocation ? std::make_shared<Arena>() : nullptr);
+
+    m_phaseTimings.clear();
+    PhaseTimingsScope timings(m_collectPhaseTimings ? &m_phaseTimings : nullptr);
+    m_limitsState.reset(m_limits);
+    LimitsScope limits(m_limits.isSet() ? &m_limitsState : nullptr);
+    PhaseScope phase(ParsingPhase::Blocks);
 
     std::shared_ptr<Document<Trait>> doc(new Document<Trait>);
 
@@ -2071,6 +2591,15 @@ Parser<Trait>::parse(typename Trait::TextStream &stream,
                      bool fullyOptimizeParagraphs)
 {
     m_fullyOptimizeParagraphs = fullyOptimizeParagraphs;
+    m_skippedFilesCount = 0;
+
+    ArenaScope arena(m_arenaAllocation ? std::make_shared<Arena>() : nullptr);
+
+    m_phaseTimings.clear();
+    PhaseTimingsScope timings(m_collectPhaseTimings ? &m_phaseTimings : nullptr);
+    m_limitsState.reset(m_limits);
+    LimitsScope limits(m_limits.isSet() ? &m_limitsState : nullptr);
+    PhaseScope phase(ParsingPhase::Blocks);
 
     std::shared_ptr<Document<Trait>> doc(new Document<Trait>);
 
@@ -2091,10 +2620,12 @@ template<>
 class TextStream<QStringTrait>
 {
 public:
-    TextStream(QTextStream &stream)
+    TextStream(QTextStream &stream,
+               bool countBytes = false)
         : m_stream(stream)
         , m_lastBuf(false)
         , m_pos(0)
+        , m_countBytes(countBytes)
     {
     }
 
@@ -2111,30 +2642,70 @@ public:
         bool rFound = false;
 
         while (!atEnd()) {
-            const auto c = getChar();
+            if (m_pos == m_buf.size()) {
+                fillBuf();
 
-            if (rFound && c != QLatin1Char('\n')) {
-                --m_pos;
+                continue;
+            }
+
+            if (rFound) {
+                if (m_buf.at(m_pos) == QLatin1Char('\n')) {
+                    ++m_pos;
+                    ++m_offset;
+                }
 
-                return line;
+                break;
             }
 
-            if (c == QLatin1Char('\r')) {
-                rFound = true;
+            const auto e = findLineEnd(m_buf, m_pos);
 
-                continue;
-            } else if (c == QLatin1Char('\n')) {
-                return line;
+            line.append(QStringView(m_buf).sliced(m_pos, e - m_pos));
+
+            if (m_countBytes) {
+                m_offset += SourceOffsets::utf8Length(reinterpret_cast<const char16_t *>(m_buf.utf16()) + m_pos,
+                                                      e - m_pos) + (e < m_buf.size() ? 1 : 0);
             }
 
-            if (!c.isNull()) {
-                line.push_back(c);
+            if (e == m_buf.size()) {
+                m_pos = e;
+            } else {
+                m_pos = e + 1;
+
+                if (m_buf.at(e) == QLatin1Char('\r')) {
+                    rFound = true;
+                } else {
+                    break;
+                }
             }
         }
 
+        if (line.contains(QChar())) {
+            line.remove(QChar());
+        }
+
         return line;
     }
 
+    //! \return Count of bytes of UTF-8 encoding of the read text, if bytes are counted.
+    long long int
+    offset() const
+    {
+        return m_offset;
+    }
+
+    //! \return Position of the first line break character starting from \p pos,
+    //! or length of the string if there is no any.
+    static long long int
+    findLineEnd(QStringView str,
+                long long int pos)
+    {
+        const auto it = std::find_if(str.cbegin() + pos, str.cend(), [](const QChar &c) {
+            return (c == QLatin1Char('\n') || c == QLatin1Char('\r'));
+        });
+
+        return std::distance(str.cbegin(), it);
+    }
+
 private:
     void
     fillBuf()
@@ -2148,126 +2719,188 @@ private:
         m_pos = 0;
     }
 
-    QChar
-    getChar()
-    {
-        if (m_pos < m_buf.size()) {
-            return m_buf.at(m_pos++);
-        } else if (!atEnd()) {
-            fillBuf();
-
-            return getChar();
-        } else {
-            return QChar();
-        }
-    }
-
 private:
     QTextStream &m_stream;
     QString m_buf;
     bool m_lastBuf;
     long long int m_pos;
+    bool m_countBytes;
+    long long int m_offset = 0;
 }; // class TextStream
 
-#endif
+//! Split already decoded content into lines. Each line is copied only once.
+inline void
+splitToLines(const QString &content,
+             MdBlock<QStringTrait>::Data &data,
+             bool byteOffsets = false)
+{
+    long long int pos = 0;
+    long long int i = 0;
+    long long int offset = 0;
 
-#ifdef MD4QT_ICU_STL_SUPPORT
+    do {
+        const auto e = TextStream<QStringTrait>::findLineEnd(content, pos);
 
-//! Wrapper for std::istream.
-template<>
-class TextStream<UnicodeStringTrait>
-{
-public:
-    TextStream(std::istream &stream)
-        : m_pos(0)
-    {
-        std::vector<unsigned char> content;
-
-        stream.seekg(0, std::ios::end);
-        const auto ssize = stream.tellg();
-        content.resize((size_t)ssize + 1);
-        stream.seekg(0, std::ios::beg);
-        stream.read((char *)&content[0], ssize);
-        content[(size_t)ssize] = 0;
-
-        const auto z = std::count(content.cbegin(), content.cend(), 0);
-
-        if (z > 1) {
-            std::vector<unsigned char> tmp;
-            tmp.resize(content.size() + (z - 1) * 2);
-
-            for (size_t i = 0, j = 0; i < content.size() - 1; ++i, ++j) {
-                if (content[i] == 0) {
-                    // 0xFFFD - replacement character in UTF-8.
-                    tmp[j++] = 0xEF;
-                    tmp[j++] = 0xBF;
-                    tmp[j] = 0xBD;
-                } else {
-                    tmp[j] = content[i];
-                }
-            }
+        auto line = content.sliced(pos, e - pos);
+
+        if (line.contains(QChar())) {
+            line.remove(QChar());
+        }
+
+        data.push_back(std::pair<QStringTrait::InternalString, MdLineData>(line, {i, {}, (byteOffsets ? offset : -1)}));
+        ++i;
+
+        if (byteOffsets) {
+            offset += SourceOffsets::utf8Length(reinterpret_cast<const char16_t *>(content.utf16()) + pos,
+                                                std::min<long long int>(e + 1, content.size()) - pos);
+        }
 
-            tmp[tmp.size() - 1] = 0;
+        pos = e + 1;
 
-            std::swap(content, tmp);
+        if (e < content.size() && content.at(e) == QLatin1Char('\r') && pos < content.size()
+            && content.at(pos) == QLatin1Char('\n')) {
+            ++pos;
+            ++offset;
         }
+    } while (pos < content.size());
+}
+
+#endif
+
+#ifdef MD4QT_ICU_STL_SUPPORT
+
+//! Wrapper for std::istream.
+//!
+//! Reads the stream by chunks, so it works with non-seekable streams too, and
+//! keeps in memory only one chunk plus the longest line. Zero bytes are replaced
+//! with U+FFFD.
+template<>
+class TextStream<UnicodeStringTrait>
+{
+public:
+    //! Bytes are always counted, as the stream is read by bytes.
+    TextStream(std::istream &stream,
+               bool countBytes = false)
+        : m_stream(stream)
+        , m_pos(0)
+        , m_eof(false)
+    {
+        MD_UNUSED(countBytes)
 
-        m_str = UnicodeString::fromUTF8((char *)&content[0]);
+        fillBuf();
     }
 
     bool
     atEnd() const
     {
-        return m_pos == m_str.size();
+        return (m_eof && m_pos == m_buf.size());
     }
 
     UnicodeString
     readLine()
     {
         UnicodeString line;
-
+        std::string bytes;
         bool rFound = false;
+        bool whole = true;
 
         while (!atEnd()) {
-            const auto c = getChar();
+            if (m_pos == m_buf.size()) {
+                fillBuf();
+
+                continue;
+            }
 
-            if (rFound && c != UnicodeChar('\n')) {
-                --m_pos;
+            if (rFound) {
+                if (m_buf[m_pos] == '\n') {
+                    ++m_pos;
+                }
 
-                return line;
+                break;
             }
 
-            if (c == UnicodeChar('\r')) {
-                rFound = true;
+            const auto e = findLineEnd(m_pos);
+
+            if (whole && e < m_buf.size() && m_buf[e] != 0) {
+                // The most often case - the line is in the buffer and doesn't
+                // contain zero bytes, so convert it without intermediate copy.
+                line = UnicodeString::fromUTF8(icu::StringPiece(m_buf.data() + m_pos, e - m_pos));
+            } else {
+                whole = false;
+                bytes.append(m_buf, m_pos, e - m_pos);
+            }
 
+            m_pos = e;
+
+            if (e == m_buf.size()) {
                 continue;
-            } else if (c == UnicodeChar('\n')) {
-                return line;
             }
 
-            if (!c.isNull()) {
-                line.push_back(c);
+            const auto c = m_buf[m_pos++];
+
+            if (c == 0) {
+                // 0xFFFD - replacement character in UTF-8.
+                bytes.append("\xEF\xBF\xBD");
+            } else if (c == '\r') {
+                rFound = true;
+            } else {
+                break;
             }
         }
 
+        if (m_pos == m_buf.size() && !m_eof) {
+            fillBuf();
+        }
+
+        if (!whole) {
+            line = UnicodeString::fromUTF8(bytes);
+        }
+
         return line;
     }
 
+    //! \return Count of read bytes.
+    long long int
+    offset() const
+    {
+        return m_consumed + static_cast<long long int>(m_pos);
+    }
+
 private:
-    UnicodeChar
-    getChar()
+    void
+    fillBuf()
     {
-        if (!atEnd()) {
-            return m_str[m_pos++];
-        } else {
-            return UnicodeChar();
+        m_consumed += static_cast<long long int>(m_buf.size());
+        m_buf.resize(s_chunkSize);
+        m_stream.read(&m_buf[0], s_chunkSize);
+        m_buf.resize((size_t)m_stream.gcount());
+        m_pos = 0;
+
+        if (m_buf.empty() || !m_stream.good()) {
+            m_eof = true;
         }
     }
 
+    size_t
+    findLineEnd(size_t pos) const
+    {
+        const auto it = std::find_if(m_buf.cbegin() + pos, m_buf.cend(), [](char c) {
+            return (c == '\n' || c == '\r' || c == 0);
+        });
+
+        return (size_t)std::distance(m_buf.cbegin(), it);
+    }
+
 private:
-    UnicodeString m_str;
-    long long int m_pos;
-};
+    static const size_t s_chunkSize = 64 * 1024;
+
+    std::istream &m_stream;
+    std::string m_buf;
+    size_t m_pos;
+    bool m_eof;
+    //! Count of bytes in previous chunks.
+    long long int m_consumed = 0;
+}; // class TextStream
 
 #endif
 
@@ -2319,11 +2952,19 @@ checkForHtmlComments(const typename Trait::InternalString &line,
         } else {
             addNegative = true;
 
-            for (; l < stream.size(); ++l) {
+            // The first "-->" decides, so only appended lines are searched, otherwise
+            // a long unclosed comment is quadratic.
+            long long int e = c.indexOf(Trait::latin1ToString("-->"), 4);
+
+            for (; e == -1 && l < stream.size(); ++l) {
+                const auto from = c.length();
+
                 c.push_back(Trait::latin1ToChar(' '));
                 c.push_back(stream.lineAt(l).asString());
 
-                if (checkForEndHtmlComments<Trait>(c, 4)) {
+                e = c.indexOf(Trait::latin1ToString("-->"), from);
+
+                if (e != -1 && isHtmlComment<Trait>(c.sliced(0, e + 3))) {
                     res.insert({line.virginPos(p), {2, true}});
 
                     addNegative = false;
@@ -2334,6 +2975,8 @@ checkForHtmlComments(const typename Trait::InternalString &line,
         }
 
         if (addNegative) {
+            l = stream.size();
+
             res.insert({line.virginPos(p), {-1, false}});
         }
 
@@ -2341,6 +2984,31 @@ checkForHtmlComments(const typename Trait::InternalString &line,
     }
 }
 
+//! \return Is raw HTML state same as before parsing of any block.
+template<class Trait>
+inline bool
+isHtmlStateClean(const RawHtmlBlock<Trait> &html)
+{
+    return (!html.m_html && !html.m_parent && !html.m_topParent && html.m_blocks.empty() &&
+            html.m_htmlBlockType == -1 && !html.m_continueHtml && !html.m_onLine);
+}
+
+//! \return Can the given lines contain reference links, footnotes or raw HTML.
+template<class Trait>
+inline bool
+mayHaveRefLinksOrHtml(const typename MdBlock<Trait>::Data &data)
+{
+    for (const auto &l : data) {
+        const auto &s = l.first.asString();
+
+        if (s.contains(Trait::latin1ToChar('<')) || s.contains(Trait::latin1ToString("]:"))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 template<class Trait>
 inline void
 Parser<Trait>::parseFragment(typename Parser<Trait>::ParserContext &ctx,
@@ -2358,7 +3026,10 @@ Parser<Trait>::parseFragment(typename Parser<Trait>::ParserContext &ctx,
 
         ctx.m_splitted.push_back(block);
 
-        long long int line = 0;
+        // On the top level fragments are parsed again after collecting of reference links,
+        // so skip fragments that can't give anything now.
+        long long int line = (collectRefLinks && ctx.m_top && isHtmlStateClean(ctx.m_html) &&
+            !mayHaveRefLinksOrHtml<Trait>(ctx.m_fragment) ? -1 : 0);
 
         while (line >= 0) {
             line = parseFragment(block, parent, doc, linksToParse, workingPath,
@@ -2403,6 +3074,10 @@ template<class Trait>
 inline void
 replaceTabs(typename Trait::InternalString &s)
 {
+    if (!s.asString().contains(Trait::latin1ToChar('\t'))) {
+        return;
+    }
+
     unsigned char size = 4;
     long long int len = s.length();
 
@@ -2518,7 +3193,7 @@ Parser<Trait>::finishHtml(ParserContext &ctx,
                     p->setEndColumn(ctx.m_html.m_html->endColumn());
                     p->setEndLine(ctx.m_html.m_html->endLine());
                 } else {
-                    std::shared_ptr<Paragraph<Trait>> p(new Paragraph<Trait>);
+                    auto p = makeItem<Paragraph<Trait>>();
                     p->appendItem(ctx.m_html.m_html);
                     p->setStartColumn(ctx.m_html.m_html->startColumn());
                     p->setStartLine(ctx.m_html.m_html->startLine());
@@ -2527,7 +3202,7 @@ Parser<Trait>::finishHtml(ParserContext &ctx,
                     doc->appendItem(p);
                 }
             } else {
-                std::shared_ptr<Paragraph<Trait>> p(new Paragraph<Trait>);
+                auto p = makeItem<Paragraph<Trait>>();
                 p->appendItem(ctx.m_html.m_html);
                 p->setStartColumn(ctx.m_html.m_html->startColumn());
                 p->setStartLine(ctx.m_html.m_html->startLine());
@@ -2651,6 +3326,7 @@ Parser<Trait>::parse(StringListStream<Trait> &stream,
                      bool dontProcessLastFreeHtml)
 {
     ParserContext ctx;
+    ctx.m_top = top;
 
     while (!stream.atEnd()) {
         const auto currentLineNumber = stream.currentLineNumber();
@@ -2930,59 +3606,276 @@ Parser<Trait>::parse(StringListStream<Trait> &stream,
     if (top) {
         resetHtmlTag(ctx.m_html);
 
-        for (long long int i = 0; i < (long long int)ctx.m_splitted.size(); ++i) {
-            long long int line = 0;
+        const auto segments = splitToSegments(ctx.m_splitted.size());
 
-            auto &data = ctx.m_splitted[i];
+        if (segments.size() > 1) {
+            parseSplittedInParallel(ctx, segments, parent, doc, linksToParse, workingPath, fileName,
+                collectRefLinks, top, dontProcessLastFreeHtml);
+        } else {
+            for (auto &data : ctx.m_splitted) {
+                parseSplittedBlock(ctx, data, parent, doc, linksToParse, workingPath, fileName,
+                    collectRefLinks, top, dontProcessLastFreeHtml);
+            }
+        }
+    }
 
-            while (line >= 0) {
-                line = parseFragment(data, parent, doc, linksToParse, workingPath, fileName, false, ctx.m_html);
+    if (ctx.m_html.m_html) {
+        finishHtml(ctx, parent, doc, collectRefLinks, top, dontProcessLastFreeHtml);
+    }
 
-                assert(line != 0);
+    return ctx.m_html;
+}
 
-                if (line > 0) {
-                    if (ctx.m_html.m_html) {
-                        ctx.m_html.m_parent->appendItem(ctx.m_html.m_html);
+template<class Trait>
+inline void
+Parser<Trait>::parseSplittedBlock(ParserContext &ctx,
+                                  MdBlock<Trait> &data,
+                                  std::shared_ptr<Block<Trait>> parent,
+                                  std::shared_ptr<Document<Trait>> doc,
+                                  typename Trait::StringList &linksToParse,
+                                  const typename Trait::String &workingPath,
+                                  const typename Trait::String &fileName,
+                                  bool collectRefLinks,
+                                  bool top,
+                                  bool dontProcessLastFreeHtml)
+{
+    long long int line = 0;
 
-                        resetHtmlTag<Trait>(ctx.m_html);
-                    }
+    while (line >= 0) {
+        line = parseFragment(data, parent, doc, linksToParse, workingPath, fileName, false, ctx.m_html);
 
-                    const auto it = std::find_if(data.m_data.cbegin(), data.m_data.cend(), [line](const auto &d) {
-                        return (d.second.m_lineNumber == line);
-                    });
+        assert(line != 0);
 
-                    data.m_data.erase(data.m_data.cbegin(), it);
-                }
+        if (line > 0) {
+            if (ctx.m_html.m_html) {
+                ctx.m_html.m_parent->appendItem(ctx.m_html.m_html);
+
+                resetHtmlTag<Trait>(ctx.m_html);
+            }
+
+            const auto it = std::find_if(data.m_data.cbegin(), data.m_data.cend(), [line](const auto &d) {
+                return (d.second.m_lineNumber == line);
+            });
+
+            data.m_data.erase(data.m_data.cbegin(), it);
+        }
+    }
+
+    if (ctx.m_html.m_htmlBlockType >= 6) {
+        ctx.m_html.m_continueHtml = (!data.m_emptyLineAfter);
+    }
+
+    if (ctx.m_html.m_html && !ctx.m_html.m_continueHtml) {
+        finishHtml(ctx, parent, doc, collectRefLinks, top, dontProcessLastFreeHtml);
+    } else if (!ctx.m_html.m_html) {
+        ctx.m_html.m_toAdjustLastPos.clear();
+    }
+}
+
+template<class Trait>
+inline std::vector<std::pair<long long int, long long int>>
+Parser<Trait>::splitToSegments(long long int blocksCount) const
+{
+    static const long long int c_minBlocksInSegment = 16;
+
+    std::vector<std::pair<long long int, long long int>> segments;
+
+    const long long int threads = (m_threadsCount ? m_threadsCount :
+        std::max(1u, std::thread::hardware_concurrency()));
+    const long long int count = std::min(threads, blocksCount / c_minBlocksInSegment);
+
+    if (count > 1) {
+        const auto size = blocksCount / count;
+        const auto rest = blocksCount % count;
+
+        for (long long int i = 0, first = 0; i < count; ++i) {
+            const auto last = first + size + (i < rest ? 1 : 0);
+
+            segments.push_back({first, last});
+
+            first = last;
+        }
+    }
+
+    return segments;
+}
+
+//! \return Would be the given item joined with the previous one if they were
+//! parsed in one sequence.
+template<class Trait>
+inline bool
+canBeJoinedWithPrevious(const std::shared_ptr<Item<Trait>> &prev,
+                        const std::shared_ptr<Item<Trait>> &item)
+{
+    switch (item->type()) {
+    case ItemType::Paragraph: {
+        auto p = static_cast<Paragraph<Trait> *>(item.get());
+
+        return (prev->type() == ItemType::Paragraph && !p->isEmpty() &&
+                p->items().front()->type() == ItemType::RawHtml);
+    }
+
+    case ItemType::Code:
+        return (prev->type() == ItemType::Code && !static_cast<Code<Trait> *>(item.get())->isFensedCode());
+
+    default:
+        return false;
+    }
+}
+
+template<class Trait>
+inline void
+Parser<Trait>::parseSplittedInParallel(ParserContext &ctx,
+                                       const std::vector<std::pair<long long int, long long int>> &segments,
+                                       std::shared_ptr<Block<Trait>> parent,
+                                       std::shared_ptr<Document<Trait>> doc,
+                                       typename Trait::StringList &linksToParse,
+                                       const typename Trait::String &workingPath,
+                                       const typename Trait::String &fileName,
+                                       bool collectRefLinks,
+                                       bool top,
+                                       bool dontProcessLastFreeHtml)
+{
+    // Result of the parsing of a segment with assumption that before the segment
+    // there is no raw HTML.
+    struct Segment {
+        std::shared_ptr<Document<Trait>> m_doc;
+        typename Trait::StringList m_links;
+        bool m_htmlClosed = false;
+    };
+
+    const auto labeledLinks = doc->labeledLinks();
+    const auto arena = currentArena();
+    const auto timings = currentPhaseTimings();
+    const auto limits = currentLimits();
+
+    auto parseSegment = [&](long long int first, long long int last) {
+        ArenaScope scope(arena);
+        PhaseTimingsScope timingsScope(timings);
+        LimitsScope limitsScope(limits);
+        PhaseScope phase(ParsingPhase::Blocks);
+
+        Segment res;
+        res.m_doc.reset(new Document<Trait>);
+        // Some parsing functions look at the last item of the parent.
+        res.m_doc->appendItem(makeItem<Anchor<Trait>>(typename Trait::String()));
+
+        for (const auto &l : labeledLinks) {
+            res.m_doc->insertLabeledLink(l.first, l.second);
+        }
+
+        ParserContext segmentCtx;
+
+        for (; first != last; ++first) {
+            auto data = ctx.m_splitted[first];
+
+            parseSplittedBlock(segmentCtx, data, res.m_doc, res.m_doc, res.m_links, workingPath,
+                fileName, collectRefLinks, top, dontProcessLastFreeHtml);
+        }
+
+        res.m_htmlClosed = isHtmlStateClean(segmentCtx.m_html);
+
+        return res;
+    };
+
+    std::vector<std::future<Segment>> results;
+
+    // First segment is parsed in the current thread, so skip it.
+    for (auto it = std::next(segments.cbegin()), last = segments.cend(); it != last; ++it) {
+        results.push_back(std::async(std::launch::async, parseSegment, it->first, it->second));
+    }
+
+    for (long long int i = segments.front().first; i < segments.front().second; ++i) {
+        parseSplittedBlock(ctx, ctx.m_splitted[i], parent, doc, linksToParse, workingPath, fileName,
+            collectRefLinks, top, dontProcessLastFreeHtml);
+    }
+
+    for (long long int i = 1; i < (long long int)segments.size(); ++i) {
+        auto res = results[i - 1].get();
+
+        const bool valid = res.m_htmlClosed && isHtmlStateClean(ctx.m_html) &&
+            (res.m_doc->items().size() < 2 || parent->isEmpty() ||
+                !canBeJoinedWithPrevious(parent->items().back(), res.m_doc->items().at(1)));
+
+        if (valid) {
+            for (auto it = std::next(res.m_doc->items().cbegin()), last = res.m_doc->items().cend();
+                 it != last; ++it) {
+                parent->appendItem(*it);
             }
 
-            if (ctx.m_html.m_htmlBlockType >= 6) {
-                ctx.m_html.m_continueHtml = (!ctx.m_splitted[i].m_emptyLineAfter);
+            for (const auto &h : res.m_doc->labeledHeadings()) {
+                doc->insertLabeledHeading(h.first, h.second);
             }
 
-            if (ctx.m_html.m_html && !ctx.m_html.m_continueHtml) {
-                finishHtml(ctx, parent, doc, collectRefLinks, top, dontProcessLastFreeHtml);
-            } else if (!ctx.m_html.m_html) {
-                ctx.m_html.m_toAdjustLastPos.clear();
+            for (const auto &l : res.m_doc->labeledLinks()) {
+                doc->insertLabeledLink(l.first, l.second);
+            }
+
+            for (const auto &f : res.m_doc->footnotesMap()) {
+                doc->insertFootnote(f.first, f.second);
+            }
+
+            std::copy(res.m_links.cbegin(), res.m_links.cend(), std::back_inserter(linksToParse));
+
+            ctx.m_html.m_toAdjustLastPos.clear();
+        } else {
+            // Segment depends on the previous one, parse it again in sequence.
+            for (long long int j = segments[i].first; j < segments[i].second; ++j) {
+                parseSplittedBlock(ctx, ctx.m_splitted[j], parent, doc, linksToParse, workingPath, fileName,
+                    collectRefLinks, top, dontProcessLastFreeHtml);
             }
         }
     }
+}
 
-    if (ctx.m_html.m_html) {
-        finishHtml(ctx, parent, doc, collectRefLinks, top, dontProcessLastFreeHtml);
+//! Read all lines from the given stream.
+template<class Trait>
+inline void
+readLines(typename Trait::TextStream &s,
+          typename MdBlock<Trait>::Data &data,
+          bool byteOffsets = false)
+{
+    TextStream<Trait> stream(s, byteOffsets);
+
+    long long int i = 0;
+
+    while (!stream.atEnd()) {
+        const long long int offset = (byteOffsets ? stream.offset() : -1);
+
+        data.push_back(std::pair<typename Trait::InternalString, MdLineData>(stream.readLine(), {i, {}, offset}));
+        ++i;
     }
+}
 
-    return ctx.m_html;
+//! \return Byte offsets of the given lines, null if they were not recorded while reading.
+template<class Trait>
+inline std::shared_ptr<const SourceOffsets>
+makeSourceOffsets(const typename MdBlock<Trait>::Data &data)
+{
+    if (data.empty() || data.front().second.m_byteOffset < 0) {
+        return {};
+    }
+
+    auto offsets = std::make_shared<SourceOffsets>();
+
+    for (const auto &line : data) {
+        const auto &str = line.first.asString();
+
+        offsets->appendLine(line.second.m_byteOffset, Trait::utf16(str), str.length());
+    }
+
+    return offsets;
 }
 
 #ifdef MD4QT_QT_SUPPORT
 
 template<>
-inline void
-Parser<QStringTrait>::parseFile(const QString &fileName,
-                                bool recursive,
-                                std::shared_ptr<Document<QStringTrait>> doc,
-                                const QStringList &ext,
-                                QStringList *parentLinks)
+inline bool
+Parser<QStringTrait>::readFile(const QString &fileName,
+                               const QStringList &ext,
+                               MdBlock<QStringTrait>::Data &data,
+                               QString &workingPath,
+                               QString &name) const
 {
     QFileInfo fi(fileName);
 
@@ -2990,12 +3883,44 @@ Parser<QStringTrait>::parseFile(const QString &fileName,
         QFile f(fileName);
 
         if (f.open(QIODevice::ReadOnly)) {
+            workingPath = fi.absolutePath();
+            name = fi.fileName();
+
+            if (m_memoryMappedInput) {
+                const auto size = f.size();
+                uchar *mapped = (size > 0 ? f.map(0, size) : nullptr);
+
+                if (mapped || size == 0) {
+                    QString content;
+
+                    if (mapped) {
+                        const QByteArrayView bytes(mapped, size);
+
+                        QStringDecoder decoder(QStringConverter::encodingForData(bytes).value_or(
+                            QStringConverter::Utf8));
+                        content = decoder.decode(bytes);
+
+                        f.unmap(mapped);
+                    }
+
+                    f.close();
+
+                    splitToLines(content, data, m_byteOffsets);
+
+                    return true;
+                }
+            }
+
             QTextStream s(f.readAll());
             f.close();
 
-            parseStream(s, fi.absolutePath(), fi.fileName(), recursive, doc, ext, parentLinks);
+            readLines<QStringTrait>(s, data, m_byteOffsets);
+
+            return true;
         }
     }
+
+    return false;
 }
 
 #endif
@@ -3003,12 +3928,12 @@ Parser<QStringTrait>::parseFile(const QString &fileName,
 #ifdef MD4QT_ICU_STL_SUPPORT
 
 template<>
-inline void
-Parser<UnicodeStringTrait>::parseFile(const UnicodeString &fileName,
-                                      bool recursive,
-                                      std::shared_ptr<Document<UnicodeStringTrait>> doc,
-                                      const std::vector<UnicodeString> &ext,
-                                      std::vector<UnicodeString> *parentLinks)
+inline bool
+Parser<UnicodeStringTrait>::readFile(const UnicodeString &fileName,
+                                     const std::vector<UnicodeString> &ext,
+                                     MdBlock<UnicodeStringTrait>::Data &data,
+                                     UnicodeString &workingPath,
+                                     UnicodeString &name) const
 {
     if (UnicodeStringTrait::fileExists(fileName)) {
         std::string fn;
@@ -3035,19 +3960,86 @@ Parser<UnicodeStringTrait>::parseFile(const UnicodeString &fileName,
 
                     std::replace(workingDirectory.begin(), workingDirectory.end(), '\\', '/');
 
-                    parseStream(file, UnicodeString::fromUTF8(workingDirectory),
-                        UnicodeString::fromUTF8(fileNameS), recursive, doc, ext, parentLinks);
+                    readLines<UnicodeStringTrait>(file, data, m_byteOffsets);
 
                     file.close();
+
+                    workingPath = UnicodeString::fromUTF8(workingDirectory);
+                    name = UnicodeString::fromUTF8(fileNameS);
+
+                    return true;
                 }
             }
         } catch (const std::exception &) {
         }
     }
+
+    return false;
 }
 
 #endif
 
+template<class Trait>
+inline void
+Parser<Trait>::parseFile(const typename Trait::String &fileName,
+                         bool recursive,
+                         std::shared_ptr<Document<Trait>> doc,
+                         const typename Trait::StringList &ext,
+                         LinksQueue *parentLinks)
+{
+    const auto it = m_crawledFiles.find(fileName);
+
+    // File was already parsed by crawler.
+    if (it != m_crawledFiles.end() && !it->second.m_used) {
+        auto &file = it->second;
+        file.m_used = true;
+
+        if (file.m_doc) {
+            for (const auto &item : file.m_doc->items()) {
+                doc->appendItem(item);
+            }
+
+            for (const auto &h : file.m_doc->labeledHeadings()) {
+                doc->insertLabeledHeading(h.first, h.second);
+            }
+
+            for (const auto &l : file.m_doc->labeledLinks()) {
+                doc->insertLabeledLink(l.first, l.second);
+            }
+
+            for (const auto &f : file.m_doc->footnotesMap()) {
+                doc->insertFootnote(f.first, f.second);
+            }
+
+            m_filesState[fileId(file.m_path)] = FileState::Parsed;
+
+            if (recursive && !file.m_links.empty()) {
+                parseLinks(file.m_links, recursive, doc, ext, parentLinks);
+            }
+        } else {
+            m_filesState[fileId(fileName)] = FileState::Failed;
+        }
+
+        return;
+    }
+
+    typename MdBlock<Trait>::Data data;
+    typename Trait::String workingPath, name;
+    bool read = false;
+
+    {
+        PhaseScope reading(ParsingPhase::Reading);
+
+        read = readFile(fileName, ext, data, workingPath, name);
+    }
+
+    if (read) {
+        parseData(data, workingPath, name, recursive, doc, ext, parentLinks);
+    } else {
+        m_filesState[fileId(fileName)] = FileState::Failed;
+    }
+}
+
 template<class Trait>
 void
 resolveLinks(typename Trait::StringList &linksToParse,
@@ -3066,84 +4058,836 @@ resolveLinks(typename Trait::StringList &linksToParse,
             }
         }
 
-        if (Trait::fileExists(nextFileName)) {
-            *it = Trait::absoluteFilePath(nextFileName);
+        if (Trait::fileExists(nextFileName)) {
+            *it = Trait::absoluteFilePath(nextFileName);
+        }
+    }
+}
+
+template<class Trait>
+inline void
+Parser<Trait>::parseStream(typename Trait::TextStream &s,
+                           const typename Trait::String &workingPath,
+                           const typename Trait::String &fileName,
+                           bool recursive,
+                           std::shared_ptr<Document<Trait>> doc,
+                           const typename Trait::StringList &ext,
+                           LinksQueue *parentLinks)
+{
+    typename MdBlock<Trait>::Data data;
+
+    {
+        PhaseScope reading(ParsingPhase::Reading);
+
+        readLines<Trait>(s, data, m_byteOffsets);
+    }
+
+    parseData(data, workingPath, fileName, recursive, doc, ext, parentLinks);
+}
+
+template<class Trait>
+inline typename Trait::String
+Parser<Trait>::parseDocument(typename MdBlock<Trait>::Data &data,
+                             const typename Trait::String &workingPath,
+                             const typename Trait::String &fileName,
+                             std::shared_ptr<Document<Trait>> doc,
+                             typename Trait::StringList &linksToParse)
+{
+    const auto path = workingPath.isEmpty() ? typename Trait::String(fileName) :
+        typename Trait::String(workingPath + Trait::latin1ToString("/") + fileName);
+
+    auto anchor = makeItem<Anchor<Trait>>(path);
+    anchor->setSourceOffsets(makeSourceOffsets<Trait>(data));
+    doc->appendItem(anchor);
+
+    StringListStream<Trait> stream(data);
+
+    parse(stream, doc, doc, linksToParse, workingPath, fileName, true, true);
+
+    resolveLinks<Trait>(linksToParse, doc);
+
+    return path;
+}
+
+//! Cut lines of the document that exceed the limit of size of a document.
+//! \return Whether lines were cut.
+template<class Trait>
+inline bool
+limitDocumentSize(typename MdBlock<Trait>::Data &data)
+{
+    auto limits = currentLimits();
+
+    if (!limits || limits->limits().m_maxDocumentSize <= 0) {
+        return false;
+    }
+
+    const auto max = limits->limits().m_maxDocumentSize;
+    long long int size = 0;
+
+    for (long long int i = 0; i < static_cast<long long int>(data.size()); ++i) {
+        const auto length = data[i].first.length();
+
+        // Line break is counted too.
+        if (size + length + 1 > max) {
+            const auto rest = max - size;
+
+            if (rest < length) {
+                data[i].first = data[i].first.sliced(0, rest);
+            }
+
+            data.erase(data.begin() + (rest > 0 ? i + 1 : i), data.end());
+
+            limits->setReached(DocumentSizeLimit);
+
+            return true;
+        }
+
+        size += length + 1;
+    }
+
+    return false;
+}
+
+template<class Trait>
+inline void
+Parser<Trait>::parseData(typename MdBlock<Trait>::Data &data,
+                         const typename Trait::String &workingPath,
+                         const typename Trait::String &fileName,
+                         bool recursive,
+                         std::shared_ptr<Document<Trait>> doc,
+                         const typename Trait::StringList &ext,
+                         LinksQueue *parentLinks)
+{
+    typename Trait::StringList linksToParse;
+
+    limitDocumentSize<Trait>(data);
+
+    m_filesState[fileId(parseDocument(data, workingPath, fileName, doc, linksToParse))] = FileState::Parsed;
+
+    // Parse all links if parsing is recursive.
+    if (recursive && !linksToParse.empty()) {
+        // Linked files are parsed concurrently first, and then are taken
+        // in the same order as in sequential parsing.
+        const bool crawl = (m_threadsCount != 1 && !parentLinks && m_crawledFiles.empty());
+
+        if (crawl) {
+            crawlLinks(linksToParse, ext);
+        }
+
+        parseLinks(linksToParse, recursive, doc, ext, parentLinks);
+
+        if (crawl) {
+            m_crawledFiles.clear();
+        }
+    }
+}
+
+template<class Trait>
+inline long long int
+Parser<Trait>::fileId(const typename Trait::String &path)
+{
+    const auto it = m_fileIds.find(path);
+
+    if (it != m_fileIds.cend()) {
+        return it->second;
+    }
+
+    const auto id = static_cast<long long int>(m_filePaths.size());
+
+    m_fileIds.insert({path, id});
+    m_filePaths.push_back(path);
+    m_filesState.push_back(FileState::NotParsed);
+
+    return id;
+}
+
+template<class Trait>
+inline void
+Parser<Trait>::parseLinks(const typename Trait::StringList &links,
+                          bool recursive,
+                          std::shared_ptr<Document<Trait>> doc,
+                          const typename Trait::StringList &ext,
+                          LinksQueue *parentLinks)
+{
+    LinksQueue linksToParse;
+
+    for (const auto &l : links) {
+        // Links to labels that were not resolved into files.
+        if (!l.startsWith(Trait::latin1ToString("#"))) {
+            linksToParse.push(fileId(l));
+        }
+    }
+
+    const auto tmpLinks = linksToParse.ids();
+
+    while (!linksToParse.isEmpty()) {
+        const auto id = linksToParse.pop();
+
+        if ((parentLinks && parentLinks->contains(id)) || m_filesState[id] == FileState::Parsed) {
+            ++m_skippedFilesCount;
+
+            continue;
+        }
+
+        if (!doc->isEmpty() && doc->items().back()->type() != ItemType::PageBreak) {
+            doc->appendItem(makeItem<PageBreak<Trait>>());
+        }
+
+        if (m_filesState[id] == FileState::Failed) {
+            ++m_skippedFilesCount;
+        } else {
+            const auto fileName = m_filePaths[id];
+
+            parseFile(fileName, recursive, doc, ext, &linksToParse);
+        }
+    }
+
+    // Already parsed files will be skipped by parent anyway, so don't grow its queue.
+    if (parentLinks) {
+        for (const auto id : tmpLinks) {
+            if (m_filesState[id] != FileState::Parsed) {
+                parentLinks->push(id);
+            }
+        }
+    }
+}
+
+template<class Trait>
+inline void
+Parser<Trait>::crawlLinks(const typename Trait::StringList &links,
+                          const typename Trait::StringList &ext)
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<typename Trait::String> queue;
+    std::unordered_set<typename Trait::String, typename Trait::StringHash> visited;
+    long long int inProgress = 0;
+    const auto arena = currentArena();
+    const auto timings = currentPhaseTimings();
+    const auto limits = currentLimits();
+
+    auto enqueue = [&](const typename Trait::StringList &l) {
+        for (const auto &fileName : l) {
+            if (!fileName.startsWith(Trait::latin1ToString("#")) && visited.insert(fileName).second) {
+                queue.push_back(fileName);
+            }
+        }
+    };
+
+    auto worker = [&]() {
+        ArenaScope scope(arena);
+        PhaseTimingsScope timingsScope(timings);
+        LimitsScope limitsScope(limits);
+        PhaseScope phase(ParsingPhase::Blocks);
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            cv.wait(lock, [&]() { return !queue.empty() || inProgress == 0; });
+
+            if (queue.empty()) {
+                break;
+            }
+
+            const auto fileName = queue.front();
+            queue.pop_front();
+            ++inProgress;
+
+            lock.unlock();
+
+            CrawledFile file;
+            bool ok = true;
+
+            try {
+                typename MdBlock<Trait>::Data data;
+                typename Trait::String workingPath, name;
+
+                bool read = false;
+
+                {
+                    PhaseScope reading(ParsingPhase::Reading);
+
+                    read = readFile(fileName, ext, data, workingPath, name);
+                }
+
+                if (read) {
+                    limitDocumentSize<Trait>(data);
+
+                    file.m_doc.reset(new Document<Trait>);
+                    file.m_path = parseDocument(data, workingPath, name, file.m_doc, file.m_links);
+                }
+            } catch (...) {
+                // This file will be parsed again in sequence, so the error will be
+                // reported in a usual way.
+                ok = false;
+            }
+
+            lock.lock();
+
+            if (ok) {
+                enqueue(file.m_links);
+                m_crawledFiles.insert({fileName, file});
+            }
+
+            --inProgress;
+
+            cv.notify_all();
+        }
+    };
+
+    for (long long int id = 0; id < static_cast<long long int>(m_filePaths.size()); ++id) {
+        if (m_filesState[id] == FileState::Parsed) {
+            visited.insert(m_filePaths[id]);
+        }
+    }
+
+    enqueue(links);
+
+    const auto threads = (m_threadsCount ? m_threadsCount : std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<std::future<void>> results;
+
+    for (unsigned int i = 1; i < threads; ++i) {
+        results.push_back(std::async(std::launch::async, worker));
+    }
+
+    worker();
+
+    for (auto &r : results) {
+        r.get();
+    }
+}
+
+//! Shift line numbers of the position.
+inline void
+shiftLines(WithPosition &pos,
+           long long int delta)
+{
+    if (pos.startLine() >= 0) {
+        pos.setStartLine(pos.startLine() + delta);
+    }
+
+    if (pos.endLine() >= 0) {
+        pos.setEndLine(pos.endLine() + delta);
+    }
+}
+
+//! Shift line numbers of the item and all its children.
+template<class Trait>
+inline void
+shiftLines(Item<Trait> *item,
+           long long int delta)
+{
+    shiftLines(*static_cast<WithPosition *>(item), delta);
+
+    auto shiftPos = [delta](const WithPosition &p) {
+        WithPosition tmp = p;
+        shiftLines(tmp, delta);
+
+        return tmp;
+    };
+
+    auto shiftStyles = [delta](ItemWithOpts<Trait> *i) {
+        for (auto &s : i->openStyles()) {
+            shiftLines(s, delta);
+        }
+
+        for (auto &s : i->closeStyles()) {
+            shiftLines(s, delta);
+        }
+    };
+
+    auto shiftChildren = [delta](Block<Trait> *b) {
+        for (const auto &i : b->items()) {
+            shiftLines<Trait>(i.get(), delta);
+        }
+    };
+
+    auto shiftLink = [&](LinkBase<Trait> *l) {
+        shiftStyles(l);
+        l->setTextPos(shiftPos(l->textPos()));
+        l->setUrlPos(shiftPos(l->urlPos()));
+        shiftChildren(l->p().get());
+    };
+
+    switch (item->type()) {
+    case ItemType::Heading: {
+        auto h = static_cast<Heading<Trait> *>(item);
+
+        auto delims = h->delims();
+
+        for (auto &d : delims) {
+            shiftLines(d, delta);
+        }
+
+        h->setDelims(delims);
+        h->setLabelPos(shiftPos(h->labelPos()));
+        shiftLines<Trait>(h->text().get(), delta);
+    } break;
+
+    case ItemType::Text:
+    case ItemType::LineBreak:
+    case ItemType::RawHtml:
+        shiftStyles(static_cast<ItemWithOpts<Trait> *>(item));
+        break;
+
+    case ItemType::FootnoteRef: {
+        auto f = static_cast<FootnoteRef<Trait> *>(item);
+
+        shiftStyles(f);
+        f->setIdPos(shiftPos(f->idPos()));
+    } break;
+
+    case ItemType::Code:
+    case ItemType::Math: {
+        auto c = static_cast<Code<Trait> *>(item);
+
+        shiftStyles(c);
+        c->setSyntaxPos(shiftPos(c->syntaxPos()));
+        c->setStartDelim(shiftPos(c->startDelim()));
+        c->setEndDelim(shiftPos(c->endDelim()));
+    } break;
+
+    case ItemType::Link: {
+        auto l = static_cast<Link<Trait> *>(item);
+
+        shiftLink(l);
+
+        // Image of the link usually is one of items of the link's text.
+        const auto &pItems = l->p()->items();
+
+        if (std::find(pItems.cbegin(), pItems.cend(), l->img()) == pItems.cend()) {
+            shiftLines<Trait>(l->img().get(), delta);
+        }
+    } break;
+
+    case ItemType::Image:
+        shiftLink(static_cast<Image<Trait> *>(item));
+        break;
+
+    case ItemType::Blockquote: {
+        auto b = static_cast<Blockquote<Trait> *>(item);
+
+        for (auto &d : b->delims()) {
+            shiftLines(d, delta);
+        }
+
+        shiftChildren(b);
+    } break;
+
+    case ItemType::ListItem: {
+        auto l = static_cast<ListItem<Trait> *>(item);
+
+        l->setDelim(shiftPos(l->delim()));
+        l->setTaskDelim(shiftPos(l->taskDelim()));
+        shiftChildren(l);
+    } break;
+
+    case ItemType::Footnote: {
+        auto f = static_cast<Footnote<Trait> *>(item);
+
+        f->setIdPos(shiftPos(f->idPos()));
+        shiftChildren(f);
+    } break;
+
+    case ItemType::Paragraph:
+    case ItemType::List:
+    case ItemType::TableCell:
+        shiftChildren(static_cast<Block<Trait> *>(item));
+        break;
+
+    case ItemType::Table: {
+        for (const auto &r : static_cast<Table<Trait> *>(item)->rows()) {
+            shiftLines<Trait>(r.get(), delta);
+        }
+    } break;
+
+    case ItemType::TableRow: {
+        for (const auto &c : static_cast<TableRow<Trait> *>(item)->cells()) {
+            shiftLines<Trait>(c.get(), delta);
+        }
+    } break;
+
+    default:
+        break;
+    }
+}
+
+//! \return First and last lines of the top-level item, including its delimiters.
+template<class Trait>
+inline std::pair<long long int, long long int>
+linesOfItem(Item<Trait> *item)
+{
+    std::pair<long long int, long long int> res = {item->startLine(), item->endLine()};
+
+    auto apply = [&res](const WithPosition &p) {
+        if (p.startLine() >= 0) {
+            res.first = std::min(res.first, p.startLine());
+            res.second = std::max(res.second, p.endLine());
+        }
+    };
+
+    switch (item->type()) {
+    case ItemType::Code: {
+        auto c = static_cast<Code<Trait> *>(item);
+
+        apply(c->startDelim());
+        apply(c->endDelim());
+    } break;
+
+    case ItemType::Heading: {
+        for (const auto &d : static_cast<Heading<Trait> *>(item)->delims()) {
+            apply(d);
+        }
+    } break;
+
+    case ItemType::Blockquote: {
+        for (const auto &d : static_cast<Blockquote<Trait> *>(item)->delims()) {
+            apply(d);
+        }
+    } break;
+
+    default:
+        break;
+    }
+
+    return res;
+}
+
+//! \return Is there a delimiter of fenced code of the item or its children in the given lines.
+template<class Trait>
+inline bool
+hasFenceInLines(Item<Trait> *item,
+                long long int firstLine,
+                long long int lastLine)
+{
+    switch (item->type()) {
+    case ItemType::Code: {
+        auto c = static_cast<Code<Trait> *>(item);
+
+        auto inLines = [firstLine, lastLine](const WithPosition &p) {
+            return (p.startLine() >= firstLine && p.startLine() <= lastLine);
+        };
+
+        return (c->isFensedCode() && (inLines(c->startDelim()) || inLines(c->endDelim())));
+    }
+
+    case ItemType::Blockquote:
+    case ItemType::List:
+    case ItemType::ListItem:
+    case ItemType::Footnote: {
+        for (const auto &i : static_cast<Block<Trait> *>(item)->items()) {
+            if (hasFenceInLines<Trait>(i.get(), firstLine, lastLine)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    default:
+        return false;
+    }
+}
+
+//! Collect headings of the item and its children.
+template<class Trait>
+inline void
+collectHeadings(const std::shared_ptr<Item<Trait>> &item,
+                std::vector<std::shared_ptr<Heading<Trait>>> &headings)
+{
+    switch (item->type()) {
+    case ItemType::Heading:
+        headings.push_back(std::static_pointer_cast<Heading<Trait>>(item));
+        break;
+
+    case ItemType::Blockquote:
+    case ItemType::List:
+    case ItemType::ListItem:
+    case ItemType::Footnote: {
+        for (const auto &i : static_cast<Block<Trait> *>(item.get())->items()) {
+            collectHeadings<Trait>(i, headings);
+        }
+    } break;
+
+    default:
+        break;
+    }
+}
+
+template<class Trait>
+inline std::shared_ptr<Document<Trait>>
+Parser<Trait>::reparse(std::shared_ptr<Document<Trait>> doc,
+                       typename Trait::TextStream &stream,
+                       const typename Trait::String &path,
+                       const typename Trait::String &fileName,
+                       long long int firstLine,
+                       long long int lastLine,
+                       long long int newLastLine,
+                       bool fullyOptimizeParagraphs)
+{
+    m_fullyOptimizeParagraphs = fullyOptimizeParagraphs;
+    m_skippedFilesCount = 0;
+
+    ArenaScope arena(m_arenaAllocation ? std::make_shared<Arena>() : nullptr);
+
+    m_phaseTimings.clear();
+    PhaseTimingsScope timings(m_collectPhaseTimings ? &m_phaseTimings : nullptr);
+    m_limitsState.reset(m_limits);
+    LimitsScope limits(m_limits.isSet() ? &m_limitsState : nullptr);
+    PhaseScope phase(ParsingPhase::Blocks);
+
+    typename MdBlock<Trait>::Data data;
+
+    {
+        PhaseScope reading(ParsingPhase::Reading);
+
+        readLines<Trait>(stream, data, m_byteOffsets);
+    }
+
+    auto parseAll = [&]() {
+        std::shared_ptr<Document<Trait>> res(new Document<Trait>);
+
+        parseData(data, path, fileName, false, res, typename Trait::StringList());
+
+        clearCache();
+
+        return res;
+    };
+
+    // Blocks at the end of the cut document can't be reused.
+    if (limitDocumentSize<Trait>(data)) {
+        return parseAll();
+    }
+
+    const auto anchor = path.isEmpty() ? typename Trait::String(fileName) :
+        typename Trait::String(path + Trait::latin1ToString("/") + fileName);
+    const long long int linesCount = data.size();
+
+    if (!doc || doc->items().size() < 2 || doc->items().front()->type() != ItemType::Anchor ||
+        static_cast<Anchor<Trait> *>(doc->items().front().get())->label() != anchor ||
+        doc->items().back()->type() == ItemType::PageBreak || firstLine < 0 ||
+        lastLine < firstLine - 1 || newLastLine < firstLine - 1 || newLastLine >= linesCount) {
+        return parseAll();
+    }
+
+    const auto &items = doc->items();
+    const long long int count = items.size();
+    const long long int delta = newLastLine - lastLine;
+
+    // The item before the edit is parsed again too, as the edit may change it,
+    // for example turn paragraph into setext heading or table.
+    long long int first = std::partition_point(std::next(items.cbegin()), items.cend(),
+        [firstLine](const auto &i) { return linesOfItem<Trait>(i.get()).second < firstLine - 1; }) -
+        items.cbegin();
+    first = std::max(1ll, first - 1);
+
+    // Parsing starts after an empty line, as a block may depend on the previous one
+    // if there is no empty line between them.
+    auto startOfItem = [&](long long int i) {
+        return (i > 1 ? linesOfItem<Trait>(items[i - 1].get()).second + 1 : 0);
+    };
+
+    // Items may share a line, for example a table and an indented code after it.
+    while (first > 1 && ((startOfItem(first) < linesCount &&
+                          !data[startOfItem(first)].first.asString().simplified().isEmpty()) ||
+                         linesOfItem<Trait>(items[first].get()).first < startOfItem(first))) {
+        --first;
+    }
+
+    const long long int startLine = startOfItem(first);
+
+    // Fences may change everything till the end of the document.
+    for (long long int i = firstLine; i <= newLastLine; ++i) {
+        const auto &line = data[i].first.asString();
+
+        if (line.contains(Trait::latin1ToString("```")) || line.contains(Trait::latin1ToString("~~~"))) {
+            return parseAll();
+        }
+    }
+
+    for (long long int i = first; i < count && linesOfItem<Trait>(items[i].get()).first <= lastLine; ++i) {
+        if (hasFenceInLines<Trait>(items[i].get(), firstLine, lastLine)) {
+            return parseAll();
+        }
+    }
+    const long long int htmlCheckLine = (first > 1 ? linesOfItem<Trait>(items[first - 1].get()).first : 0);
+
+    // The first item after the edit. If this item is the same after parsing,
+    // all next items are the same too. The item after it is parsed too, as
+    // the last line of a block depends on the next line (tables, setext headings).
+    long long int sync = std::partition_point(items.cbegin() + first, items.cend(),
+        [lastLine](const auto &i) { return linesOfItem<Trait>(i.get()).first <= lastLine + 1; }) -
+        items.cbegin();
+
+    while (true) {
+        const bool toEnd = (sync + 1 >= count);
+        const auto oldLines = (toEnd ? std::pair<long long int, long long int>() :
+            linesOfItem<Trait>(items[sync].get()));
+        const auto guardLines = (toEnd ? std::pair<long long int, long long int>() :
+            linesOfItem<Trait>(items[sync + 1].get()));
+        const long long int oldEndLine = (toEnd ? std::numeric_limits<long long int>::max() :
+            oldLines.second);
+        const long long int endLine = (toEnd ? linesCount - 1 : guardLines.second + delta);
+
+        if (endLine >= linesCount) {
+            return parseAll();
+        }
+
+        // Definitions are used by all blocks, so parse everything if they were touched.
+        for (const auto &l : doc->labeledLinks()) {
+            if (l.second->startLine() >= startLine && l.second->startLine() <= oldEndLine) {
+                return parseAll();
+            }
+        }
+
+        for (const auto &f : doc->footnotesMap()) {
+            if (f.second->idPos().startLine() >= startLine && f.second->idPos().startLine() <= oldEndLine) {
+                return parseAll();
+            }
+        }
+
+        // Raw HTML may change state of parsing of next blocks, so don't reuse blocks
+        // around it. The item before the region is checked too.
+        for (long long int i = std::max(1ll, first - 1); i < std::min(count, sync + 2); ++i) {
+            if (items[i]->type() == ItemType::RawHtml) {
+                return parseAll();
+            }
+        }
+
+        for (long long int i = htmlCheckLine; i <= endLine; ++i) {
+            const auto &line = data[i].first.asString();
+
+            if ((i >= startLine && line.contains(Trait::latin1ToString("]:"))) ||
+                line.contains(Trait::latin1ToChar('<'))) {
+                return parseAll();
+            }
+        }
+
+        typename MdBlock<Trait>::Data fragment;
+        std::copy(data.cbegin() + startLine, data.cbegin() + endLine + 1, std::back_inserter(fragment));
+
+        std::shared_ptr<Document<Trait>> part(new Document<Trait>);
+
+        for (const auto &l : doc->labeledLinks()) {
+            part->insertLabeledLink(l.first, l.second);
         }
-    }
-}
 
-template<class Trait>
-inline void
-Parser<Trait>::parseStream(typename Trait::TextStream &s,
-                           const typename Trait::String &workingPath,
-                           const typename Trait::String &fileName,
-                           bool recursive,
-                           std::shared_ptr<Document<Trait>> doc,
-                           const typename Trait::StringList &ext,
-                           typename Trait::StringList *parentLinks)
-{
-    typename Trait::StringList linksToParse;
+        typename Trait::StringList links;
 
-    const auto path = workingPath.isEmpty() ? typename Trait::String(fileName) :
-        typename Trait::String(workingPath + Trait::latin1ToString("/") + fileName);
+        parseDocument(fragment, path, fileName, part, links);
 
-    doc->appendItem(std::shared_ptr<Anchor<Trait>>(new Anchor<Trait>(path)));
+        if (!toEnd) {
+            const auto &old = items[sync];
+            const auto size = part->items().size();
+            const auto &res = (size < 3 ? part->items().back() : part->items().at(size - 2));
 
-    typename MdBlock<Trait>::Data data;
+            if (size < 3 || linesOfItem<Trait>(part->items().back().get()).first != guardLines.first + delta ||
+                res->type() != old->type() ||
+                res->startLine() != old->startLine() + delta || res->endLine() != old->endLine() + delta ||
+                res->startColumn() != old->startColumn() || res->endColumn() != old->endColumn() ||
+                linesOfItem<Trait>(res.get()) !=
+                    std::make_pair(oldLines.first + delta, oldLines.second + delta)) {
+                // Parse more blocks.
+                sync = std::min(count - 1, sync + std::max(1ll, sync - first));
 
-    {
-        TextStream<Trait> stream(s);
+                continue;
+            }
+        }
 
-        long long int i = 0;
+        const long long int last = (toEnd ? count : sync + 1);
 
-        while (!stream.atEnd()) {
-            data.push_back(std::pair<typename Trait::InternalString, MdLineData>(stream.readLine(), {i}));
-            ++i;
+        // Headings from the region, that were in the map, are replaced with new ones.
+        std::vector<std::shared_ptr<Heading<Trait>>> oldHeadings;
+        std::vector<typename Trait::String> removedLabels;
+
+        for (long long int i = first; i < last; ++i) {
+            collectHeadings<Trait>(items[i], oldHeadings);
         }
-    }
 
-    StringListStream<Trait> stream(data);
+        for (const auto &h : oldHeadings) {
+            const auto it = doc->labeledHeadings().find(h->label());
 
-    parse(stream, doc, doc, linksToParse, workingPath, fileName, true, true);
+            if (it != doc->labeledHeadings().cend() && it->second == h) {
+                removedLabels.push_back(h->label());
+                doc->removeLabeledHeading(h->label());
+            }
+        }
 
-    m_parsedFiles.push_back(path);
+        for (const auto &h : part->labeledHeadings()) {
+            // The next after the region item is not replaced.
+            if (!toEnd && h.second->startLine() > oldEndLine + delta) {
+                continue;
+            }
 
-    resolveLinks<Trait>(linksToParse, doc);
+            const auto it = doc->labeledHeadings().find(h.first);
 
-    // Parse all links if parsing is recursive.
-    if (recursive && !linksToParse.empty()) {
-        const auto tmpLinks = linksToParse;
+            if (it != doc->labeledHeadings().cend() && it->second->startLine() > oldEndLine) {
+                doc->removeLabeledHeading(h.first);
+            }
 
-        while (!linksToParse.empty()) {
-            auto nextFileName = linksToParse.front();
-            linksToParse.erase(linksToParse.cbegin());
+            doc->insertLabeledHeading(h.first, h.second);
+        }
 
-            if (parentLinks) {
-                const auto pit = std::find(parentLinks->cbegin(), parentLinks->cend(), nextFileName);
+        // Shift everything after the region.
+        if (delta) {
+            for (long long int i = last; i < count; ++i) {
+                shiftLines<Trait>(items[i].get(), delta);
+            }
 
-                if (pit != parentLinks->cend()) {
-                    continue;
+            for (const auto &l : doc->labeledLinks()) {
+                if (l.second->startLine() > oldEndLine) {
+                    shiftLines<Trait>(l.second.get(), delta);
                 }
             }
 
-            if (nextFileName.startsWith(Trait::latin1ToString("#"))) {
-                continue;
+            for (const auto &f : doc->footnotesMap()) {
+                if (f.second->idPos().startLine() > oldEndLine) {
+                    shiftLines<Trait>(f.second.get(), delta);
+                }
             }
+        }
+
+        for (long long int i = first; i < last; ++i) {
+            doc->removeItemAt(first);
+        }
 
-            const auto pit = std::find(m_parsedFiles.cbegin(), m_parsedFiles.cend(), nextFileName);
+        const long long int partCount = static_cast<long long int>(part->items().size()) - (toEnd ? 0 : 1);
 
-            if (pit == m_parsedFiles.cend()) {
-                if (!doc->isEmpty() && doc->items().back()->type() != ItemType::PageBreak) {
-                    doc->appendItem(std::shared_ptr<PageBreak<Trait>>(new PageBreak<Trait>));
-                }
+        for (long long int i = 1; i < partCount; ++i) {
+            doc->insertItem(first + i - 1, part->items().at(i));
+        }
+
+        // Some removed heading could hide another one with the same label.
+        bool lostLabel = false;
 
-                parseFile(nextFileName, recursive, doc, ext, &linksToParse);
+        for (const auto &l : removedLabels) {
+            if (doc->labeledHeadings().find(l) == doc->labeledHeadings().cend()) {
+                lostLabel = true;
+
+                break;
             }
         }
 
-        if (parentLinks) {
-            std::copy(tmpLinks.cbegin(), tmpLinks.cend(), std::back_inserter(*parentLinks));
+        if (lostLabel) {
+            std::vector<std::shared_ptr<Heading<Trait>>> headings;
+
+            for (const auto &i : doc->items()) {
+                collectHeadings<Trait>(i, headings);
+            }
+
+            for (const auto &h : headings) {
+                if (std::find(removedLabels.cbegin(), removedLabels.cend(), h->label()) != removedLabels.cend()) {
+                    doc->insertLabeledHeading(h->label(), h);
+                }
+            }
         }
+
+        static_cast<Anchor<Trait> *>(doc->items().front().get())->setSourceOffsets(makeSourceOffsets<Trait>(data));
+
+        clearCache();
+
+        return doc;
     }
 }
 
@@ -3223,6 +4967,12 @@ Parser<Trait>::whatIsTheLine(typename Trait::InternalString &str,
     const auto first = skipSpaces<Trait>(0, str.asString());
 
     if (first < str.length()) {
+        // Most of lines are paragraph's text, outside of lists they are recognized
+        // by the first non-space character without any copying.
+        if (!inList && first < 4 && !canStartBlock<Trait>(str[first])) {
+            return BlockType::Text;
+        }
+
         auto s = str.sliced(first);
 
         const bool isBlockquote = s.asString().startsWith(Trait::latin1ToString(">"));
@@ -3410,7 +5160,10 @@ template<class Trait>
 inline void
 Parser<Trait>::clearCache()
 {
-    m_parsedFiles.clear();
+    m_fileIds.clear();
+    m_filePaths.clear();
+    m_filesState.clear();
+    m_crawledFiles.clear();
 }
 
 template<class Trait>
@@ -3647,7 +5400,7 @@ Parser<Trait>::parseHeading(MdBlock<Trait> &fr,
     if (!fr.m_data.empty() && !collectRefLinks) {
         auto line = fr.m_data.front().first;
 
-        std::shared_ptr<Heading<Trait>> h(new Heading<Trait>);
+        auto h = makeItem<Heading<Trait>>();
         h->setStartColumn(line.virginPos(skipSpaces<Trait>(0, line.asString())));
         h->setStartLine(fr.m_data.front().second.m_lineNumber);
         h->setEndColumn(line.virginPos(line.length() - 1));
@@ -3705,7 +5458,7 @@ Parser<Trait>::parseHeading(MdBlock<Trait> &fr,
             h->setLabelPos(label.second);
         }
 
-        std::shared_ptr<Paragraph<Trait>> p(new Paragraph<Trait>);
+        auto p = makeItem<Paragraph<Trait>>();
 
         typename MdBlock<Trait>::Data tmp;
         tmp.push_back(fr.m_data.front());
@@ -3799,7 +5552,7 @@ Parser<Trait>::parseTable(MdBlock<Trait> &fr,
     static const char sep = '|';
 
     if (fr.m_data.size() >= 2) {
-        std::shared_ptr<Table<Trait>> table(new Table<Trait>);
+        auto table = makeItem<Table<Trait>>();
         table->setStartColumn(fr.m_data.front().first.virginPos(0));
         table->setStartLine(fr.m_data.front().second.m_lineNumber);
         table->setEndColumn(fr.m_data.back().first.virginPos(fr.m_data.back().first.length() - 1));
@@ -3826,7 +5579,7 @@ Parser<Trait>::parseTable(MdBlock<Trait> &fr,
             columns.second.insert(columns.second.begin(), row.virginPos(0));
             columns.second.push_back(row.virginPos(row.length() - 1));
 
-            std::shared_ptr<TableRow<Trait>> tr(new TableRow<Trait>);
+            auto tr = makeItem<TableRow<Trait>>();
             tr->setStartColumn(row.virginPos(0));
             tr->setStartLine(lineData.second.m_lineNumber);
             tr->setEndColumn(row.virginPos(row.length() - 1));
@@ -3839,7 +5592,7 @@ Parser<Trait>::parseTable(MdBlock<Trait> &fr,
                     break;
                 }
 
-                std::shared_ptr<TableCell<Trait>> c(new TableCell<Trait>);
+                auto c = makeItem<TableCell<Trait>>();
                 c->setStartColumn(columns.second.at(col));
                 c->setStartLine(lineData.second.m_lineNumber);
                 c->setEndColumn(columns.second.at(col + 1));
@@ -3852,7 +5605,7 @@ Parser<Trait>::parseTable(MdBlock<Trait> &fr,
                     fragment.push_back({*it, lineData.second});
                     MdBlock<Trait> block = {fragment, 0};
 
-                    std::shared_ptr<Paragraph<Trait>> p(new Paragraph<Trait>);
+                    auto p = makeItem<Paragraph<Trait>>();
 
                     RawHtmlBlock<Trait> html;
 
@@ -3972,6 +5725,30 @@ isH2(const typename Trait::String &s)
     return isH<Trait>(s, Trait::latin1ToChar('-'));
 }
 
+//! \return Index of the line with the given number in the fragment, -1 if there is no such line.
+template<class Trait>
+inline long long int
+lineIndex(const MdBlock<Trait> &fr,
+          long long int line)
+{
+    // Lines of a fragment are read from the stream one by one, so they go in order,
+    // and a fragment of a paragraph may be very long.
+    assert(std::is_sorted(fr.m_data.cbegin(), fr.m_data.cend(), [](const auto &l1, const auto &l2) {
+        return (l1.second.m_lineNumber < l2.second.m_lineNumber);
+    }));
+
+    const auto it = std::lower_bound(fr.m_data.cbegin(), fr.m_data.cend(), line,
+        [](const auto &l, long long int n) {
+            return (l.second.m_lineNumber < n);
+        });
+
+    if (it != fr.m_data.cend() && it->second.m_lineNumber == line) {
+        return std::distance(fr.m_data.cbegin(), it);
+    }
+
+    return -1;
+}
+
 template<class Trait>
 inline std::pair<long long int, long long int>
 prevPosition(const MdBlock<Trait> &fr,
@@ -3982,13 +5759,11 @@ prevPosition(const MdBlock<Trait> &fr,
         return {pos - 1, line};
     }
 
-    for (long long int i = 0; i < static_cast<long long int>(fr.m_data.size()); ++i) {
-        if (fr.m_data.at(i).second.m_lineNumber == line) {
-            if (i > 0) {
-                return {fr.m_data.at(i - 1).first.virginPos(fr.m_data.at(i - 1).first.length() - 1),
-                    line - 1};
-            }
-        }
+    const auto i = lineIndex(fr, line);
+
+    if (i > 0) {
+        return {fr.m_data.at(i - 1).first.virginPos(fr.m_data.at(i - 1).first.length() - 1),
+            line - 1};
     }
 
     return {pos, line};
@@ -4000,15 +5775,13 @@ nextPosition(const MdBlock<Trait> &fr,
              long long int pos,
              long long int line)
 {
-    for (long long int i = 0; i < static_cast<long long int>(fr.m_data.size()); ++i) {
-        if (fr.m_data.at(i).second.m_lineNumber == line) {
-            if (fr.m_data.at(i).first.virginPos(fr.m_data.at(i).first.length() - 1) >= pos + 1) {
-                return {pos + 1, line};
-            } else if (i + 1 < static_cast<long long int>(fr.m_data.size())) {
-                return {fr.m_data.at(i + 1).first.virginPos(0), fr.m_data.at(i + 1).second.m_lineNumber};
-            } else {
-                return {pos, line};
-            }
+    const auto i = lineIndex(fr, line);
+
+    if (i >= 0) {
+        if (fr.m_data.at(i).first.virginPos(fr.m_data.at(i).first.length() - 1) >= pos + 1) {
+            return {pos + 1, line};
+        } else if (i + 1 < static_cast<long long int>(fr.m_data.size())) {
+            return {fr.m_data.at(i + 1).first.virginPos(0), fr.m_data.at(i + 1).second.m_lineNumber};
         }
     }
 
@@ -4311,6 +6084,46 @@ Parser<Trait>::collectDelimiters(const typename MdBlock<Trait>::Data &fr)
     return d;
 }
 
+template<class Trait>
+inline void
+Parser<Trait>::limitDelimiters(Delims &delims)
+{
+    auto limits = currentLimits();
+
+    if (!limits) {
+        return;
+    }
+
+    const long long int count = std::count_if(delims.cbegin(), delims.cend(), isInlineDelimiter);
+    long long int allowed = count;
+
+    if (limits->limits().m_maxDelimiters > 0 && count > limits->limits().m_maxDelimiters) {
+        allowed = limits->limits().m_maxDelimiters;
+
+        limits->setReached(DelimitersLimit);
+    }
+
+    if (allowed > 0 && !limits->consume(allowed)) {
+        allowed = 0;
+    }
+
+    if (allowed < count) {
+        Delims tmp;
+
+        for (const auto &d : delims) {
+            if (!isInlineDelimiter(d)) {
+                tmp.push_back(d);
+            } else if (allowed > 0) {
+                tmp.push_back(d);
+
+                --allowed;
+            }
+        }
+
+        std::swap(delims, tmp);
+    }
+}
+
 template<class Trait>
 inline bool
 isLineBreak(const typename Trait::String &s)
@@ -4374,7 +6187,7 @@ makeTextObject(const typename Trait::String &text,
             --endLine;
         }
 
-        std::shared_ptr<Text<Trait>> t(new Text<Trait>);
+        auto t = makeItem<Text<Trait>>();
         t->setText(s);
         t->setOpts(po.m_opts);
         t->setSpaceBefore(spaceBefore);
@@ -4414,7 +6227,7 @@ makeTextObjectWithLineBreak(const typename Trait::String &text,
 
     makeTextObject(text, spaceBefore, true, po, startPos, startLine, endPos, endLine);
 
-    std::shared_ptr<LineBreak<Trait>> hr(new LineBreak<Trait>);
+    auto hr = makeItem<LineBreak<Trait>>();
     hr->setText(po.m_fr.m_data.at(endLine).first.asString().sliced(endPos + 1));
     hr->setSpaceAfter(true);
     hr->setSpaceBefore(po.m_fr.m_data.at(endLine).first.asString()[endPos].isSpace());
@@ -5032,7 +6845,8 @@ Parser<Trait>::readHtmlTag(typename Delims::const_iterator it,
     for (; i < po.m_fr.m_data[it->m_line].first.length(); ++i) {
         const auto ch = po.m_fr.m_data[it->m_line].first[i];
 
-        if (ch.isSpace() || ch == Trait::latin1ToChar('>')) {
+        // Tag can't contain '<', there is no need to read further.
+        if (ch.isSpace() || ch == Trait::latin1ToChar('>') || ch == Trait::latin1ToChar('<')) {
             break;
         }
     }
@@ -5540,6 +7354,12 @@ Parser<Trait>::htmlTagRule(typename Delims::const_iterator it,
         return 5;
     }
 
+    // Tag that is followed by '<' is valid only as a start of comment, processing
+    // instruction or declaration.
+    const auto tagEnd = it->m_pos + 1 + tag.length();
+    const bool withLess = (tagEnd < po.m_fr.m_data[it->m_line].first.length() &&
+        po.m_fr.m_data[it->m_line].first[tagEnd] == Trait::latin1ToChar('<'));
+
     tag = tag.toLower();
 
     static const typename Trait::String s_validHtmlTagLetters =
@@ -5571,7 +7391,7 @@ Parser<Trait>::htmlTagRule(typename Delims::const_iterator it,
                                                              Trait::latin1ToString("style"),
                                                              Trait::latin1ToString("textarea")};
 
-    if (!closing && s_rule1.find(tag) != s_rule1.cend()) {
+    if (!closing && !withLess && s_rule1.find(tag) != s_rule1.cend()) {
         return 1;
     } else if (tag.startsWith(Trait::latin1ToString("!--"))) {
         return 2;
@@ -5581,6 +7401,8 @@ Parser<Trait>::htmlTagRule(typename Delims::const_iterator it,
                ((tag[1].unicode() >= 65 && tag[1].unicode() <= 90) ||
                     (tag[1].unicode() >= 97 && tag[1].unicode() <= 122))) {
         return 4;
+    } else if (withLess) {
+        return -1;
     } else {
         static const std::set<typename Trait::String> s_rule6 = {
             Trait::latin1ToString("address"),  Trait::latin1ToString("article"),    Trait::latin1ToString("aside"),    Trait::latin1ToString("base"),
@@ -5640,7 +7462,7 @@ Parser<Trait>::checkForRawHtml(typename Delims::const_iterator it,
     }
 
     po.m_html.m_htmlBlockType = rule;
-    po.m_html.m_html.reset(new RawHtml<Trait>);
+    po.m_html.m_html = makeItem<RawHtml<Trait>>();
     po.m_html.m_html->setStartColumn(po.m_fr.m_data.at(it->m_line).first.virginPos(it->m_pos));
     po.m_html.m_html->setStartLine(po.m_fr.m_data.at(it->m_line).second.m_lineNumber);
 
@@ -5737,7 +7559,7 @@ Parser<Trait>::checkForMath(typename Delims::const_iterator it,
         }
 
         if (!po.m_collectRefLinks) {
-            std::shared_ptr<Math<Trait>> m(new Math<Trait>);
+            auto m = makeItem<Math<Trait>>();
 
             auto startLine = po.m_fr.m_data.at(it->m_line).second.m_lineNumber;
             auto startColumn = po.m_fr.m_data.at(it->m_line).first.virginPos(it->m_pos + it->m_len);
@@ -5802,9 +7624,30 @@ Parser<Trait>::checkForAutolinkHtml(typename Delims::const_iterator it,
                                     TextParsingOpts<Trait> &po,
                                     bool updatePos)
 {
-    const auto nit = std::find_if(std::next(it), last, [](const auto &d) {
+    const auto isGreater = [](const auto &d) {
         return (d.m_type == Delimiter::Greater);
-    });
+    };
+
+    const auto from = std::make_pair(it->m_line, it->m_pos);
+    auto nit = last;
+
+    // The nearest ">" is remembered, otherwise many "<" without ">" are quadratic.
+    if (po.m_greaterSearchFrom.first >= 0 && po.m_greaterSearchFrom <= from &&
+        (po.m_nearestGreater.first < 0 || from < po.m_nearestGreater)) {
+        if (po.m_nearestGreater.first >= 0) {
+            nit = std::find_if(std::lower_bound(std::next(it), last, po.m_nearestGreater,
+                                   [](const auto &d, const auto &p) {
+                                       return (std::make_pair(d.m_line, d.m_pos) < p);
+                                   }),
+                               last, isGreater);
+        }
+    } else {
+        nit = std::find_if(std::next(it), last, isGreater);
+
+        po.m_greaterSearchFrom = from;
+        po.m_nearestGreater = (nit != last ? std::make_pair(nit->m_line, nit->m_pos) :
+            std::make_pair(-1LL, -1LL));
+    }
 
     if (nit != last) {
         if (nit->m_line == it->m_line) {
@@ -5829,7 +7672,7 @@ Parser<Trait>::checkForAutolinkHtml(typename Delims::const_iterator it,
 
             if (isUrl) {
                 if (!po.m_collectRefLinks) {
-                    std::shared_ptr<Link<Trait>> lnk(new Link<Trait>);
+                    auto lnk = makeItem<Link<Trait>>();
                     lnk->setStartColumn(po.m_fr.m_data.at(it->m_line).first.virginPos(it->m_pos));
                     lnk->setStartLine(po.m_fr.m_data.at(it->m_line).second.m_lineNumber);
                     lnk->setEndColumn(po.m_fr.m_data.at(nit->m_line).first.virginPos(nit->m_pos + nit->m_len - 1));
@@ -5901,7 +7744,7 @@ Parser<Trait>::makeInlineCode(long long int startLine,
     }
 
     if (!c.isEmpty()) {
-        auto code = std::make_shared<Code<Trait>>(c, false, true);
+        auto code = makeItem<Code<Trait>>(c, false, true);
 
         code->setStartColumn(po.m_fr.m_data.at(startLine).first.virginPos(startPos));
         code->setStartLine(po.m_fr.m_data.at(startLine).second.m_lineNumber);
@@ -5951,10 +7794,9 @@ Parser<Trait>::checkForInlineCode(typename Delims::const_iterator it,
 
     for (; it != last; ++it) {
         if (it->m_line <= po.m_lastTextLine) {
-            const auto p = skipSpaces<Trait>(0, po.m_fr.m_data.at(it->m_line).first.asString());
-            const auto withoutSpaces = po.m_fr.m_data.at(it->m_line).first.asString().sliced(p);
+            const auto &str = po.m_fr.m_data.at(it->m_line).first.asString();
 
-            if ((it->m_type == Delimiter::HorizontalLine && withoutSpaces[0] == Trait::latin1ToChar('-')) ||
+            if ((it->m_type == Delimiter::HorizontalLine && str[skipSpaces<Trait>(0, str)] == Trait::latin1ToChar('-')) ||
                 it->m_type == Delimiter::H1 || it->m_type == Delimiter::H2) {
                 break;
             } else if (it->m_type == Delimiter::InlineCode && (it->m_len - (it->m_backslashed ? 1 : 0)) == len) {
@@ -6070,27 +7912,55 @@ Parser<Trait>::checkForLinkText(typename Delims::const_iterator it,
 {
     const auto start = it;
 
-    long long int brackets = 0;
-
     const bool collectRefLinks = po.m_collectRefLinks;
     po.m_collectRefLinks = true;
     long long int l = po.m_line, p = po.m_pos;
 
-    for (it = std::next(it); it != last; ++it) {
+    // Brackets matched once are not scanned again, otherwise unclosed brackets are quadratic.
+    if (po.m_linkTextEndsLine != po.m_lastTextLine) {
+        po.m_linkTextEnds.clear();
+        po.m_linkTextEndsLine = po.m_lastTextLine;
+    }
+
+    const auto key = [](typename Delims::const_iterator d) {
+        return std::make_pair(d->m_line, d->m_pos);
+    };
+
+    std::vector<typename Delims::const_iterator> opened;
+
+    const auto known = po.m_linkTextEnds.find(key(it));
+
+    if (known != po.m_linkTextEnds.cend()) {
+        it = std::next(it, known->second);
+    } else {
+        opened.push_back(it);
+    }
+
+    for (it = (opened.empty() ? it : std::next(it)); !opened.empty() && it != last; ++it) {
         bool quit = false;
 
         switch (it->m_type) {
         case Delimiter::SquareBracketsClose: {
-            if (!brackets)
-                quit = true;
-            else
-                --brackets;
+            po.m_linkTextEnds[key(opened.back())] = std::distance(opened.back(), it);
+            opened.pop_back();
+
+            quit = opened.empty();
         } break;
 
         case Delimiter::SquareBracketsOpen:
-        case Delimiter::ImageOpen:
-            ++brackets;
-            break;
+        case Delimiter::ImageOpen: {
+            const auto nested = po.m_linkTextEnds.find(key(it));
+
+            if (nested != po.m_linkTextEnds.cend()) {
+                it = std::next(it, nested->second);
+
+                if (it == last) {
+                    quit = true;
+                }
+            } else {
+                opened.push_back(it);
+            }
+        } break;
 
         case Delimiter::InlineCode:
             it = checkForInlineCode(it, last, po);
@@ -6109,6 +7979,30 @@ Parser<Trait>::checkForLinkText(typename Delims::const_iterator it,
         }
     }
 
+    if (it == last) {
+        for (const auto &o : opened) {
+            po.m_linkTextEnds[key(o)] = std::distance(o, last);
+        }
+    } else if (it->m_line - start->m_line < 3) {
+        // Only inline links and links with reference may have text longer than 999 characters,
+        // labels can't be so long. Such text is not copied, otherwise nested brackets are quadratic.
+        const auto &closing = po.m_fr.m_data.at(it->m_line).first;
+        const auto next = (it->m_pos + it->m_len < closing.length() ?
+            closing[it->m_pos + it->m_len] : Trait::latin1ToChar(' '));
+
+        if (next != Trait::latin1ToChar('(') && next != Trait::latin1ToChar('[')) {
+            long long int length = it->m_pos - start->m_pos - start->m_len;
+
+            for (long long int i = start->m_line; i < it->m_line; ++i) {
+                length += po.m_fr.m_data.at(i).first.length();
+            }
+
+            if (length > 999) {
+                it = last;
+            }
+        }
+    }
+
     const auto r = readTextBetweenSquareBrackets(start, it, last, po, false, pos);
 
     po.m_collectRefLinks = collectRefLinks;
@@ -6237,7 +8131,7 @@ Parser<Trait>::makeLink(const typename Trait::String &url,
                 po.m_fileName;
     }
 
-    std::shared_ptr<Link<Trait>> link(new Link<Trait>);
+    auto link = makeItem<Link<Trait>>();
     link->setUrl(u);
     link->setOpts(po.m_opts);
     link->setTextPos(textPos);
@@ -6245,7 +8139,22 @@ Parser<Trait>::makeLink(const typename Trait::String &url,
 
     MdBlock<Trait> block = {text, 0};
 
-    std::shared_ptr<Paragraph<Trait>> p(new Paragraph<Trait>);
+    // Text of a link is parsed again for each outer link, that is exponential on nested links.
+    typename Trait::String key;
+
+    for (const auto &l : text) {
+        key.push_back(l.first.asString());
+        key.push_back(Trait::latin1ToChar('\n'));
+    }
+
+    if (!po.m_textsWithLinks) {
+        po.m_textsWithLinks = std::make_shared<std::unordered_set<typename Trait::String,
+            typename Trait::StringHash>>();
+    } else if (po.m_textsWithLinks->find(key) != po.m_textsWithLinks->cend()) {
+        return {};
+    }
+
+    auto p = makeItem<Paragraph<Trait>>();
 
     RawHtmlBlock<Trait> html;
 
@@ -6258,7 +8167,8 @@ Parser<Trait>::makeLink(const typename Trait::String &url,
                                   po.m_collectRefLinks,
                                   true,
                                   html,
-                                  true);
+                                  true,
+                                  po.m_textsWithLinks);
 
     if (!p->isEmpty()) {
         std::shared_ptr<Image<Trait>> img;
@@ -6269,6 +8179,8 @@ Parser<Trait>::makeLink(const typename Trait::String &url,
             for (auto it = ip->items().cbegin(), last = ip->items().cend(); it != last; ++it) {
                 switch ((*it)->type()) {
                 case ItemType::Link:
+                    po.m_textsWithLinks->insert(key);
+
                     return {};
 
                 case ItemType::Image: {
@@ -6380,7 +8292,7 @@ Parser<Trait>::makeImage(const typename Trait::String &url,
 {
     MD_UNUSED(doNotCreateTextOnFail)
 
-    std::shared_ptr<Image<Trait>> img(new Image<Trait>);
+    auto img = makeItem<Image<Trait>>();
 
     typename Trait::String u = (url.startsWith(Trait::latin1ToString("#")) ? url :
         removeBackslashes<typename Trait::String, Trait>(replaceEntity<Trait>(url)));
@@ -6395,7 +8307,7 @@ Parser<Trait>::makeImage(const typename Trait::String &url,
 
     MdBlock<Trait> block = {text, 0};
 
-    std::shared_ptr<Paragraph<Trait>> p(new Paragraph<Trait>);
+    auto p = makeItem<Paragraph<Trait>>();
 
     RawHtmlBlock<Trait> html;
 
@@ -6498,11 +8410,69 @@ skipSpacesUpTo1Line(long long int &line,
     }
 }
 
+//! \return Ends of link destinations on the given line. The line is scanned once, so
+//! many unfinished links on a line are not quadratic.
+template<class Trait>
+inline const typename TextParsingOpts<Trait>::LinkDestinations &
+linkDestinationEnds(long long int line,
+                    TextParsingOpts<Trait> &po)
+{
+    auto &d = po.m_linkDestinations;
+
+    if (d.m_line == line) {
+        return d;
+    }
+
+    const auto &s = po.m_fr.m_data.at(line).first.asString();
+    const long long int size = s.size();
+
+    d.m_line = line;
+    d.m_ends.assign(size + 1, size);
+    d.m_depths.assign(size + 1, 0);
+
+    std::vector<bool> escaped(size, false);
+    bool backslash = false;
+
+    for (long long int i = 0; i < size; ++i) {
+        escaped[i] = backslash;
+        d.m_depths[i + 1] = d.m_depths[i];
+
+        if (backslash) {
+            backslash = false;
+        } else if (s[i] == Trait::latin1ToChar('\\')) {
+            backslash = true;
+        } else if (s[i] == Trait::latin1ToChar('(')) {
+            ++d.m_depths[i + 1];
+        } else if (s[i] == Trait::latin1ToChar(')')) {
+            --d.m_depths[i + 1];
+        }
+    }
+
+    long long int space = size;
+    std::unordered_map<long long int, long long int> closing;
+
+    for (long long int i = size - 1; i >= 0; --i) {
+        if (!escaped[i]) {
+            if (s[i] == Trait::latin1ToChar(' ')) {
+                space = i;
+            } else if (s[i] == Trait::latin1ToChar(')')) {
+                closing[d.m_depths[i]] = i;
+            }
+        }
+
+        const auto c = closing.find(d.m_depths[i]);
+
+        d.m_ends[i] = std::min(space, c != closing.cend() ? c->second : size);
+    }
+
+    return d;
+}
+
 template<class Trait>
 inline std::tuple<long long int, long long int, bool, typename Trait::String, long long int>
 readLinkDestination(long long int line,
                     long long int pos,
-                    const TextParsingOpts<Trait> &po,
+                    TextParsingOpts<Trait> &po,
                     WithPosition *urlPos = nullptr)
 {
     skipSpacesUpTo1Line<Trait>(line, pos, po.m_fr.m_data);
@@ -6554,8 +8524,6 @@ readLinkDestination(long long int line,
                 return {line, pos, false, {}, destLine};
             }
         } else {
-            long long int pc = 0;
-
             const auto start = pos;
 
             if (urlPos) {
@@ -6563,43 +8531,13 @@ readLinkDestination(long long int line,
                 urlPos->setStartLine(po.m_fr.m_data[line].second.m_lineNumber);
             }
 
-            while (pos < s.size()) {
-                bool now = false;
-
-                if (s[pos] == Trait::latin1ToChar('\\') && !backslash) {
-                    backslash = true;
-                    now = true;
-                } else if (!backslash && s[pos] == Trait::latin1ToChar(' ')) {
-                    if (!pc) {
-                        if (urlPos) {
-                            urlPos->setEndColumn(po.m_fr.m_data[line].first.virginPos(pos - 1));
-                            urlPos->setEndLine(po.m_fr.m_data[line].second.m_lineNumber);
-                        }
-
-                        return {line, pos, true, s.sliced(start, pos - start), destLine};
-                    } else {
-                        return {line, pos, false, {}, destLine};
-                    }
-                } else if (!backslash && s[pos] == Trait::latin1ToChar('(')) {
-                    ++pc;
-                } else if (!backslash && s[pos] == Trait::latin1ToChar(')')) {
-                    if (!pc) {
-                        if (urlPos) {
-                            urlPos->setEndColumn(po.m_fr.m_data[line].first.virginPos(pos - 1));
-                            urlPos->setEndLine(po.m_fr.m_data[line].second.m_lineNumber);
-                        }
-
-                        return {line, pos, true, s.sliced(start, pos - start), destLine};
-                    } else {
-                        --pc;
-                    }
-                }
+            const auto &ends = linkDestinationEnds(line, po);
 
-                if (!now) {
-                    backslash = false;
-                }
+            pos = ends.m_ends[pos];
 
-                ++pos;
+            if (pos < s.size() && s[pos] == Trait::latin1ToChar(' ') &&
+                ends.m_depths[pos] != ends.m_depths[start]) {
+                return {line, pos, false, {}, destLine};
             }
 
             if (urlPos) {
@@ -6900,10 +8838,10 @@ Parser<Trait>::checkForLink(typename Delims::const_iterator it,
             text.front().first.asString().simplified().length() > 1 && text.size() == 1 &&
             start->m_line == it->m_line) {
             if (!po.m_collectRefLinks) {
-                std::shared_ptr<FootnoteRef<Trait>> fnr(new FootnoteRef<Trait>(
+                auto fnr = makeItem<FootnoteRef<Trait>>(
                     Trait::latin1ToString("#") + toSingleLine(text).simplified().toCaseFolded().toUpper() +
                     Trait::latin1ToString("/") + (po.m_workingPath.isEmpty() ? typename Trait::String() :
-                        po.m_workingPath + Trait::latin1ToString("/")) + po.m_fileName));
+                        po.m_workingPath + Trait::latin1ToString("/")) + po.m_fileName);
                 fnr->setStartColumn(po.m_fr.m_data.at(start->m_line).first.virginPos(start->m_pos));
                 fnr->setStartLine(po.m_fr.m_data.at(start->m_line).second.m_lineNumber);
                 fnr->setEndColumn(po.m_fr.m_data.at(it->m_line).first.virginPos(it->m_pos + it->m_len - 1));
@@ -6964,7 +8902,7 @@ Parser<Trait>::checkForLink(typename Delims::const_iterator it,
                                 (po.m_workingPath.isEmpty() ? typename Trait::String() :
                                     po.m_workingPath + Trait::latin1ToString("/")) + po.m_fileName;
 
-                            std::shared_ptr<Link<Trait>> link(new Link<Trait>);
+                            auto link = makeItem<Link<Trait>>();
                             link->setStartColumn(po.m_fr.m_data.at(start->m_line).first.virginPos(
                                 start->m_pos));
                             link->setStartLine(po.m_fr.m_data.at(start->m_line).second.m_lineNumber);
@@ -7094,162 +9032,55 @@ Parser<Trait>::checkForLink(typename Delims::const_iterator it,
             } else {
                 return checkShortcut(start, last, po, &Parser<Trait>::createShortcutLink);
             }
-        } else {
-            return checkShortcut(start, last, po, &Parser<Trait>::createShortcutLink);
-        }
-    }
-
-    return start;
-}
-
-inline bool
-isClosingStyle(const std::vector<std::pair<Style, long long int>> &styles,
-               Style s)
-{
-    const auto it = std::find_if(styles.cbegin(), styles.cend(), [&](const auto &p) {
-        return (p.first == s);
-    });
-
-    return it != styles.cend();
-}
-
-inline void
-closeStyle(std::vector<std::pair<Style, long long int>> &styles,
-           Style s)
-{
-    const auto it = std::find_if(styles.crbegin(), styles.crend(), [&](const auto &p) {
-        return (p.first == s);
-    });
-
-    if (it != styles.crend()) {
-        styles.erase(it.base() - 1);
-    }
-}
-
-inline void
-applyStyles(int &opts,
-            const std::vector<std::pair<Style, long long int>> &styles)
-{
-    opts = 0;
-
-    for (const auto &s : styles) {
-        switch (s.first) {
-        case Style::Strikethrough:
-            opts |= StrikethroughText;
-            break;
-
-        case Style::Italic1:
-        case Style::Italic2:
-            opts |= ItalicText;
-            break;
-
-        case Style::Bold1:
-        case Style::Bold2:
-            opts |= BoldText;
-            break;
-
-        default:
-            break;
-        }
-    }
-}
-
-inline void
-appendPossibleDelimiter(std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>> &vars,
-                        long long int len,
-                        int type,
-                        bool leftAndRight)
-{
-    for (auto &v : vars) {
-        v.push_back({{len, leftAndRight}, type});
-    }
-}
-
-inline std::vector<std::pair<std::pair<long long int, bool>, int>>
-longestSequenceWithMoreOpeningsAtStart(const std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>> &vars)
-{
-    size_t max = 0;
-
-    for (const auto &s : vars) {
-        if (s.size() > max) {
-            max = s.size();
-        }
-    }
-
-    std::vector<std::pair<std::pair<long long int, bool>, int>> ret;
-
-    size_t maxOp = 0;
-
-    for (const auto &s : vars) {
-        if (s.size() == max) {
-            size_t op = 0;
-
-            for (const auto &v : s) {
-                if (v.first.first > 0) {
-                    ++op;
-                } else {
-                    break;
-                }
-            }
-
-            if (op > maxOp) {
-                maxOp = op;
-                ret = s;
-            }
+        } else {
+            return checkShortcut(start, last, po, &Parser<Trait>::createShortcutLink);
         }
     }
 
-    return ret;
+    return start;
+}
+
+inline bool
+isClosingStyle(const std::vector<std::pair<Style, long long int>> &styles,
+               Style s)
+{
+    const auto it = std::find_if(styles.cbegin(), styles.cend(), [&](const auto &p) {
+        return (p.first == s);
+    });
+
+    return it != styles.cend();
 }
 
 inline void
-collectDelimiterVariants(std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>> &vars,
-                         long long int itLength,
-                         int type,
-                         bool leftFlanking,
-                         bool rightFlanking)
+openStyle(std::vector<std::pair<Style, int>> &styles,
+          Style s)
 {
-    {
-        auto vars1 = vars;
-        auto vars2 = vars;
+    styles.push_back({s, (styles.empty() ? TextWithoutFormat : styles.back().second) | styleToTextOption(s)});
+}
 
-        vars.clear();
+inline void
+closeStyle(std::vector<std::pair<Style, int>> &styles,
+           Style s)
+{
+    const auto it = std::find_if(styles.crbegin(), styles.crend(), [&](const auto &p) {
+        return (p.first == s);
+    });
 
-        if (leftFlanking) {
-            appendPossibleDelimiter(vars1, itLength, type, leftFlanking && rightFlanking);
-            std::copy(vars1.cbegin(), vars1.cend(), std::back_inserter(vars));
-        }
+    if (it != styles.crend()) {
+        auto i = styles.erase(it.base() - 1);
 
-        if (rightFlanking) {
-            appendPossibleDelimiter(vars2, -itLength, type, leftFlanking && rightFlanking);
-            std::copy(vars2.cbegin(), vars2.cend(), std::back_inserter(vars));
+        for (; i != styles.end(); ++i) {
+            i->second = (i == styles.begin() ? TextWithoutFormat : std::prev(i)->second) |
+                styleToTextOption(i->first);
         }
     }
 }
 
-template<class Trait>
 inline void
-Parser<Trait>::createStyles(std::vector<std::pair<Style, long long int>> &s,
-                            long long int l,
-                            typename Delimiter::DelimiterType t,
-                            long long int &count)
-{
-    if (t != Delimiter::Strikethrough) {
-        if (l % 2 == 1) {
-            s.push_back({t == Delimiter::Emphasis1 ? Style::Italic1 : Style::Italic2, 1});
-            ++count;
-        }
-
-        if (l >= 2) {
-            for (long long int i = 0; i < l / 2; ++i) {
-                s.push_back({t == Delimiter::Emphasis1 ? Style::Bold1 : Style::Bold2, 2});
-                count += 2;
-            }
-        }
-    } else {
-        s.push_back({Style::Strikethrough, l});
-        ++count;
-    }
+applyStyles(int &opts,
+            const std::vector<std::pair<Style, int>> &styles)
+{
+    opts = (styles.empty() ? TextWithoutFormat : styles.back().second);
 }
 
 template<class Trait>
@@ -7259,7 +9090,7 @@ Parser<Trait>::isSequence(typename Delims::const_iterator it,
                           long long int itPos,
                           typename Delimiter::DelimiterType t)
 {
-    return (itLine == it->m_line && itPos + it->m_len == it->m_pos && it->m_type == t);
+    return (itLine == it->m_line && itPos == it->m_pos && it->m_type == t);
 }
 
 template<class Trait>
@@ -7272,7 +9103,7 @@ Parser<Trait>::readSequence(typename Delims::const_iterator it,
                             typename Delims::const_iterator &current)
 {
     line = it->m_line;
-    pos = it->m_pos;
+    pos = it->m_pos + it->m_len;
     len = it->m_len;
     current = it;
     const auto t = it->m_type;
@@ -7363,212 +9194,120 @@ Parser<Trait>::checkEmphasisSequence(const std::vector<std::pair<std::pair<long
 }
 
 template<class Trait>
-inline std::vector<std::pair<std::pair<long long int, bool>, int>>
-Parser<Trait>::fixSequence(const std::vector<std::pair<std::pair<long long int, bool>, int>> &s)
-{
-    std::vector<std::pair<std::pair<long long int, bool>, int>> tmp;
-    std::map<int, long long int> length;
-
-    for (const auto &p : s) {
-        if (p.first.first < 0 && length[p.second] + p.first.first < 0) {
-            tmp.push_back({{-length[p.second], p.first.second}, p.second});
-
-            length[p.second] = 0;
-        } else {
-            tmp.push_back(p);
-
-            length[p.second] += p.first.first;
-        }
-    }
-
-    return tmp;
-}
-
-template<class Trait>
-inline std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>>
-Parser<Trait>::closedSequences(const std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>> &vars,
-                               size_t idx)
-{
-    std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>> tmp;
-
-    const auto longest = longestSequenceWithMoreOpeningsAtStart(vars);
-
-    for (const auto &v : vars) {
-        if (longest.size() == v.size()) {
-            bool closed = false;
-            std::tie(closed, std::ignore) = checkEmphasisSequence(v, idx);
-
-            if (closed) {
-                tmp.push_back(fixSequence(v));
-            }
-        }
-    }
-
-    return tmp;
-}
-
-template<class Trait>
-inline std::vector<std::pair<Style, long long int>>
-Parser<Trait>::createStyles(const std::vector<std::pair<std::pair<long long int, bool>, int>> &s,
-                            size_t i,
-                            typename Delimiter::DelimiterType t,
-                            long long int &count)
+inline typename Parser<Trait>::Delims::const_iterator
+Parser<Trait>::incrementIterator(typename Delims::const_iterator it,
+                                 typename Delims::const_iterator last,
+                                 long long int count)
 {
-    std::vector<std::pair<Style, long long int>> styles;
-
-    const size_t idx = i;
-    long long int len = s[i].first.first;
-
-    size_t closeIdx = 0;
-    std::tie(std::ignore, closeIdx) = checkEmphasisSequence(s, i);
-
-    for (i = closeIdx;; --i) {
-        if (s[i].second == s[idx].second && s[i].first.first < 0) {
-            auto l = std::abs(s[i].first.first);
-
-            createStyles(styles, std::min(l, len), t, count);
-
-            len -= std::min(l, len);
-
-            if (!len) {
-                break;
-            }
-        }
+    const auto len = std::distance(it, last);
 
-        if (i == 0) {
-            break;
-        }
+    if (count < len) {
+        return it + count;
+    } else {
+        return it + (len - 1);
     }
-
-    return styles;
 }
 
 template<class Trait>
-inline bool
-isSkipAllEmphasis(const std::vector<std::pair<std::pair<long long int, bool>, int>> &s,
-                  size_t idx)
+inline void
+appendCloseStyle(TextParsingOpts<Trait> &po,
+                 const StyleDelim &s)
 {
-    if (s[idx].first.second) {
-        for (size_t i = idx + 1; i < s.size(); ++i) {
-            if (s[i].second == s[idx].second && s[i].first.first < 0) {
-                return ((s[idx].first.first - s[i].first.first) % 3 == 0 &&
-                    !(s[idx].first.first % 3 == 0 && s[i].first.first % 3 == 0));
-            }
-        }
+    if (po.m_lastItemWithStyle) {
+        po.m_lastItemWithStyle->closeStyles().push_back(s);
     }
-
-    return false;
 }
 
 template<class Trait>
-inline std::tuple<bool, std::vector<std::pair<Style, long long int>>, long long int, long long int>
-Parser<Trait>::isStyleClosed(typename Delims::const_iterator it,
-                             typename Delims::const_iterator last,
-                             TextParsingOpts<Trait> &po)
+inline void
+Parser<Trait>::collectEmphasisRuns(typename Delims::const_iterator it,
+                                   typename Delims::const_iterator last,
+                                   TextParsingOpts<Trait> &po)
 {
-    const auto open = it;
-    auto current = it;
-
-    std::vector<std::vector<std::pair<std::pair<long long int, bool>, int>>> vars, closed;
-    vars.push_back({});
-
-    long long int itLine = open->m_line, itPos = open->m_pos, itLength = open->m_len;
+    po.m_emphasisRuns.clear();
+    po.m_emphasisFrom = {it->m_line, it->m_pos};
+    po.m_emphasisTo = {std::numeric_limits<long long int>::max(), 0};
 
+    // Checks of links and others should not affect state of parsing.
     const long long int line = po.m_line, pos = po.m_pos;
     const bool collectRefLinks = po.m_collectRefLinks;
+    const auto lastText = po.m_lastText;
+    const bool isSpaceBefore = po.m_isSpaceBefore;
+    const bool wasRefLink = po.m_wasRefLink;
+    const bool firstInParagraph = po.m_firstInParagraph;
 
     po.m_collectRefLinks = true;
 
-    bool first = true;
+    for (; it != last; ++it) {
+        if (it->m_line > po.m_lastTextLine) {
+            po.m_emphasisTo = {it->m_line, it->m_pos};
 
-    std::for_each(po.m_styles.cbegin(), po.m_styles.cend(), [&vars](const auto &p) {
-        if (p.first == Style::Strikethrough) {
-            vars.front().push_back({{p.second, false}, 0});
+            break;
         }
-    });
 
-    {
-        {
-            const auto c1 = std::count_if(po.m_styles.cbegin(), po.m_styles.cend(), [&](const auto &p) {
-                return (p.first == Style::Italic1);
-            });
+        po.m_line = it->m_line;
+        po.m_pos = it->m_pos;
 
-            if (c1) {
-                vars.front().push_back({{c1, false}, 1});
-            }
+        switch (it->m_type) {
+        case Delimiter::SquareBracketsOpen:
+            it = checkForLink(it, last, po);
+            break;
 
-            const auto c2 = std::count_if(po.m_styles.cbegin(),
-                                          po.m_styles.cend(),
-                                          [&](const auto &p) {
-                                              return (p.first == Style::Bold1);
-                                          }) * 2;
+        case Delimiter::ImageOpen:
+            it = checkForImage(it, last, po);
+            break;
 
-            if (c2) {
-                vars.front().push_back({{c2, false}, 1});
-            }
-        }
+        case Delimiter::Less:
+            it = checkForAutolinkHtml(it, last, po, false);
+            break;
 
-        {
-            const auto c1 = std::count_if(po.m_styles.cbegin(), po.m_styles.cend(), [&](const auto &p) {
-                return (p.first == Style::Italic2);
-            });
+        case Delimiter::Math:
+            it = checkForMath(it, last, po);
+            break;
 
-            if (c1) {
-                vars.front().push_back({{c1, false}, 2});
+        case Delimiter::InlineCode: {
+            if (!it->m_backslashed) {
+                it = checkForInlineCode(it, last, po);
             }
+        } break;
 
-            const auto c2 = std::count_if(po.m_styles.cbegin(),
-                                          po.m_styles.cend(),
-                                          [&](const auto &p) {
-                                              return (p.first == Style::Bold2);
-                                          }) * 2;
-
-            if (c2) {
-                vars.front().push_back({{c2, false}, 2});
-            }
-        }
-    }
+        // Emphasis doesn't continue after a heading or a horizontal line.
+        case Delimiter::HorizontalLine:
+        case Delimiter::H1:
+        case Delimiter::H2: {
+            po.m_emphasisTo = {it->m_line, it->m_pos};
+            it = std::prev(last);
+        } break;
 
-    const auto idx = vars.front().size();
+        case Delimiter::Strikethrough:
+        case Delimiter::Emphasis1:
+        case Delimiter::Emphasis2: {
+            EmphasisRun r;
+            r.m_line = it->m_line;
+            r.m_pos = it->m_pos;
+            r.m_type = emphasisToInt(it->m_type);
 
-    for (; it != last; ++it) {
-        if (it->m_line <= po.m_lastTextLine) {
-            switch (it->m_type) {
-            case Delimiter::SquareBracketsOpen:
-                it = checkForLink(it, last, po);
-                break;
+            long long int runLine = 0, runPos = 0;
+            auto current = it;
 
-            case Delimiter::ImageOpen:
-                it = checkForImage(it, last, po);
-                break;
+            it = readSequence(it, last, runLine, runPos, r.m_len, current);
 
-            case Delimiter::Less:
-                it = checkForAutolinkHtml(it, last, po, false);
-                break;
+            r.m_canOpen = it->m_leftFlanking;
+            r.m_canClose = it->m_rightFlanking;
 
-            case Delimiter::Strikethrough:
-            case Delimiter::Emphasis1:
-            case Delimiter::Emphasis2: {
-                it = readSequence(it, last, itLine, itPos, itLength, current);
+            // "_" inside a word may open or close emphasis only next to punctuation.
+            if (it->m_type == Delimiter::Emphasis2 && r.m_canOpen && r.m_canClose) {
+                const auto &str = po.m_fr.m_data[r.m_line].first;
+                const auto after = r.m_pos + r.m_len;
 
-                if (first) {
-                    vars.front().push_back({{itLength, it->m_leftFlanking && it->m_rightFlanking},
-                        emphasisToInt(open->m_type)});
-                    first = false;
-                } else {
-                    collectDelimiterVariants(vars, itLength, emphasisToInt(it->m_type),
-                        it->m_leftFlanking, it->m_rightFlanking);
-                }
-            } break;
+                r.m_canOpen = (str[r.m_pos - 1].isPunct() || str[r.m_pos - 1].isSymbol());
+                r.m_canClose = (after < str.length() ? str[after].isPunct() || str[after].isSymbol() : true);
+            }
 
-            case Delimiter::InlineCode:
-                it = checkForInlineCode(it, last, po);
-                break;
+            po.m_emphasisRuns.push_back(std::move(r));
+        } break;
 
-            default:
-                break;
-            }
-        } else {
+        default:
             break;
         }
     }
@@ -7576,229 +9315,128 @@ Parser<Trait>::isStyleClosed(typename Delims::const_iterator it,
     po.m_line = line;
     po.m_pos = pos;
     po.m_collectRefLinks = collectRefLinks;
+    po.m_lastText = lastText;
+    po.m_isSpaceBefore = isSpaceBefore;
+    po.m_wasRefLink = wasRefLink;
+    po.m_firstInParagraph = firstInParagraph;
 
-    closed = closedSequences(vars, idx);
-
-    if (!closed.empty()) {
-        long long int itCount = 0;
-
-        return {true, createStyles(longestSequenceWithMoreOpeningsAtStart(closed), idx,
-            open->m_type, itCount), vars.front().at(idx).first.first, itCount};
-    } else {
-        return {false, {{Style::Unknown, 0}}, isSkipAllEmphasis<Trait>(vars.front(), idx) ?
-            vars.front().at(idx).first.first : open->m_len, 1};
-    }
-}
-
-template<class Trait>
-inline typename Parser<Trait>::Delims::const_iterator
-Parser<Trait>::incrementIterator(typename Delims::const_iterator it,
-                                 typename Delims::const_iterator last,
-                                 long long int count)
-{
-    const auto len = std::distance(it, last);
-
-    if (count < len) {
-        return it + count;
-    } else {
-        return it + (len - 1);
-    }
-}
-
-template<class Trait>
-inline void
-appendCloseStyle(TextParsingOpts<Trait> &po,
-                 const StyleDelim &s)
-{
-    if (po.m_lastItemWithStyle) {
-        po.m_lastItemWithStyle->closeStyles().push_back(s);
-    }
+    resolveEmphasisRuns(po.m_emphasisRuns);
 }
 
 template<class Trait>
 inline typename Parser<Trait>::Delims::const_iterator
-Parser<Trait>::checkForStyle(typename Delims::const_iterator first,
-                             typename Delims::const_iterator it,
+Parser<Trait>::checkForStyle(typename Delims::const_iterator it,
                              typename Delims::const_iterator last,
                              TextParsingOpts<Trait> &po)
 {
-    long long int count = 1;
-
     po.m_wasRefLink = false;
     po.m_firstInParagraph = false;
 
-    if (it->m_rightFlanking) {
-        long long int line = it->m_line, pos = it->m_pos + it->m_len, ppos = it->m_pos;
-        const auto t = it->m_type;
-        long long int len = it->m_len;
+    const auto itPos = std::make_pair(it->m_line, it->m_pos);
 
-        for (auto j = std::next(it); j != last; ++j) {
-            if (j->m_line == line && pos == j->m_pos && j->m_type == t) {
-                len += j->m_len;
-                pos = j->m_pos + j->m_len;
-                ++count;
-            } else {
-                break;
-            }
-        }
+    if (itPos < po.m_emphasisFrom || itPos >= po.m_emphasisTo) {
+        collectEmphasisRuns(it, last, po);
+    }
 
-        if (it != first) {
-            for (auto j = std::prev(it);; --j) {
-                if (j->m_line == line && ppos - j->m_len == j->m_pos && j->m_type == t) {
-                    len += j->m_len;
-                    ppos = j->m_pos;
-                    ++count;
-                } else {
-                    break;
-                }
+    auto run = std::upper_bound(po.m_emphasisRuns.cbegin(), po.m_emphasisRuns.cend(), itPos,
+        [](const auto &p, const auto &r) {
+            return p < std::make_pair(r.m_line, r.m_pos);
+        });
 
-                if (j == first) {
-                    break;
-                }
-            }
+    // Delimiter was skipped on collecting of runs, it's a text.
+    if (run == po.m_emphasisRuns.cbegin() || std::prev(run)->m_line != it->m_line ||
+        std::prev(run)->m_pos + std::prev(run)->m_len <= it->m_pos) {
+        if (!po.m_collectRefLinks) {
+            makeText(it->m_line, it->m_pos + it->m_len, po);
         }
 
-        long long int opened = 0;
-
-        for (auto it = po.m_styles.crbegin(), last = po.m_styles.crend(); it != last; ++it) {
-            bool doBreak = false;
+        resetHtmlTag(po.m_html);
 
-            switch (t) {
-            case Delimiter::Emphasis1: {
-                if (it->first == Style::Italic1 || it->first == Style::Bold1) {
-                    opened = it->second;
-                    doBreak = true;
-                }
-            } break;
+        return it;
+    }
 
-            case Delimiter::Emphasis2: {
-                if (it->first == Style::Italic2 || it->first == Style::Bold2) {
-                    opened = it->second;
-                    doBreak = true;
-                }
-            } break;
+    run = std::prev(run);
 
-            case Delimiter::Strikethrough: {
-                if (it->first == Style::Strikethrough) {
-                    opened = it->second;
-                    doBreak = true;
-                }
-            } break;
+    const auto style = [&](long long int len) {
+        switch (it->m_type) {
+        case Delimiter::Strikethrough:
+            return Style::Strikethrough;
 
-            default:
-                break;
-            }
+        case Delimiter::Emphasis1:
+            return (len == 1 ? Style::Italic1 : Style::Bold1);
 
-            if (doBreak)
-                break;
+        default:
+            return (len == 1 ? Style::Italic2 : Style::Bold2);
         }
+    };
 
-        const bool sumMult3 = (it->m_leftFlanking ? ((opened + len) % 3 == 0) : false);
+    // Closing delimiters are at the start of the run, opening ones are at the end,
+    // and the rest of delimiters between them are a text.
+    const auto offset = it->m_pos - run->m_pos;
+    const auto closed = std::accumulate(run->m_closes.cbegin(), run->m_closes.cend(), 0ll);
+    const auto opened = std::accumulate(run->m_opens.cbegin(), run->m_opens.cend(), 0ll);
+    long long int count = 1;
 
-        if (count && opened && (!sumMult3 || (count % 3 == 0 && opened % 3 == 0))) {
-            if (count > opened) {
-                count = opened;
-            }
+    if (offset == 0 && closed) {
+        auto pos = po.m_fr.m_data.at(it->m_line).first.virginPos(it->m_pos);
+        const auto line = po.m_fr.m_data.at(it->m_line).second.m_lineNumber;
 
-            auto pos = po.m_fr.m_data.at(it->m_line).first.virginPos(it->m_pos);
-            const auto line = po.m_fr.m_data.at(it->m_line).second.m_lineNumber;
+        for (const auto len : run->m_closes) {
+            const auto st = style(len);
 
-            if (it->m_type == Delimiter::Strikethrough) {
-                const auto len = it->m_len;
+            closeStyle(po.m_styles, st);
+            appendCloseStyle(po, {styleToTextOption(st), pos, line, pos + len - 1, line});
+            pos += len;
+        }
 
-                for (auto i = 0; i < count; ++i) {
-                    closeStyle(po.m_styles, Style::Strikethrough);
-                    appendCloseStyle(po, {StrikethroughText, pos, line, pos + len - 1, line});
-                    pos += len;
-                }
-            } else {
-                if (count % 2 == 1) {
-                    const auto st = (it->m_type == Delimiter::Emphasis1 ? Style::Italic1 : Style::Italic2);
+        applyStyles(po.m_opts, po.m_styles);
 
-                    closeStyle(po.m_styles, st);
-                    appendCloseStyle(po, {ItalicText, pos, line, pos, line});
-                    ++pos;
-                }
+        const auto j = incrementIterator(it, last, closed / it->m_len - 1);
 
-                if (count >= 2) {
-                    const auto st = (it->m_type == Delimiter::Emphasis1 ? Style::Bold1 : Style::Bold2);
+        po.m_pos = j->m_pos + j->m_len;
+        po.m_line = j->m_line;
 
-                    for (auto i = 0; i < count / 2; ++i) {
-                        closeStyle(po.m_styles, st);
-                        appendCloseStyle(po, {BoldText, pos, line, pos + 1, line});
-                        pos += 2;
-                    }
-                }
-            }
+        if (po.m_lastText) {
+            po.m_lastText->setSpaceAfter(po.m_lastText->isSpaceAfter() ||
+                (po.m_pos < po.m_fr.m_data[po.m_line].first.length() ?
+                    po.m_fr.m_data[po.m_line].first[po.m_pos].isSpace() : true));
+        }
 
-            applyStyles(po.m_opts, po.m_styles);
+        return j;
+    } else if (opened && offset == run->m_len - opened) {
+        auto pos = po.m_fr.m_data.at(it->m_line).first.virginPos(it->m_pos);
+        const auto line = po.m_fr.m_data.at(it->m_line).second.m_lineNumber;
 
-            const auto j = incrementIterator(it, last, count - 1);
+        for (const auto len : run->m_opens) {
+            const auto st = style(len);
 
-            po.m_pos = j->m_pos + j->m_len;
-            po.m_line = j->m_line;
+            openStyle(po.m_styles, st);
 
-            if (po.m_lastText) {
-                po.m_lastText->setSpaceAfter(po.m_lastText->isSpaceAfter() ||
-                    (po.m_pos < po.m_fr.m_data[po.m_line].first.length() ?
-                        po.m_fr.m_data[po.m_line].first[po.m_pos].isSpace() : true));
+            if (!po.m_collectRefLinks) {
+                po.m_openStyles.push_back({styleToTextOption(st), pos, line, pos + len - 1, line});
             }
 
-            return j;
+            pos += len;
         }
-    }
-
-    count = 1;
-
-    if (it->m_leftFlanking) {
-        switch (it->m_type) {
-        case Delimiter::Strikethrough:
-        case Delimiter::Emphasis1:
-        case Delimiter::Emphasis2: {
-            bool closed = false;
-            std::vector<std::pair<Style, long long int>> styles;
-            long long int len = 0;
-
-            std::tie(closed, styles, len, count) = isStyleClosed(it, last, po);
-
-            if (closed) {
-                auto pos = po.m_fr.m_data.at(it->m_line).first.virginPos(it->m_pos);
-                const auto line = po.m_fr.m_data.at(it->m_line).second.m_lineNumber;
 
-                for (const auto &p : styles) {
-                    po.m_styles.push_back({p.first, p.second});
+        po.m_pos = run->m_pos + run->m_len;
+        po.m_line = it->m_line;
 
-                    if (!po.m_collectRefLinks) {
-                        po.m_openStyles.push_back({styleToTextOption(p.first), pos, line,
-                            pos + p.second - 1, line});
-                    }
-
-                    pos += p.second;
-                }
+        po.m_isSpaceBefore = (it->m_pos > 0 ?
+            po.m_fr.m_data[it->m_line].first[it->m_pos - 1].isSpace() : true) ||
+                po.m_isSpaceBefore;
 
-                po.m_pos = it->m_pos + len;
-                po.m_line = it->m_line;
+        applyStyles(po.m_opts, po.m_styles);
 
-                po.m_isSpaceBefore = (it->m_pos > 0 ?
-                    po.m_fr.m_data[it->m_line].first[it->m_pos - 1].isSpace() : true) ||
-                        po.m_isSpaceBefore;
-
-                applyStyles(po.m_opts, po.m_styles);
-            } else if (!po.m_collectRefLinks) {
-                makeText(it->m_line, it->m_pos + len, po);
-            }
-        } break;
+        count = opened / it->m_len;
+    } else {
+        const auto end = std::max(offset + it->m_len, run->m_len - opened);
 
-        default: {
-            if (!po.m_collectRefLinks) {
-                makeText(it->m_line, it->m_pos + it->m_len, po);
-            }
-        } break;
+        if (!po.m_collectRefLinks) {
+            makeText(it->m_line, run->m_pos + end, po);
         }
-    }
 
-    if (!count) {
-        count = 1;
+        count = (end - offset) / it->m_len;
     }
 
     resetHtmlTag(po.m_html);
@@ -7811,7 +9449,7 @@ inline std::shared_ptr<Text<Trait>>
 concatenateText(typename Block<Trait>::Items::const_iterator it,
                 typename Block<Trait>::Items::const_iterator last)
 {
-    std::shared_ptr<Text<Trait>> t(new Text<Trait>);
+    auto t = makeItem<Text<Trait>>();
     t->setOpts(std::static_pointer_cast<Text<Trait>>(*it)->opts());
     t->setSpaceBefore(std::static_pointer_cast<Text<Trait>>(*it)->isSpaceBefore());
     t->setStartColumn((*it)->startColumn());
@@ -7888,7 +9526,9 @@ optimizeParagraph(std::shared_ptr<Paragraph<Trait>> &p,
                   TextParsingOpts<Trait> &po,
                   OptimizeParagraphType type = OptimizeParagraphType::Full)
 {
-    std::shared_ptr<Paragraph<Trait>> np(new Paragraph<Trait>);
+    PhaseScope phase(ParsingPhase::ParagraphOptimization);
+
+    auto np = makeItem<Paragraph<Trait>>();
     np->setStartColumn(p->startColumn());
     np->setStartLine(p->startLine());
     np->setEndColumn(p->endColumn());
@@ -7897,7 +9537,7 @@ optimizeParagraph(std::shared_ptr<Paragraph<Trait>> &p,
     int opts = TextWithoutFormat;
     auto start = p->items().cend();
     long long int line = -1;
-    long long int auxStart = 0, auxIt = 0;
+    long long int auxStart = 0, auxIt = 0, auxTo = 0;
     bool finished = false;
 
     for (auto it = p->items().cbegin(), last = p->items().cend(); it != last; ++it) {
@@ -7913,8 +9553,7 @@ optimizeParagraph(std::shared_ptr<Paragraph<Trait>> &p,
                 if (opts != t->opts() || t->startLine() != line || finished ||
                     (!t->openStyles().empty() && isSemiOptimization(type))) {
                     if (!isWithoutRawDataOptimization(type)) {
-                        po.concatenateAuxText(auxStart, auxIt);
-                        auxIt = auxIt - (auxIt - auxStart) + 1;
+                        auxTo = po.concatenateAuxText(auxStart, auxIt, auxTo);
                         auxStart = auxIt;
                     }
 
@@ -7934,8 +9573,7 @@ optimizeParagraph(std::shared_ptr<Paragraph<Trait>> &p,
 
             if (start != last) {
                 if (!isWithoutRawDataOptimization(type)) {
-                    po.concatenateAuxText(auxStart, auxIt);
-                    auxIt = auxIt - (auxIt - auxStart) + 1;
+                    auxTo = po.concatenateAuxText(auxStart, auxIt, auxTo);
                     auxStart = auxIt;
                 }
 
@@ -7953,8 +9591,17 @@ optimizeParagraph(std::shared_ptr<Paragraph<Trait>> &p,
         np->appendItem(concatenateText<Trait>(start, p->items().cend()));
 
         if (!isWithoutRawDataOptimization(type)) {
-            po.concatenateAuxText(auxStart, po.m_rawTextData.size());
+            auxTo = po.concatenateAuxText(auxStart, po.m_rawTextData.size(), auxTo);
+            auxStart = po.m_rawTextData.size();
+        }
+    }
+
+    if (!isWithoutRawDataOptimization(type)) {
+        for (; auxStart < static_cast<long long int>(po.m_rawTextData.size()); ++auxStart) {
+            auxTo = po.concatenateAuxText(auxStart, auxStart + 1, auxTo);
         }
+
+        po.m_rawTextData.resize(auxTo);
     }
 
     p = np;
@@ -8068,7 +9715,7 @@ inline std::shared_ptr<Paragraph<Trait>>
 makeParagraph(typename Block<Trait>::Items::const_iterator first,
               typename Block<Trait>::Items::const_iterator last)
 {
-    auto p = std::make_shared<Paragraph<Trait>>();
+    auto p = makeItem<Paragraph<Trait>>();
 
     p->setStartColumn((*first)->startColumn());
     p->setStartLine((*first)->startLine());
@@ -8162,7 +9809,7 @@ splitParagraphsAndFreeHtml(std::shared_ptr<Block<Trait>> parent,
     } else {
         po.m_rawTextData.clear();
 
-        return std::make_shared<Paragraph<Trait>>();
+        return makeItem<Paragraph<Trait>>();
     }
 }
 
@@ -8194,7 +9841,7 @@ makeHeading(std::shared_ptr<Block<Trait>> parent,
                 po.m_rawTextData.back().m_str += (lb->isSpaceBefore() ?
                     Trait::latin1ToString(" ") : typename Trait::String()) + lb->text();
             } else {
-                auto t = std::make_shared<Text<Trait>>();
+                auto t = makeItem<Text<Trait>>();
                 t->setText(lb->text());
                 t->setSpaceBefore(lb->isSpaceBefore());
                 t->setSpaceAfter(lb->isSpaceAfter());
@@ -8253,7 +9900,7 @@ makeHeading(std::shared_ptr<Block<Trait>> parent,
             }
         }
 
-        std::shared_ptr<Heading<Trait>> h(new Heading<Trait>);
+        auto h = makeItem<Heading<Trait>>();
         h->setStartColumn(p->startColumn());
         h->setStartLine(p->startLine());
         h->setEndColumn(lastColumn);
@@ -8327,7 +9974,7 @@ inline void
 makeHorLine(const typename MdBlock<Trait>::Line &line,
             std::shared_ptr<Block<Trait>> parent)
 {
-    std::shared_ptr<Item<Trait>> hr(new HorizontalLine<Trait>);
+    std::shared_ptr<Item<Trait>> hr = makeItem<HorizontalLine<Trait>>();
     hr->setStartColumn(line.first.virginPos(skipSpaces<Trait>(0, line.first.asString())));
     hr->setStartLine(line.second.m_lineNumber);
     hr->setEndColumn(line.first.virginPos(line.first.length() - 1));
@@ -8346,22 +9993,30 @@ Parser<Trait>::parseFormattedTextLinksImages(MdBlock<Trait> &fr,
                                              bool collectRefLinks,
                                              bool ignoreLineBreak,
                                              RawHtmlBlock<Trait> &html,
-                                             bool inLink)
+                                             bool inLink,
+                                             std::shared_ptr<std::unordered_set<typename Trait::String,
+                                                 typename Trait::StringHash>> textsWithLinks)
 
 {
     if (fr.m_data.empty()) {
         return;
     }
 
-    std::shared_ptr<Paragraph<Trait>> p(new Paragraph<Trait>);
+    PhaseScope phase(ParsingPhase::Inlines);
+
+    auto p = makeItem<Paragraph<Trait>>();
     p->setStartColumn(fr.m_data.at(0).first.virginPos(0));
     p->setStartLine(fr.m_data.at(0).second.m_lineNumber);
-    std::shared_ptr<Paragraph<Trait>> pt(new Paragraph<Trait>);
+    auto pt = makeItem<Paragraph<Trait>>();
 
-    const auto delims = collectDelimiters(fr.m_data);
+    auto delims = collectDelimiters(fr.m_data);
+    limitDelimiters(delims);
 
     TextParsingOpts<Trait> po = {fr, p, nullptr, doc, linksToParse, workingPath, fileName,
         collectRefLinks, ignoreLineBreak, html, m_textPlugins};
+    po.m_textsWithLinks = textsWithLinks;
+
+    auto limits = currentLimits();
 
     if (!delims.empty()) {
         for (auto it = delims.cbegin(), last = delims.cend(); it != last; ++it) {
@@ -8394,7 +10049,8 @@ Parser<Trait>::parseFormattedTextLinksImages(MdBlock<Trait> &fr,
                     }
                 }
 
-                switch (it->m_type) {
+                // When time is over the rest of inline markup is text.
+                switch (limits && isInlineDelimiter(*it) && limits->isTimeOver() ? Delimiter::Unknown : it->m_type) {
                 case Delimiter::SquareBracketsOpen: {
                     it = checkForLink(it, last, po);
                     p->setEndColumn(fr.m_data.at(it->m_line).first.virginPos(it->m_pos + it->m_len - 1));
@@ -8420,7 +10076,7 @@ Parser<Trait>::parseFormattedTextLinksImages(MdBlock<Trait> &fr,
                 case Delimiter::Emphasis1:
                 case Delimiter::Emphasis2: {
                     if (!collectRefLinks) {
-                        it = checkForStyle(delims.cbegin(), it, last, po);
+                        it = checkForStyle(it, last, po);
                         p->setEndColumn(fr.m_data.at(it->m_line).first.virginPos(it->m_pos + it->m_len - 1));
                         p->setEndLine(fr.m_data.at(it->m_line).second.m_lineNumber);
                     }
@@ -8496,7 +10152,7 @@ Parser<Trait>::parseFormattedTextLinksImages(MdBlock<Trait> &fr,
                         h2 = false;
                     }
 
-                    p.reset(new Paragraph<Trait>);
+                    p = makeItem<Paragraph<Trait>>();
                     po.m_rawTextData.clear();
 
                     if (it->m_line + 1 < static_cast<long long int>(fr.m_data.size())) {
@@ -8552,7 +10208,7 @@ Parser<Trait>::parseFormattedTextLinksImages(MdBlock<Trait> &fr,
 
                         po.m_checkLineOnNewType = true;
 
-                        p.reset(new Paragraph<Trait>);
+                        p = makeItem<Paragraph<Trait>>();
                         po.m_rawTextData.clear();
 
                         if (it->m_line + 1 < static_cast<long long int>(fr.m_data.size())) {
@@ -8701,7 +10357,7 @@ Parser<Trait>::parseFootnote(MdBlock<Trait> &fr,
     }
 
     if (!fr.m_data.empty()) {
-        std::shared_ptr<Footnote<Trait>> f(new Footnote<Trait>);
+        auto f = makeItem<Footnote<Trait>>();
         f->setStartColumn(fr.m_data.front().first.virginPos(0));
         f->setStartLine(fr.m_data.front().second.m_lineNumber);
         f->setEndColumn(fr.m_data.back().first.virginPos(fr.m_data.back().first.length() - 1));
@@ -8776,8 +10432,17 @@ Parser<Trait>::parseBlockquote(MdBlock<Trait> &fr,
                                const typename Trait::String &workingPath,
                                const typename Trait::String &fileName,
                                bool collectRefLinks,
-                               RawHtmlBlock<Trait> &)
+                               RawHtmlBlock<Trait> &html)
 {
+    NestingScope nesting;
+
+    // Too deep blockquote is a text.
+    if (!nesting.isAllowed()) {
+        parseText(fr, parent, doc, linksToParse, workingPath, fileName, collectRefLinks, html);
+
+        return;
+    }
+
     const long long int pos = fr.m_data.front().first.asString().indexOf(Trait::latin1ToChar('>'));
     long long int extra = 0;
 
@@ -8851,7 +10516,7 @@ Parser<Trait>::parseBlockquote(MdBlock<Trait> &fr,
 
         StringListStream<Trait> stream(tmp);
 
-        std::shared_ptr<Blockquote<Trait>> bq(new Blockquote<Trait>);
+        auto bq = makeItem<Blockquote<Trait>>();
         bq->setStartColumn(fr.m_data.at(0).first.virginPos(0) - extra);
         bq->setStartLine(fr.m_data.at(0).second.m_lineNumber);
         bq->setEndColumn(fr.m_data.at(j - 1).first.virginPos(fr.m_data.at(j - 1).first.length() - 1));
@@ -8939,24 +10604,24 @@ listItemData(const typename Trait::String &s,
     if (p < 4) {
         if (s[p] == Trait::latin1ToChar('*') && space) {
             return {true, p + 2, Trait::latin1ToChar('*'),
-                p + 2 < s.size() ? !s.sliced(p + 2).simplified().isEmpty() : false};
+                skipSpaces<Trait>(p + 2, s) < s.size()};
         } else if (s[p] == Trait::latin1ToChar('-')) {
             if (isH2<Trait>(s) && wasText) {
                 return {false, p + 2, Trait::latin1ToChar('-'), false};
             } else if (space) {
                 return {true, p + 2, Trait::latin1ToChar('-'),
-                    p + 2 < s.size() ? !s.sliced(p + 2).simplified().isEmpty() : false};
+                    skipSpaces<Trait>(p + 2, s) < s.size()};
             }
         } else if (s[p] == Trait::latin1ToChar('+') && space) {
             return {true, p + 2, Trait::latin1ToChar('+'),
-                p + 2 < s.size() ? !s.sliced(p + 2).simplified().isEmpty() : false};
+                skipSpaces<Trait>(p + 2, s) < s.size()};
         } else {
             int d = 0, l = 0;
             typename Trait::Char c;
 
             if (isOrderedList<Trait>(s, &d, &l, &c)) {
                 return {true, p + l + 2, c,
-                    p + l + 2 < s.size() ? !s.sliced(p + l + 2).simplified().isEmpty() : false};
+                    skipSpaces<Trait>(p + l + 2, s) < s.size()};
             } else {
                 return {false, 0, typename Trait::Char(), false};
             }
@@ -9003,6 +10668,15 @@ Parser<Trait>::parseList(MdBlock<Trait> &fr,
                          bool collectRefLinks,
                          RawHtmlBlock<Trait> &html)
 {
+    NestingScope nesting;
+
+    // Too deep list is a text.
+    if (!nesting.isAllowed()) {
+        parseText(fr, parent, doc, linksToParse, workingPath, fileName, collectRefLinks, html);
+
+        return -1;
+    }
+
     bool resetTopParent = false;
     long long int line = -1;
 
@@ -9014,7 +10688,7 @@ Parser<Trait>::parseList(MdBlock<Trait> &fr,
     const auto p = skipSpaces<Trait>(0, fr.m_data.front().first.asString());
 
     if (p != fr.m_data.front().first.length()) {
-        std::shared_ptr<List<Trait>> list(new List<Trait>);
+        auto list = makeItem<List<Trait>>();
 
         typename MdBlock<Trait>::Data listItem;
         auto it = fr.m_data.begin();
@@ -9044,7 +10718,7 @@ Parser<Trait>::parseList(MdBlock<Trait> &fr,
 
             html.m_blocks.pop_back();
 
-            list.reset(new List<Trait>);
+            list = makeItem<List<Trait>>();
 
             html.m_blocks.push_back({list, indent});
 
@@ -9102,12 +10776,13 @@ Parser<Trait>::parseList(MdBlock<Trait> &fr,
 
             const auto ns = skipSpaces<Trait>(0, it->first.asString());
 
-            if (isH1<Trait>(it->first.asString().sliced(ns)) && ns < indent && !listItem.empty()) {
+            // Lines of nested blocks are not checked, so they are not copied on each level.
+            if (ns < indent && !listItem.empty() && isH1<Trait>(it->first.asString().sliced(ns))) {
                 const auto p = it->first.asString().indexOf(Trait::latin1ToChar('='));
 
                 it->first.insert(p, Trait::latin1ToChar('\\'));
-            } else if (isHorizontalLine<Trait>(it->first.asString().sliced(ns)) &&
-                ns < indent && !listItem.empty()) {
+            } else if (ns < indent && !listItem.empty() &&
+                isHorizontalLine<Trait>(it->first.asString().sliced(ns))) {
                 updateIndent = true;
 
                 processListItem();
@@ -9200,7 +10875,7 @@ Parser<Trait>::parseListItem(MdBlock<Trait> &fr,
 
     const auto p = skipSpaces<Trait>(0, fr.m_data.front().first.asString());
 
-    std::shared_ptr<ListItem<Trait>> item(new ListItem<Trait>);
+    auto item = makeItem<ListItem<Trait>>();
 
     item->setStartColumn(fr.m_data.front().first.virginPos(p));
     item->setStartLine(fr.m_data.front().second.m_lineNumber);
@@ -9301,11 +10976,14 @@ Parser<Trait>::parseListItem(MdBlock<Trait> &fr,
 
     auto parseStream = [&] (StringListStream<Trait> &stream)
     {
-        const auto tmpHtml = html;
+        // Stack of blocks is not copied, as it grows with count of lists and items.
+        auto topParent = std::move(html.m_topParent);
+        auto blocks = std::move(html.m_blocks);
+        auto toAdjustLastPos = std::move(html.m_toAdjustLastPos);
         html = parse(stream, item, doc, linksToParse, workingPath, fileName, collectRefLinks, false, true);
-        html.m_topParent = tmpHtml.m_topParent;
-        html.m_blocks = tmpHtml.m_blocks;
-        html.m_toAdjustLastPos = tmpHtml.m_toAdjustLastPos;
+        html.m_topParent = std::move(topParent);
+        html.m_blocks = std::move(blocks);
+        html.m_toAdjustLastPos = std::move(toAdjustLastPos);
     };
 
     for (auto last = fr.m_data.end(); it != last; ++it, ++pos) {
@@ -9551,7 +11229,8 @@ Parser<Trait>::parseCode(MdBlock<Trait> &fr,
 
             fr.m_data.erase(fr.m_data.cbegin());
 
-            {
+            // Fragment may consist of only the opening fence if the code is not finished.
+            if (!fr.m_data.empty()) {
                 const auto it = std::prev(fr.m_data.cend());
 
                 if (it->second.m_lineNumber > -1) {
@@ -9579,13 +11258,13 @@ Parser<Trait>::parseCode(MdBlock<Trait> &fr,
                 }
 
                 if (!collectRefLinks) {
-                    std::shared_ptr<Paragraph<Trait>> p(new Paragraph<Trait>);
+                    auto p = makeItem<Paragraph<Trait>>();
                     p->setStartColumn(startPos);
                     p->setStartLine(startLine);
                     p->setEndColumn(endPos);
                     p->setEndLine(endLine);
 
-                    std::shared_ptr<Math<Trait>> m(new Math<Trait>);
+                    auto m = makeItem<Math<Trait>>();
 
                     if (!fr.m_data.empty()) {
                         m->setStartColumn(fr.m_data.front().first.virginPos(0));
@@ -9653,7 +11332,7 @@ Parser<Trait>::parseCodeIndentedBySpaces(MdBlock<Trait> &fr,
             code.remove(code.length() - 1, 1);
         }
 
-        std::shared_ptr<Code<Trait>> codeItem(new Code<Trait>(code, fensedCode, false));
+        auto codeItem = makeItem<Code<Trait>>(code, fensedCode, false);
         codeItem->setSyntax(syntax);
         codeItem->setStartDelim(startDelim);
         codeItem->setEndDelim(endDelim);
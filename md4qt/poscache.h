@@ -11,6 +11,11 @@
 // C++ include.
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace MD
@@ -55,6 +60,21 @@ bool operator<(const PosRange<Trait> &l, const PosRange<Trait> &r)
             (l.m_endLine == r.m_startLine && l.m_endColumn < r.m_startColumn));
 }
 
+//! Position in text, line goes first to compare positions.
+using TextPos = std::pair<long long int, long long int>;
+
+//
+// IndexedPos
+//
+
+//! Item in flattened index of positions.
+template<class Trait>
+struct IndexedPos {
+    TextPos m_start = {-1, -1};
+    TextPos m_end = {-1, -1};
+    Item<Trait> *m_item = nullptr;
+};
+
 } /* namespace details */
 
 //
@@ -74,8 +94,14 @@ public:
     virtual void initialize(std::shared_ptr<MD::Document<Trait>> doc)
     {
         m_cache.clear();
+        m_sourceOffsets.reset();
+        m_indexValid = false;
 
         if (doc) {
+            if (!doc->isEmpty() && doc->items().front()->type() == ItemType::Anchor) {
+                m_sourceOffsets = static_cast<Anchor<Trait> *>(doc->items().front().get())->sourceOffsets();
+            }
+
             Visitor<Trait>::process(doc);
 
             for (auto it = doc->footnotesMap().cbegin(), last = doc->footnotesMap().cend(); it != last; ++it) {
@@ -105,6 +131,157 @@ public:
         return res;
     }
 
+    //! Update the cache after MD::Parser::reparse() with the same range of edited lines.
+    //! Items that were parsed again are replaced in the cache, positions of items after
+    //! the edit are shifted. If the whole document was parsed again, the cache is initialized.
+    virtual void update(
+        //! Document returned by MD::Parser::reparse().
+        std::shared_ptr<MD::Document<Trait>> doc,
+        //! First edited line.
+        long long int firstLine,
+        //! Last edited line in the text before the edit.
+        long long int lastLine,
+        //! Last edited line in the text after the edit.
+        long long int newLastLine)
+    {
+        MD_UNUSED(firstLine)
+
+        if (!doc || doc != this->m_doc) {
+            initialize(doc);
+
+            return;
+        }
+
+        if (!doc->isEmpty() && doc->items().front()->type() == ItemType::Anchor) {
+            m_sourceOffsets = static_cast<Anchor<Trait> *>(doc->items().front().get())->sourceOffsets();
+        }
+
+        std::unordered_set<Item<Trait> *> alive;
+
+        for (const auto &i : doc->items()) {
+            alive.insert(i.get());
+        }
+
+        for (auto it = doc->footnotesMap().cbegin(), last = doc->footnotesMap().cend(); it != last; ++it) {
+            alive.insert(it->second.get());
+        }
+
+        for (auto it = doc->labeledLinks().cbegin(), last = doc->labeledLinks().cend(); it != last; ++it) {
+            alive.insert(it->second.get());
+        }
+
+        std::unordered_set<Item<Trait> *> cached;
+        const long long int delta = newLastLine - lastLine;
+
+        // Kept items are either before or after the edited region, only the last ones are shifted.
+        m_cache.erase(std::remove_if(m_cache.begin(), m_cache.end(), [&](details::PosRange<Trait> &r) {
+            if (alive.find(r.m_item) == alive.cend()) {
+                return true;
+            }
+
+            cached.insert(r.m_item);
+
+            if (delta && r.m_startLine > lastLine) {
+                shiftLines(r, delta);
+            }
+
+            return false;
+        }), m_cache.end());
+
+        m_sortInCache = true;
+
+        for (long long int i = 0, count = doc->items().size(); i < count; ++i) {
+            if (cached.find(doc->items().at(i).get()) == cached.cend()) {
+                Visitor<Trait>::processItems(i, i + 1);
+            }
+        }
+
+        m_sortInCache = false;
+        m_indexValid = false;
+    }
+
+    //! \return All items, top-level and nested, that intersect the given range, ordered by
+    //! their start positions.
+    Items findAllInCache(const MD::WithPosition &range) const
+    {
+        Items res;
+
+        buildIndex();
+
+        const details::TextPos start = {range.startLine(), range.startColumn()};
+        const details::TextPos end = {range.endLine(), range.endColumn()};
+        const long long int count = std::upper_bound(m_index.cbegin(), m_index.cend(), end,
+            [](const details::TextPos &p, const details::IndexedPos<Trait> &i) { return p < i.m_start; }) -
+            m_index.cbegin();
+
+        if (count) {
+            collectIntersected(1, 0, m_indexCapacity, count, start, res);
+        }
+
+        return res;
+    }
+
+    //! \return All items, top-level and nested, that intersect the given range of lines,
+    //! ordered by their start positions.
+    Items findInLines(long long int firstLine,
+                      long long int lastLine) const
+    {
+        return findAllInCache({0, firstLine, std::numeric_limits<long long int>::max(), lastLine});
+    }
+
+    //! \return At most \p k items nearest to the given position. Items that contain the position go
+    //! first, then items before and after it. Distance is counted in lines between the position and
+    //! the item, and in columns if they are on the same line.
+    Items findNearest(const MD::WithPosition &pos,
+                      std::size_t k) const
+    {
+        auto res = findAllInCache({pos.startColumn(), pos.startLine(), pos.startColumn(), pos.startLine()});
+
+        if (res.size() >= k) {
+            res.resize(k);
+
+            return res;
+        }
+
+        const details::TextPos p = {pos.startLine(), pos.startColumn()};
+        auto after = std::upper_bound(m_index.cbegin(), m_index.cend(), p,
+            [](const details::TextPos &p, const details::IndexedPos<Trait> &i) { return p < i.m_start; });
+        auto before = std::lower_bound(m_byEnd.cbegin(), m_byEnd.cend(), p,
+            [this](long long int i, const details::TextPos &p) { return m_index[i].m_end < p; });
+
+        auto distance = [&p](const details::TextPos &other) {
+            return (other.first == p.first ? details::TextPos(0, std::abs(other.second - p.second)) :
+                                             details::TextPos(std::abs(other.first - p.first), 0));
+        };
+
+        while (res.size() < k && (after != m_index.cend() || before != m_byEnd.cbegin())) {
+            if (before != m_byEnd.cbegin() &&
+                (after == m_index.cend() ||
+                 distance(m_index[*std::prev(before)].m_end) <= distance(after->m_start))) {
+                --before;
+                res.push_back(m_index[*before].m_item);
+            } else {
+                res.push_back(after->m_item);
+                ++after;
+            }
+        }
+
+        return res;
+    }
+
+    //! \return First occurense of Markdown item with all first children by the given
+    //! byte offset in the source. Empty if byte offsets were not recorded by the parser.
+    Items findFirstInCache(long long int offset) const
+    {
+        if (!m_sourceOffsets) {
+            return {};
+        }
+
+        const auto pos = m_sourceOffsets->position(offset);
+
+        return (pos.startLine() < 0 ? Items() : findFirstInCache(pos));
+    }
+
 protected:
     details::PosRange<Trait> *findInCache(std::vector<details::PosRange<Trait>> &vec,
                                           const details::PosRange<Trait> &pos) const
@@ -148,7 +325,7 @@ protected:
             if (pos) {
                 pos->m_children.push_back(item);
             } else {
-                if (sort) {
+                if (sort || m_sortInCache) {
                     const auto it = std::upper_bound(m_cache.begin(), m_cache.end(), item);
 
                     if (it != m_cache.end()) {
@@ -163,6 +340,96 @@ protected:
         }
     }
 
+    static void shiftLines(details::PosRange<Trait> &r,
+                           long long int delta)
+    {
+        r.m_startLine += delta;
+        r.m_endLine += delta;
+
+        for (auto &c : r.m_children) {
+            shiftLines(c, delta);
+        }
+    }
+
+    //! Build flattened index of the cache if it's not valid.
+    void buildIndex() const
+    {
+        if (m_indexValid) {
+            return;
+        }
+
+        m_index.clear();
+
+        std::vector<const std::vector<details::PosRange<Trait>> *> stack = {&m_cache};
+
+        // All levels of the cache are put in one array, it's sorted by start positions then.
+        while (!stack.empty()) {
+            const auto level = stack.back();
+            stack.pop_back();
+
+            for (const auto &r : *level) {
+                m_index.push_back({{r.m_startLine, r.m_startColumn}, {r.m_endLine, r.m_endColumn}, r.m_item});
+
+                if (!r.m_children.empty()) {
+                    stack.push_back(&r.m_children);
+                }
+            }
+        }
+
+        std::stable_sort(m_index.begin(), m_index.end(), [](const auto &l, const auto &r) {
+            return l.m_start < r.m_start;
+        });
+
+        // Implicit binary tree over the array with maximum end positions of subtrees.
+        m_indexCapacity = 1;
+
+        while (m_indexCapacity < static_cast<long long int>(m_index.size())) {
+            m_indexCapacity *= 2;
+        }
+
+        m_maxEnd.assign(2 * m_indexCapacity, {-1, -1});
+
+        for (long long int i = 0, count = m_index.size(); i < count; ++i) {
+            m_maxEnd[m_indexCapacity + i] = m_index[i].m_end;
+        }
+
+        for (long long int i = m_indexCapacity - 1; i > 0; --i) {
+            m_maxEnd[i] = std::max(m_maxEnd[2 * i], m_maxEnd[2 * i + 1]);
+        }
+
+        m_byEnd.resize(m_index.size());
+        std::iota(m_byEnd.begin(), m_byEnd.end(), 0);
+        // Items with the same end go from nested to outer, as they are walked backward.
+        std::stable_sort(m_byEnd.begin(), m_byEnd.end(), [this](long long int l, long long int r) {
+            return (m_index[l].m_end < m_index[r].m_end || (m_index[l].m_end == m_index[r].m_end && l > r));
+        });
+
+        m_indexValid = true;
+    }
+
+    //! Collect items in [first, last) node of the index, with index less than \p count,
+    //! and with end not before \p start.
+    void collectIntersected(long long int node,
+                            long long int first,
+                            long long int last,
+                            long long int count,
+                            const details::TextPos &start,
+                            Items &res) const
+    {
+        if (first >= count || m_maxEnd[node] < start) {
+            return;
+        }
+
+        if (last - first == 1) {
+            res.push_back(m_index[first].m_item);
+        } else {
+            const auto middle = first + (last - first) / 2;
+
+            collectIntersected(2 * node, first, middle, count, start, res);
+            collectIntersected(2 * node + 1, middle, last, count, start, res);
+        }
+    }
+
 protected:
     void onUserDefined(Item<Trait> *i) override
     {
@@ -451,6 +718,20 @@ protected:
     std::vector<details::PosRange<Trait>> m_cache;
     //! Skip adding in cache.
     bool m_skipInCache = false;
+    //! Insert top-level items in sorted order.
+    bool m_sortInCache = false;
+    //! Byte offsets of lines of the document.
+    std::shared_ptr<const SourceOffsets> m_sourceOffsets;
+    //! Flattened cache sorted by start positions, it's built on the first query that needs it.
+    mutable std::vector<details::IndexedPos<Trait>> m_index;
+    //! Implicit binary tree over m_index with maximum end positions, the root is at 1.
+    mutable std::vector<details::TextPos> m_maxEnd;
+    //! Count of leaves in the implicit binary tree.
+    mutable long long int m_indexCapacity = 1;
+    //! Indexes of items in m_index sorted by end positions.
+    mutable std::vector<long long int> m_byEnd;
+    //! Whether m_index is built for the current cache.
+    mutable bool m_indexValid = false;
 }; // class PosCache
 
 } /* namespace MD */
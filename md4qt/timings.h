@@ -0,0 +1,196 @@
+/*
+    SPDX-FileCopyrightText: 2022-2024 Igor Mironchik <igor.mironchik@gmail.com>
+    SPDX-License-Identifier: MIT
+*/
+
+#ifndef MD4QT_MD_TIMINGS_H_INCLUDED
+#define MD4QT_MD_TIMINGS_H_INCLUDED
+
+// md4qt include.
+#include "utils.h"
+
+// C++ include.
+#include <atomic>
+#include <chrono>
+
+namespace MD
+{
+
+//! Phase of parsing.
+enum class ParsingPhase : int {
+    //! Reading of lines of files and streams.
+    Reading = 0,
+    //! Splitting of text into blocks, parsing of blocks and everything else
+    //! that is not accounted to other phases.
+    Blocks,
+    //! Parsing of inline text, emphases, links and images.
+    Inlines,
+    //! Optimization of paragraphs.
+    ParagraphOptimization,
+    //! Count of phases.
+    PhasesCount
+}; // enum class ParsingPhase
+
+//
+// PhaseTimings
+//
+
+//! Time spent in phases of parsing. Time of a nested phase is not accounted
+//! to the outer one. With more than one thread time of all threads is summed.
+class PhaseTimings final
+{
+public:
+    PhaseTimings()
+    {
+        clear();
+    }
+
+    ~PhaseTimings() = default;
+
+    //! \return Time spent in the phase.
+    std::chrono::nanoseconds time(ParsingPhase p) const
+    {
+        return std::chrono::nanoseconds(m_times[static_cast<int>(p)].load(std::memory_order_relaxed));
+    }
+
+    //! \return Time spent in all phases.
+    std::chrono::nanoseconds total() const
+    {
+        std::chrono::nanoseconds res(0);
+
+        for (int i = 0; i < static_cast<int>(ParsingPhase::PhasesCount); ++i) {
+            res += time(static_cast<ParsingPhase>(i));
+        }
+
+        return res;
+    }
+
+    //! Add time to the phase.
+    void add(ParsingPhase p, std::chrono::nanoseconds t)
+    {
+        m_times[static_cast<int>(p)].fetch_add(t.count(), std::memory_order_relaxed);
+    }
+
+    //! Reset all times to zero.
+    void clear()
+    {
+        for (auto &t : m_times) {
+            t.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    MD_DISABLE_COPY(PhaseTimings)
+
+    //! Times of phases in nanoseconds.
+    std::atomic<long long int> m_times[static_cast<int>(ParsingPhase::PhasesCount)];
+}; // class PhaseTimings
+
+namespace details
+{
+
+//! Phase that is measured in the current thread.
+struct CurrentPhase {
+    //! Phase, PhasesCount if nothing is measured.
+    ParsingPhase m_phase = ParsingPhase::PhasesCount;
+    //! Start of the measurement.
+    std::chrono::steady_clock::time_point m_start = {};
+}; // struct CurrentPhase
+
+inline CurrentPhase &currentPhase()
+{
+    static thread_local CurrentPhase phase;
+
+    return phase;
+}
+
+} /* namespace details */
+
+//! \return Timings where phases of parsing in the current thread are accounted, may be null.
+inline PhaseTimings *&currentPhaseTimings()
+{
+    static thread_local PhaseTimings *timings = nullptr;
+
+    return timings;
+}
+
+//
+// PhaseTimingsScope
+//
+
+//! Set timings where phases of parsing in the current thread are accounted
+//! for the lifetime of the scope. Null timings switch measurement off.
+class PhaseTimingsScope final
+{
+public:
+    explicit PhaseTimingsScope(PhaseTimings *timings)
+        : m_prev(currentPhaseTimings())
+        , m_prevPhase(details::currentPhase().m_phase)
+    {
+        // Measurement of the outer phase is paused.
+        if (m_prev && m_prevPhase != ParsingPhase::PhasesCount) {
+            m_prev->add(m_prevPhase, std::chrono::steady_clock::now() - details::currentPhase().m_start);
+        }
+
+        currentPhaseTimings() = timings;
+        details::currentPhase() = {};
+    }
+
+    ~PhaseTimingsScope()
+    {
+        currentPhaseTimings() = m_prev;
+        details::currentPhase() = {m_prevPhase, std::chrono::steady_clock::now()};
+    }
+
+private:
+    MD_DISABLE_COPY(PhaseTimingsScope)
+
+    PhaseTimings *m_prev = nullptr;
+    ParsingPhase m_prevPhase = ParsingPhase::PhasesCount;
+}; // class PhaseTimingsScope
+
+//
+// PhaseScope
+//
+
+//! Account time of the scope to the given phase, if timings are set for the current thread.
+class PhaseScope final
+{
+public:
+    explicit PhaseScope(ParsingPhase p)
+        : m_timings(currentPhaseTimings())
+    {
+        if (m_timings) {
+            auto &current = details::currentPhase();
+            const auto now = std::chrono::steady_clock::now();
+
+            if (current.m_phase != ParsingPhase::PhasesCount) {
+                m_timings->add(current.m_phase, now - current.m_start);
+            }
+
+            m_prev = current.m_phase;
+            current = {p, now};
+        }
+    }
+
+    ~PhaseScope()
+    {
+        if (m_timings) {
+            auto &current = details::currentPhase();
+            const auto now = std::chrono::steady_clock::now();
+
+            m_timings->add(current.m_phase, now - current.m_start);
+            current = {m_prev, now};
+        }
+    }
+
+private:
+    MD_DISABLE_COPY(PhaseScope)
+
+    PhaseTimings *m_timings = nullptr;
+    ParsingPhase m_prev = ParsingPhase::PhasesCount;
+}; // class PhaseScope
+
+} /* namespace MD */
+
+#endif // MD4QT_MD_TIMINGS_H_INCLUDED
@@ -6,17 +6,22 @@
 #ifndef MD4QT_MD_TRAITS_HPP_INCLUDED
 #define MD4QT_MD_TRAITS_HPP_INCLUDED
 
-#ifdef MD4QT_ICU_STL_SUPPORT
-
 // C++ include.
 #include <algorithm>
-#include <cctype>
-#include <filesystem>
+#include <atomic>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#ifdef MD4QT_ICU_STL_SUPPORT
+
+// C++ include.
+#include <cctype>
+#include <filesystem>
+
 // ICU include.
 #include <unicode/uchar.h>
 #include <unicode/unistr.h>
@@ -28,14 +33,6 @@
 
 #ifdef MD4QT_QT_SUPPORT
 
-#ifndef MD4QT_ICU_STL_SUPPORT
-
-// C++ include.
-#include <map>
-#include <memory>
-
-#endif // MD4QT_ICU_STL_SUPPORT
-
 // Qt include.
 #include <QFileInfo>
 #include <QString>
@@ -123,11 +120,30 @@ public:
 
     long long int virginPos(long long int pos) const
     {
-        for (auto it = m_changedPos.crbegin(), last = m_changedPos.crend(); it != last; ++it) {
-            pos = virginPosImpl(pos, *it);
+        if (!m_changedPos) {
+            return pos;
         }
 
-        return pos;
+        const auto map = m_virginPositions.load();
+
+        if (map) {
+            const auto &vp = *map;
+
+            if (pos >= 0 && pos <= vp.m_lastPos) {
+                const auto it = std::prev(std::upper_bound(vp.m_runs.cbegin(), vp.m_runs.cend(), pos,
+                    [](long long int p, const auto &r) { return p < r.m_pos; }));
+
+                return it->m_virginPos + (it->m_sequential ? pos - it->m_pos : 0);
+            }
+        } else if (m_virginPositions.countCall() > m_str.length()) {
+            // History of changes is walked for each call, once it was walked as many times
+            // as building of the map costs, the map is built.
+            m_virginPositions.store(buildVirginPositions());
+
+            return virginPos(pos);
+        }
+
+        return virginPosFromHistory(pos);
     }
 
     Char operator[](long long int position) const
@@ -143,8 +159,7 @@ public:
         m_str.insert(pos, with);
 
         if (with.length() != size) {
-            m_changedPos.push_back({{0, len}, {}});
-            m_changedPos.back().second.push_back({pos, size, with.size()});
+            pushChanges({0, len}, {{pos, size, with.size()}});
         }
 
         return *this;
@@ -152,8 +167,12 @@ public:
 
     InternalStringT &replace(const String &what, const String &with)
     {
+        if (m_str.indexOf(what) == -1) {
+            return *this;
+        }
+
         String tmp;
-        bool init = false;
+        std::vector<ChangedPos> changes;
         const auto len = m_str.length();
 
         for (long long int i = 0; i < m_str.size();) {
@@ -166,12 +185,7 @@ public:
                 i = p + what.size();
 
                 if (what.size() != with.size()) {
-                    if (!init) {
-                        m_changedPos.push_back({{0, len}, {}});
-                        init = true;
-                    }
-
-                    m_changedPos.back().second.push_back({p, what.size(), with.size()});
+                    changes.push_back({p, what.size(), with.size()});
                 }
             } else {
                 tmp.push_back(m_str.sliced(i));
@@ -182,6 +196,10 @@ public:
 
         std::swap(m_str, tmp);
 
+        if (!changes.empty()) {
+            pushChanges({0, len}, std::move(changes));
+        }
+
         return *this;
     }
 
@@ -191,8 +209,7 @@ public:
 
         m_str.remove(pos, size);
 
-        m_changedPos.push_back({{0, len}, {}});
-        m_changedPos.back().second.push_back({pos, size, 0});
+        pushChanges({0, len}, {{pos, size, 0}});
 
         return *this;
     }
@@ -217,6 +234,7 @@ public:
         InternalStringT result = *this;
         result.m_str.clear();
         long long int i = 0;
+        std::vector<ChangedPos> changes;
         bool init = false;
         bool first = true;
         long long int spaces = 0;
@@ -231,13 +249,10 @@ public:
             spaces = i - tmp;
 
             if (i != tmp) {
-                if (!init) {
-                    result.m_changedPos.push_back({{0, len}, {}});
-                    init = true;
-                }
+                init = true;
 
                 if (i - tmp > 1 || first) {
-                    result.m_changedPos.back().second.push_back({tmp, i - tmp, (first ? 0 : 1)});
+                    changes.push_back({tmp, i - tmp, (first ? 0 : 1)});
                 }
             }
 
@@ -259,12 +274,16 @@ public:
             result.m_str.remove(result.length() - 1, 1);
 
             if (spaces > 1) {
-                result.m_changedPos.back().second.back().m_len = 0;
+                changes.back().m_len = 0;
             } else if (spaces == 1) {
-                result.m_changedPos.back().second.push_back({m_str.length() - spaces, spaces, 0});
+                changes.push_back({m_str.length() - spaces, spaces, 0});
             }
         }
 
+        if (init) {
+            result.pushChanges({0, len}, std::move(changes));
+        }
+
         return result;
     }
 
@@ -277,7 +296,7 @@ public:
             for (long long int i = 0; i < m_str.length(); ++i) {
                 auto is = *this;
                 is.m_str = m_str[i];
-                is.m_changedPos.push_back({{i, len}, {}});
+                is.pushChanges({i, len}, {});
 
                 result.push_back(is);
             }
@@ -292,7 +311,7 @@ public:
             if (fpos - pos > 0) {
                 auto is = *this;
                 is.m_str = m_str.sliced(pos, fpos - pos);
-                is.m_changedPos.push_back({{pos, len}, {}});
+                is.pushChanges({pos, len}, {});
 
                 result.push_back(is);
             }
@@ -303,7 +322,7 @@ public:
         if (pos < m_str.length()) {
             auto is = *this;
             is.m_str = m_str.sliced(pos, m_str.length() - pos);
-            is.m_changedPos.push_back({{pos, len}, {}});
+            is.pushChanges({pos, len}, {});
 
             result.push_back(is);
         }
@@ -316,10 +335,11 @@ public:
         InternalStringT tmp = *this;
         const auto oldLen = m_str.length();
         tmp.m_str = tmp.m_str.sliced(pos, (len == -1 ? tmp.m_str.length() - pos : len));
-        tmp.m_changedPos.push_back({{pos, oldLen}, {}});
+        std::vector<ChangedPos> changes;
         if (len != -1 && len < length() - pos) {
-            tmp.m_changedPos.back().second.push_back({pos + len, length() - pos - len, 0});
+            changes.push_back({pos + len, length() - pos - len, 0});
         }
+        tmp.pushChanges({pos, oldLen}, std::move(changes));
 
         return tmp;
     }
@@ -329,7 +349,7 @@ public:
         InternalStringT tmp = *this;
         const auto len = m_str.length();
         tmp.m_str = tmp.m_str.right(n);
-        tmp.m_changedPos.push_back({{length() - n, len}, {}});
+        tmp.pushChanges({length() - n, len}, {});
 
         return tmp;
     }
@@ -346,8 +366,7 @@ public:
 
         m_str.insert(pos, s);
 
-        m_changedPos.push_back({{0, len}, {}});
-        m_changedPos.back().second.push_back({pos, 1, ilen + 1});
+        pushChanges({0, len}, {{pos, 1, ilen + 1}});
 
         return *this;
     }
@@ -367,22 +386,149 @@ private:
         long long int m_length = 0;
     };
 
-    std::vector<std::pair<LengthAndStartPos, std::vector<ChangedPos>>> m_changedPos;
+    //! Layer of history of changes. Layers are immutable and shared between copies of the string.
+    struct Layer {
+        LengthAndStartPos m_start;
+        std::vector<ChangedPos> m_changes;
+        //! Previous layer, null for the first one.
+        std::shared_ptr<const Layer> m_prev;
+    };
+
+    //! Last layer of history of changes, null if the string was not changed.
+    std::shared_ptr<const Layer> m_changedPos;
+
+    //! Virgin positions compacted into runs of positions.
+    struct VirginPositions {
+        //! Run of positions that are mapped to sequential virgin positions, or to one position.
+        struct Run {
+            long long int m_pos = 0;
+            long long int m_virginPos = 0;
+            bool m_sequential = true;
+        };
+
+        //! Runs sorted by position.
+        std::vector<Run> m_runs;
+        //! Last position in the runs.
+        long long int m_lastPos = -1;
+    };
+
+    //! Lazily built map of virgin positions. The map is immutable once built and shared
+    //! between copies of the string. It's built in const methods, so it's accessed atomically
+    //! to allow concurrent reading of the string from several threads.
+    class LazyVirginPositions {
+    public:
+        LazyVirginPositions() = default;
+        LazyVirginPositions(const LazyVirginPositions &other)
+            : m_map(other.load())
+            , m_calls(other.m_calls.load(std::memory_order_relaxed))
+        {
+        }
+        LazyVirginPositions &operator=(const LazyVirginPositions &other)
+        {
+            if (this != &other) {
+                store(other.load());
+                m_calls.store(other.m_calls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+
+            return *this;
+        }
+
+        std::shared_ptr<const VirginPositions> load() const
+        {
+            return std::atomic_load(&m_map);
+        }
+
+        //! Concurrent builders create equal maps, so the last stored one wins.
+        void store(std::shared_ptr<const VirginPositions> map)
+        {
+            std::atomic_store(&m_map, std::move(map));
+        }
+
+        //! \return Count of calls of virginPos() with the current history, including this one.
+        long long int countCall()
+        {
+            return m_calls.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        void reset()
+        {
+            store({});
+            m_calls.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        std::shared_ptr<const VirginPositions> m_map;
+        std::atomic<long long int> m_calls = {0};
+    }; // class LazyVirginPositions
+
+    mutable LazyVirginPositions m_virginPositions;
 
 private:
+    long long int virginPosFromHistory(long long int pos) const
+    {
+        for (auto layer = m_changedPos.get(); layer; layer = layer->m_prev.get()) {
+            pos = virginPosImpl(pos, *layer);
+        }
+
+        return pos;
+    }
+
+    void pushChanges(const LengthAndStartPos &start,
+                     std::vector<ChangedPos> changes)
+    {
+        // Consecutive cuts of the beginning, like stripping of prefixes of nested blockquotes
+        // and lists, are merged into one offset, so the history doesn't grow with nesting.
+        if (changes.empty() && m_changedPos && m_changedPos->m_changes.empty()) {
+            m_changedPos = std::make_shared<const Layer>(Layer{
+                {m_changedPos->m_start.m_firstPos + start.m_firstPos, m_changedPos->m_start.m_length},
+                {}, m_changedPos->m_prev});
+        } else {
+            m_changedPos = std::make_shared<const Layer>(Layer{start, std::move(changes), std::move(m_changedPos)});
+        }
+
+        m_virginPositions.reset();
+    }
+
+    std::shared_ptr<const VirginPositions> buildVirginPositions() const
+    {
+        auto map = std::make_shared<VirginPositions>();
+        auto &vp = *map;
+        vp.m_lastPos = m_str.length();
+
+        for (long long int pos = 0; pos <= vp.m_lastPos; ++pos) {
+            const auto virgin = virginPosFromHistory(pos);
+
+            if (!vp.m_runs.empty()) {
+                auto &r = vp.m_runs.back();
+
+                if (pos - r.m_pos == 1 && (virgin == r.m_virginPos + 1 || virgin == r.m_virginPos)) {
+                    r.m_sequential = (virgin != r.m_virginPos);
+
+                    continue;
+                } else if (virgin == r.m_virginPos + (r.m_sequential ? pos - r.m_pos : 0)) {
+                    continue;
+                }
+            }
+
+            vp.m_runs.push_back({pos, virgin, true});
+        }
+
+        return map;
+    }
+
     long long int virginPosImpl(long long int pos,
-                                const std::pair<LengthAndStartPos, std::vector<ChangedPos>> &changed) const
+                                const Layer &changed) const
     {
         long long int p = 0;
 
-        for (const auto &c : changed.second) {
+        for (const auto &c : changed.m_changes) {
             if (c.m_pos + std::min(c.m_oldLen, c.m_len) <= pos + p) {
                 if (c.m_oldLen < c.m_len) {
                     if (c.m_len - c.m_oldLen >= pos) {
                         p -= pos;
-                    } else if (c.m_pos - p + changed.first.m_firstPos > changed.first.m_length) {
-                        p -= (pos + p + changed.first.m_firstPos - changed.first.m_length +
-                             (pos >= changed.first.m_length - p + (c.m_len - c.m_oldLen) ? 0 : 1));
+                    } else if (c.m_pos - p + changed.m_start.m_firstPos > changed.m_start.m_length) {
+                        p -= (pos + p + changed.m_start.m_firstPos - changed.m_start.m_length +
+                             (pos >= changed.m_start.m_length - p + (c.m_len - c.m_oldLen) ? 0 : 1));
                     } else {
                         const auto tmp = c.m_len - c.m_oldLen;
 
@@ -396,21 +542,27 @@ private:
             }
         }
 
-        return pos + p + changed.first.m_firstPos;
+        return pos + p + changed.m_start.m_firstPos;
     }
 
     long long int countOfSpacesForTab(long long int virginPos) const
     {
+        std::vector<const Layer *> layers;
+
+        for (auto layer = m_changedPos.get(); layer; layer = layer->m_prev.get()) {
+            layers.push_back(layer);
+        }
+
         long long int p = 0;
 
-        for (const auto &v : std::as_const(m_changedPos)) {
-            p += v.first.m_firstPos;
+        for (auto it = layers.crbegin(), last = layers.crend(); it != last; ++it) {
+            p += (*it)->m_start.m_firstPos;
 
             if (virginPos < p) {
                 break;
             }
 
-            for (const auto &c : std::as_const(v.second)) {
+            for (const auto &c : std::as_const((*it)->m_changes)) {
                 if (c.m_pos + p == virginPos) {
                     return c.m_len;
                 }
@@ -880,6 +1032,14 @@ struct UnicodeStringTrait {
 
     using Url = UrlUri;
 
+    //! Hash function for unordered containers.
+    struct StringHash {
+        std::size_t operator()(const String &s) const
+        {
+            return static_cast<std::size_t>(s.hashCode());
+        }
+    };
+
     //! \return Is Unicode whitespace?
     static bool isUnicodeWhitespace(const UnicodeChar &ch)
     {
@@ -900,6 +1060,12 @@ struct UnicodeStringTrait {
         return UnicodeString(u16);
     }
 
+    //! \return UTF-16 code units of the string.
+    static const char16_t *utf16(const String &s)
+    {
+        return s.getBuffer();
+    }
+
     //! Convert Latin1 into trait's string.
     static String latin1ToString(const char *latin1)
     {
@@ -918,6 +1084,12 @@ struct UnicodeStringTrait {
         return UnicodeString(utf8);
     }
 
+    //! Append string to UTF8 string.
+    static void appendUtf8(std::string &utf8, const String &str)
+    {
+        str.toUTF8String(utf8);
+    }
+
     //! \return Does file exist.
     static bool fileExists(const String &fileName, const String &workingPath)
     {
@@ -994,6 +1166,14 @@ struct QStringTrait {
 
     using Url = QUrl;
 
+    //! Hash function for unordered containers.
+    struct StringHash {
+        std::size_t operator()(const String &s) const
+        {
+            return qHash(s);
+        }
+    };
+
     //! \return Is Unicode whitespace?
     static bool isUnicodeWhitespace(const QChar &ch)
     {
@@ -1014,6 +1194,12 @@ struct QStringTrait {
         return QString::fromUtf16(u16);
     }
 
+    //! \return UTF-16 code units of the string.
+    static const char16_t *utf16(const String &s)
+    {
+        return reinterpret_cast<const char16_t *>(s.utf16());
+    }
+
     //! Convert Latin1 into trait's string.
     static String latin1ToString(const char *latin1)
     {
@@ -1032,6 +1218,14 @@ struct QStringTrait {
         return QString::fromUtf8(utf8, -1);
     }
 
+    //! Append string to UTF8 string.
+    static void appendUtf8(std::string &utf8, const String &str)
+    {
+        const auto tmp = str.toUtf8();
+
+        utf8.append(tmp.constData(), tmp.size());
+    }
+
     //! \return Does file exist.
     static bool fileExists(const String &fileName, const String &workingPath)
     {
@@ -11,7 +11,9 @@
 #include "utils.h"
 
 // C++ include.
+#include <iterator>
 #include <string>
+#include <unordered_set>
 #include <utility>
 
 namespace MD
@@ -30,6 +32,15 @@ public:
     virtual ~Visitor() = default;
 
     void process(std::shared_ptr<Document<Trait>> d)
+    {
+        setDocument(d);
+
+        processItems(0, static_cast<long long int>(m_doc->items().size()));
+    }
+
+protected:
+    //! Set document to walk through and collect its anchors.
+    void setDocument(std::shared_ptr<Document<Trait>> d)
     {
         m_anchors.clear();
         m_doc = d;
@@ -37,15 +48,20 @@ public:
         for (auto it = m_doc->items().cbegin(), last = m_doc->items().cend(); it != last; ++it) {
             switch ((*it)->type()) {
             case ItemType::Anchor:
-                m_anchors.push_back(static_cast<Anchor<Trait> *>(it->get())->label());
+                m_anchors.insert(static_cast<Anchor<Trait> *>(it->get())->label());
                 break;
 
             default:
                 break;
             }
         }
+    }
 
-        for (auto it = m_doc->items().cbegin(), last = m_doc->items().cend(); it != last; ++it) {
+    //! Walk through top-level items of the document in the range [first, last).
+    void processItems(long long int first, long long int last)
+    {
+        for (auto it = std::next(m_doc->items().cbegin(), first), end = std::next(m_doc->items().cbegin(), last);
+             it != end; ++it) {
             if (static_cast<int>((*it)->type()) >= static_cast<int>(ItemType::UserDefined)) {
                 onUserDefined(it->get());
             } else {
@@ -90,10 +106,19 @@ public:
                     break;
                 }
             }
+
+            onTopLevelItemProcessed(it->get());
         }
     }
 
-protected:
+    //! Invoked after processing of each top-level item of the document.
+    virtual void onTopLevelItemProcessed(
+        //! Item.
+        Item<Trait> *item)
+    {
+        MD_UNUSED(item)
+    }
+
     //! For some generator it's important to keep line endings like they were in Markdown.
     //! So onParagraph() method invokes this method when necessary to add line ending.
     virtual void onAddLineEnding() = 0;
@@ -416,7 +441,7 @@ protected:
 
 protected:
     //! All available m_anchors in the document.
-    typename Trait::template Vector<typename Trait::String> m_anchors;
+    std::unordered_set<typename Trait::String, typename Trait::StringHash> m_anchors;
     //! Document.
     std::shared_ptr<Document<Trait>> m_doc;
 }; // class Visitor
@@ -8,6 +8,9 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 
+// C++ include.
+#include <sstream>
+
 typename TRAIT::String fullPath(int num)
 {
     typename TRAIT::String wd =
@@ -430,3 +433,257 @@ TEST_CASE("019")
         "</li>\n</ul>\n</li>\n<li>\n Very easy! </li>\n</ul>\n");
     REQUIRE(html == required);
 }
+
+TEST_CASE("020")
+{
+    std::string content;
+
+    for (int i = 0; i < 1000; ++i) {
+        const auto n = std::to_string(i);
+
+        content.append("# Heading " + n + "\n\nText *\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82* with footnote[^" + n
+                       + "] and [link](#heading-" + n + ").\n\n| a | b |\n|---|---|\n| " + n + " | `code` |\n\n[^" + n + "]: Footnote " + n + ".\n\n");
+    }
+
+    MD::Parser<TRAIT> parser;
+
+#ifdef MD4QT_QT_SUPPORT
+    QTextStream stream(QByteArray::fromStdString(content));
+#else
+    std::istringstream stream(content);
+#endif
+
+    const auto doc = parser.parse(stream, TRAIT::latin1ToString("tests/html/data"), TRAIT::latin1ToString("020.md"));
+
+    for (int flags = 0; flags < 8; ++flags) {
+        const bool wrapInBody = flags & 1;
+        const bool wrapInArticle = flags & 2;
+        const auto backRef = (flags & 4 ? TRAIT::latin1ToString("back.png") : typename TRAIT::String());
+
+        std::string expected;
+        TRAIT::appendUtf8(expected, MD::toHtml(doc, wrapInBody, backRef, wrapInArticle));
+
+        std::string html;
+        int chunks = 0;
+
+        MD::HtmlCallbackSink sink([&html, &chunks](const char *data, long long int size) {
+            html.append(data, size);
+            ++chunks;
+        });
+
+        MD::toHtml(doc, sink, wrapInBody, backRef, wrapInArticle);
+
+        REQUIRE(html == expected);
+        REQUIRE(chunks > 10);
+
+        std::ostringstream out;
+        MD::HtmlStreamSink streamSink(out);
+
+        MD::toHtml(doc, streamSink, wrapInBody, backRef, wrapInArticle);
+
+        REQUIRE(out.str() == expected);
+    }
+}
+
+TEST_CASE("021")
+{
+    const auto reference = [](const typename TRAIT::String &t) {
+        auto tmp = t;
+        tmp.replace(TRAIT::latin1ToChar('&'), TRAIT::latin1ToString("&amp;"));
+        tmp.replace(TRAIT::latin1ToChar('<'), TRAIT::latin1ToString("&lt;"));
+        tmp.replace(TRAIT::latin1ToChar('>'), TRAIT::latin1ToString("&gt;"));
+
+        return tmp;
+    };
+
+    REQUIRE(MD::details::prepareTextForHtml<TRAIT>({}) == typename TRAIT::String());
+    REQUIRE(MD::details::prepareTextForHtml<TRAIT>(TRAIT::latin1ToString("&<>"))
+            == TRAIT::latin1ToString("&amp;&lt;&gt;"));
+
+    const auto clean = TRAIT::utf8ToString(u8"Текст без специальных символов, long enough to be checked in blocks.");
+    REQUIRE(MD::details::prepareTextForHtml<TRAIT>(clean) == clean);
+
+    // Special characters on every position around boundaries of blocks.
+    for (int length = 1; length <= 40; ++length) {
+        for (int pos = 0; pos < length; ++pos) {
+            for (const char c : {'&', '<', '>'}) {
+                typename TRAIT::String text;
+
+                for (int i = 0; i < length; ++i) {
+                    if (i == pos || i == length - 1 - pos / 2) {
+                        text.push_back(TRAIT::latin1ToChar(c));
+                    } else {
+                        text.push_back(i % 3 ? TRAIT::latin1ToString("a") : TRAIT::utf8ToString(u8"ж"));
+                    }
+                }
+
+                REQUIRE(MD::details::prepareTextForHtml<TRAIT>(text) == reference(text));
+            }
+        }
+    }
+}
+
+TEST_CASE("022")
+{
+    static const int count = 2000;
+
+    std::string content;
+
+    for (int i = 0; i < count; ++i) {
+        content.append("Text[^" + std::to_string(i) + "] and again[^" + std::to_string(i) + "].\n\n");
+    }
+
+    for (int i = 0; i <= count; ++i) {
+        content.append("[^" + std::to_string(i) + "]: Footnote");
+
+        if (i < count) {
+            content.append(" with reference[^" + std::to_string(i + 1) + "]");
+        }
+
+        content.append(".\n\n");
+    }
+
+    MD::Parser<TRAIT> parser;
+
+#ifdef MD4QT_QT_SUPPORT
+    QTextStream stream(QByteArray::fromStdString(content));
+#else
+    std::istringstream stream(content);
+#endif
+
+    const auto doc = parser.parse(stream, TRAIT::latin1ToString("tests/html/data"), TRAIT::latin1ToString("022.md"));
+
+    std::string html;
+    TRAIT::appendUtf8(html, MD::toHtml(doc, false, TRAIT::latin1ToString("back.png"), false));
+
+    const auto countOf = [&html](const std::string &what) {
+        long long int res = 0;
+
+        for (auto pos = html.find(what); pos != std::string::npos; pos = html.find(what, pos + what.size())) {
+            ++res;
+        }
+
+        return res;
+    };
+
+    REQUIRE(countOf("<li id=") == count + 1);
+    REQUIRE(countOf("<img src=\"back.png\" />") == 2 + 3 * (count - 1) + 1);
+    REQUIRE(countOf("<img src=\"back.png\" /></a></p></li>") == count + 1);
+    REQUIRE(html.find(">2001</a></sup>. <a href=\"#ref-#^1999/") != std::string::npos);
+}
+
+TEST_CASE("023")
+{
+    std::string content;
+
+    for (int i = 0; i < 500; ++i) {
+        const auto n = std::to_string(i);
+
+        content.append("# Heading " + n + "\n\nText with footnotes[^" + n + "][^" + std::to_string(i / 7)
+                       + "] and [link](#heading-" + n + ").\n\n* item[^" + std::to_string(i / 3) + "]\n\n| a | b |\n|---|---|\n| "
+                       + n + " | `code` |\n\n[^" + n + "]: Footnote " + n + " refers[^" + std::to_string((i + 1) % 500)
+                       + "].\n\n");
+    }
+
+    MD::Parser<TRAIT> parser;
+
+#ifdef MD4QT_QT_SUPPORT
+    QTextStream stream(QByteArray::fromStdString(content));
+#else
+    std::istringstream stream(content);
+#endif
+
+    const auto doc = parser.parse(stream, TRAIT::latin1ToString("tests/html/data"), TRAIT::latin1ToString("023.md"));
+
+    for (const auto &backRef : {typename TRAIT::String(), TRAIT::latin1ToString("back.png")}) {
+        const auto expected = MD::toHtml(doc, true, backRef, true);
+
+        for (unsigned int threads : {0u, 2u, 3u, 8u}) {
+            REQUIRE(MD::toHtml(doc, true, backRef, true, threads) == expected);
+        }
+    }
+}
+
+TEST_CASE("024")
+{
+    std::vector<std::string> lines;
+
+    for (int i = 0; i < 50; ++i) {
+        const auto n = std::to_string(i);
+
+        lines.push_back("## Heading " + n);
+        lines.push_back("");
+        lines.push_back("Paragraph " + n + " with [link](#heading-" + std::to_string(49 - i) + ")"
+                        + (i % 5 ? std::string() : "[^" + std::to_string(i / 10) + "]") + ".");
+        lines.push_back("");
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        lines.push_back("[^" + std::to_string(i) + "]: Footnote " + std::to_string(i) + ".");
+        lines.push_back("");
+    }
+
+    MD::Parser<TRAIT> parser;
+    MD::HtmlCache<TRAIT> cache;
+
+    auto parse = [&lines](const std::function<std::shared_ptr<MD::Document<TRAIT>>(TRAIT::TextStream &)> &f) {
+        std::string content;
+
+        for (const auto &l : lines) {
+            content.append(l);
+            content.push_back('\n');
+        }
+
+#ifdef MD4QT_QT_SUPPORT
+        QTextStream stream(QByteArray::fromStdString(content));
+#else
+        std::istringstream stream(content);
+#endif
+
+        return f(stream);
+    };
+
+    auto doc = parse([&parser](TRAIT::TextStream &stream) {
+        return parser.parse(stream, TRAIT::latin1ToString("tests/html/data"), TRAIT::latin1ToString("024.md"));
+    });
+
+    const auto backRef = TRAIT::latin1ToString("back.png");
+
+    REQUIRE(cache.toHtml(doc, true, backRef) == MD::toHtml(doc, true, backRef));
+    REQUIRE(cache.changedItems().size() == doc->items().size());
+
+    REQUIRE(cache.toHtml(doc, true, backRef) == MD::toHtml(doc, true, backRef));
+    REQUIRE(cache.changedItems().empty());
+
+    auto edit = [&](long long int line, const std::string &text) {
+        lines[line] = text;
+
+        doc = parse([&](TRAIT::TextStream &stream) {
+            return parser.reparse(doc, stream, TRAIT::latin1ToString("tests/html/data"), TRAIT::latin1ToString("024.md"),
+                                  line, line, line);
+        });
+
+        const auto html = cache.toHtml(doc, true, backRef);
+
+        REQUIRE(html == MD::toHtml(doc, true, backRef));
+
+        for (long long int i = 0; i < static_cast<long long int>(doc->items().size()); ++i) {
+            REQUIRE(html.contains(cache.itemHtml(i)));
+        }
+
+        return cache.changedItems().size();
+    };
+
+    // Only edited paragraph and items that are parsed again around it.
+    REQUIRE(edit(6, "Another *paragraph*.") <= 3);
+    // New reference to the footnote changes numbering of next references to it.
+    REQUIRE(edit(10, "Paragraph with reference[^0].") <= 5);
+    REQUIRE(edit(10, "Paragraph without references.") <= 5);
+    // New reference to another footnote changes numbering of footnotes.
+    REQUIRE(edit(6, "Paragraph[^4].") > 10);
+
+    cache.clear();
+
+    REQUIRE(cache.toHtml(doc, false, {}, false) == MD::toHtml(doc, false, {}, false));
+    REQUIRE(cache.changedItems().size() == doc->items().size());
+}
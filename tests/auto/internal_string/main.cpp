@@ -594,3 +594,146 @@ TEST_CASE("virgin_string")
         REQUIRE(s.virginString(4) == TRAIT::latin1ToString("a\t\tb"));
     }
 }
+
+TEST_CASE("virgin_pos_map")
+{
+    auto check = [](const TRAIT::InternalString &s) {
+        std::vector<long long int> expected;
+
+        // First calls walk the history of changes, next ones use the map.
+        for (long long int i = 0; i <= s.length(); ++i) {
+            expected.push_back(s.virginPos(i));
+        }
+
+        for (long long int i = 0; i <= s.length(); ++i) {
+            REQUIRE(s.virginPos(i) == expected[i]);
+        }
+
+        for (long long int i = s.length(); i >= 0; --i) {
+            REQUIRE(s.virginPos(i) == expected[i]);
+        }
+    };
+
+    TRAIT::InternalString s(TRAIT::latin1ToString("\ta &amp; b\t\tc  d \t e\\|f\tg    h "));
+
+    MD::replaceTabs<TRAIT>(s);
+    check(s);
+
+    s.replace(TRAIT::latin1ToString("&amp;"), TRAIT::latin1ToString("&"));
+    check(s);
+
+    s.replace(TRAIT::latin1ToString("\\|"), TRAIT::latin1ToString("|"));
+    check(s);
+
+    auto simplified = s.simplified();
+    check(simplified);
+
+    auto sliced = simplified.sliced(2, 10);
+    check(sliced);
+
+    sliced.remove(1, 2);
+    check(sliced);
+
+    sliced.insert(3, TRAIT::latin1ToChar('\\'));
+    check(sliced);
+
+    for (const auto &part : s.split(TRAIT::InternalString(TRAIT::latin1ToString(" ")))) {
+        check(part);
+        check(part.right(1));
+    }
+}
+
+TEST_CASE("shared_history")
+{
+    TRAIT::InternalString s(TRAIT::latin1ToString("a &amp; b \t c"));
+    s.replace(TRAIT::latin1ToString("&amp;"), TRAIT::latin1ToString("&"));
+
+    std::vector<long long int> expected;
+
+    for (long long int i = 0; i <= s.length(); ++i) {
+        expected.push_back(s.virginPos(i));
+    }
+
+    auto copy = s;
+    copy.remove(0, 2);
+    copy.replace(TRAIT::latin1ToString("&"), TRAIT::latin1ToString("&amp;"));
+
+    REQUIRE(copy.asString() == TRAIT::latin1ToString("&amp; b \t c"));
+    REQUIRE(copy.virginPos(0) == 2);
+    REQUIRE(copy.virginPos(6) == 8);
+    REQUIRE(copy.virginString() == TRAIT::latin1ToString("&amp; b \t c"));
+
+    for (long long int i = 0; i <= s.length(); ++i) {
+        REQUIRE(s.virginPos(i) == expected[i]);
+    }
+
+    const auto simplified = s.simplified();
+
+    REQUIRE(simplified.asString() == TRAIT::latin1ToString("a & b c"));
+    REQUIRE(simplified.virginPos(6) == 12);
+    REQUIRE(s.asString() == TRAIT::latin1ToString("a & b \t c"));
+    REQUIRE(s.virginPos(8) == 12);
+}
+
+TEST_CASE("nested_prefixes")
+{
+    TRAIT::InternalString s(TRAIT::latin1ToString("> > > >\ta &amp; b"));
+    s.replace(TRAIT::latin1ToString("&amp;"), TRAIT::latin1ToString("&"));
+
+    auto nested = s;
+
+    for (int i = 0; i < 3; ++i) {
+        nested = nested.sliced(2);
+    }
+
+    REQUIRE(nested.asString() == TRAIT::latin1ToString(">\ta & b"));
+    REQUIRE(nested.virginPos(0) == 6);
+    REQUIRE(nested.virginPos(2) == 8);
+    REQUIRE(nested.virginPos(6) == 16);
+    REQUIRE(nested.virginString(2) == TRAIT::latin1ToString("a &amp; b"));
+
+    nested = nested.sliced(1).right(6);
+    nested.replaceOne(0, 1, TRAIT::latin1ToString("  "));
+
+    REQUIRE(nested.asString() == TRAIT::latin1ToString("  a & b"));
+    REQUIRE(nested.virginPos(2) == 8);
+    REQUIRE(nested.virginPos(4) == 10);
+    REQUIRE(nested.virginPos(6) == 16);
+}
+
+TEST_CASE("concurrent_virgin_pos")
+{
+    TRAIT::InternalString s(TRAIT::latin1ToString("\ta &amp; b\t\tc  d \t e\\|f\tg    h "));
+    MD::replaceTabs<TRAIT>(s);
+    s.replace(TRAIT::latin1ToString("&amp;"), TRAIT::latin1ToString("&"));
+    s = s.simplified();
+
+    std::vector<long long int> expected;
+    auto fresh = s;
+
+    // Walk the history on a copy, so the map of s is built concurrently below.
+    for (long long int i = 0; i <= fresh.length(); ++i) {
+        expected.push_back(fresh.virginPos(i));
+    }
+
+    const auto &shared = s;
+    std::vector<std::future<bool>> results;
+
+    for (int t = 0; t < 4; ++t) {
+        results.push_back(std::async(std::launch::async, [&shared, &expected]() {
+            bool ok = true;
+
+            for (int n = 0; n < 10; ++n) {
+                for (long long int i = 0; i <= shared.length(); ++i) {
+                    ok = ok && (shared.virginPos(i) == expected[i]);
+                }
+            }
+
+            return ok;
+        }));
+    }
+
+    for (auto &r : results) {
+        REQUIRE(r.get());
+    }
+}
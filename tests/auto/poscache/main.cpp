@@ -693,3 +693,203 @@ TEST_CASE("user_defined")
         REQUIRE(items.at(1)->type() == i->type());
     }
 }
+
+TEST_CASE("byte_offsets")
+{
+    MD::Parser<TRAIT> p;
+    auto doc = p.parse(TRAIT::latin1ToString("tests/parser/data/001.md"));
+    g_cache.initialize(doc);
+
+    REQUIRE(g_cache.findFirstInCache(0).empty());
+
+    const std::string content = u8"Текст *курсив*\n\nstring\n";
+
+#ifdef MD4QT_QT_SUPPORT
+    QTextStream stream(QByteArray::fromStdString(content));
+#else
+    std::istringstream stream(content);
+#endif
+
+    p.setRecordByteOffsets();
+    doc = p.parse(stream, TRAIT::latin1ToString("tests/parser/data"), TRAIT::latin1ToString("byte_offsets.md"));
+    g_cache.initialize(doc);
+
+    {
+        auto items = g_cache.findFirstInCache(2);
+        REQUIRE(items.size() == 2);
+        REQUIRE(items.at(0)->type() == MD::ItemType::Paragraph);
+        REQUIRE(items.at(1)->type() == MD::ItemType::Text);
+        REQUIRE(static_cast<MD::Text<TRAIT> *>(items.at(1))->text() == TRAIT::utf8ToString(u8"Текст"));
+    }
+
+    {
+        auto items = g_cache.findFirstInCache(14);
+        REQUIRE(items.size() == 2);
+        REQUIRE(static_cast<MD::Text<TRAIT> *>(items.at(1))->text() == TRAIT::utf8ToString(u8"курсив"));
+    }
+
+    {
+        auto items = g_cache.findFirstInCache(28);
+        REQUIRE(items.size() == 2);
+        REQUIRE(static_cast<MD::Text<TRAIT> *>(items.at(1))->text() == TRAIT::latin1ToString("string"));
+    }
+
+    REQUIRE(g_cache.findFirstInCache(-1).empty());
+}
+
+TEST_CASE("find_all")
+{
+    const std::string content = "Text *italic* text\n"
+                                "\n"
+                                "* item 1\n"
+                                "* item 2\n"
+                                "\n"
+                                "Last\n";
+
+#ifdef MD4QT_QT_SUPPORT
+    QTextStream stream(QByteArray::fromStdString(content));
+#else
+    std::istringstream stream(content);
+#endif
+
+    MD::Parser<TRAIT> p;
+    auto doc = p.parse(stream, TRAIT::latin1ToString("tests/parser/data"), TRAIT::latin1ToString("find_all.md"));
+    g_cache.initialize(doc);
+
+    {
+        auto items = g_cache.findAllInCache({5, 0, 5, 0});
+        REQUIRE(items.size() == 2);
+        REQUIRE(items.at(0)->type() == MD::ItemType::Paragraph);
+        REQUIRE(items.at(1)->type() == MD::ItemType::Text);
+        REQUIRE(static_cast<MD::Text<TRAIT> *>(items.at(1))->text() == TRAIT::latin1ToString("italic"));
+    }
+
+    {
+        auto items = g_cache.findAllInCache({0, 0, 100, 0});
+        REQUIRE(items.size() == 4);
+        REQUIRE(items.at(0)->type() == MD::ItemType::Paragraph);
+    }
+
+    {
+        auto items = g_cache.findInLines(2, 3);
+        REQUIRE(items.size() == 7);
+        REQUIRE(items.at(0)->type() == MD::ItemType::List);
+        REQUIRE(items.at(1)->type() == MD::ItemType::ListItem);
+        REQUIRE(items.at(2)->type() == MD::ItemType::Paragraph);
+        REQUIRE(items.at(3)->type() == MD::ItemType::Text);
+        REQUIRE(items.at(4)->type() == MD::ItemType::ListItem);
+    }
+
+    REQUIRE(g_cache.findInLines(1, 1).empty());
+    REQUIRE(g_cache.findInLines(100, 200).empty());
+    REQUIRE(g_cache.findInLines(0, 100).size() == 13);
+
+    {
+        auto items = g_cache.findNearest({0, 1, 0, 1}, 3);
+        REQUIRE(items.size() == 3);
+        REQUIRE(items.at(0)->type() == MD::ItemType::Paragraph);
+        REQUIRE(items.at(0)->startLine() == 0);
+        REQUIRE(items.at(1)->type() == MD::ItemType::Text);
+        REQUIRE(items.at(1)->startLine() == 0);
+        REQUIRE(items.at(1)->endColumn() == 17);
+        REQUIRE(items.at(2)->type() == MD::ItemType::Text);
+        REQUIRE(items.at(2)->endColumn() == 11);
+    }
+
+    {
+        auto items = g_cache.findNearest({1, 5, 1, 5}, 3);
+        REQUIRE(items.size() == 3);
+        REQUIRE(items.at(0)->type() == MD::ItemType::Paragraph);
+        REQUIRE(items.at(0)->startLine() == 5);
+        REQUIRE(items.at(1)->type() == MD::ItemType::Text);
+        REQUIRE(items.at(2)->type() == MD::ItemType::List);
+    }
+
+    REQUIRE(g_cache.findNearest({0, 0, 0, 0}, 100).size() == 13);
+}
+
+TEST_CASE("update")
+{
+    std::vector<std::string> lines = {"# Heading 1",
+                                      "",
+                                      "Paragraph with [link](#heading-2).",
+                                      "",
+                                      "* item 1",
+                                      "* item 2",
+                                      "",
+                                      "Text",
+                                      "",
+                                      "> quote",
+                                      "",
+                                      "## Heading 2",
+                                      "",
+                                      "Reference [link][ref] and footnote[^1].",
+                                      "",
+                                      "[ref]: https://www.google.com",
+                                      "",
+                                      "[^1]: Footnote."};
+
+    MD::Parser<TRAIT> parser;
+
+    auto parse = [&](long long int firstLine, long long int lastLine, long long int newLastLine,
+                     std::shared_ptr<MD::Document<TRAIT>> doc) {
+        std::string content;
+
+        for (const auto &l : lines) {
+            content.append(l);
+            content.push_back('\n');
+        }
+
+#ifdef MD4QT_QT_SUPPORT
+        QTextStream stream(QByteArray::fromStdString(content));
+#else
+        std::istringstream stream(content);
+#endif
+
+        return (doc ? parser.reparse(doc, stream, TRAIT::latin1ToString("tests/parser/data"),
+                                     TRAIT::latin1ToString("update.md"), firstLine, lastLine, newLastLine) :
+                      parser.parse(stream, TRAIT::latin1ToString("tests/parser/data"),
+                                   TRAIT::latin1ToString("update.md")));
+    };
+
+    auto doc = parse(0, 0, 0, nullptr);
+    MD::PosCache<TRAIT> cache;
+    cache.initialize(doc);
+
+    auto edit = [&](long long int firstLine, long long int removed, const std::vector<std::string> &added) {
+        lines.erase(lines.begin() + firstLine, lines.begin() + firstLine + removed);
+        lines.insert(lines.begin() + firstLine, added.cbegin(), added.cend());
+
+        const auto old = doc.get();
+        const auto newLastLine = firstLine + static_cast<long long int>(added.size()) - 1;
+
+        doc = parse(firstLine, firstLine + removed - 1, newLastLine, doc);
+        cache.update(doc, firstLine, firstLine + removed - 1, newLastLine);
+
+        MD::PosCache<TRAIT> expected;
+        expected.initialize(doc);
+
+        const auto all = cache.findInLines(0, static_cast<long long int>(lines.size()));
+        REQUIRE(all == expected.findInLines(0, static_cast<long long int>(lines.size())));
+        REQUIRE(!all.empty());
+
+        for (long long int l = 0; l < static_cast<long long int>(lines.size()); ++l) {
+            for (long long int c = 0; c < static_cast<long long int>(lines[l].size()); ++c) {
+                REQUIRE(cache.findFirstInCache({c, l, c, l}) == expected.findFirstInCache({c, l, c, l}));
+            }
+        }
+
+        return doc.get() == old;
+    };
+
+    // Change text of a paragraph.
+    REQUIRE(edit(7, 1, {"Another *text*"}));
+    // Insert new heading.
+    REQUIRE(edit(9, 0, {"", "## Heading 3"}));
+    // Remove lines.
+    REQUIRE(edit(4, 3, {}));
+    // Paragraph becomes a list.
+    REQUIRE(edit(4, 1, {"* Another *text*", "* item 3"}));
+    // Definition of a link is changed, so the whole document is parsed.
+    REQUIRE(!edit(15, 1, {"[ref]: https://www.kde.org"}));
+}
@@ -24,6 +24,13 @@ struct PrivateAccess {
         return p.checkEmphasisSequence(s, idx);
     }
 
+    static bool isText(const TRAIT::String &s)
+    {
+        TRAIT::InternalString line(s);
+
+        return p.whatIsTheLine(line) == Parser<TRAIT>::BlockType::Text;
+    }
+
     static Parser<TRAIT> p;
 };
 
@@ -932,3 +939,26 @@ TEST_CASE("local_pos_from_virgin")
         REQUIRE(MD::localPosFromVirgin<TRAIT>(dd, 0, 1) == pair{-1, -1});
     }
 }
+
+TEST_CASE("can_start_block")
+{
+    for (const char c : {'#', '>', '[', '`', '~', '-', '+', '*', '0', '5', '9'}) {
+        REQUIRE(MD::canStartBlock<TRAIT>(TRAIT::latin1ToChar(c)));
+    }
+
+    for (const char c : {'a', 'Z', '_', '<', '|', '=', '!', ' ', '\\'}) {
+        REQUIRE(!MD::canStartBlock<TRAIT>(TRAIT::latin1ToChar(c)));
+    }
+
+    for (const auto &s : {"text", "   text", "_text_", "<div>", "| a | b |", "==="}) {
+        REQUIRE(MD::PrivateAccess::isText(TRAIT::latin1ToString(s)));
+    }
+
+    for (const auto &s : {"# h", "> q", "- l", "1. l", "```", "~~~", "[^1]: f", "    code", "", "   "}) {
+        REQUIRE(!MD::PrivateAccess::isText(TRAIT::latin1ToString(s)));
+    }
+
+    REQUIRE(MD::PrivateAccess::isText(TRAIT::latin1ToString("[link]")));
+    REQUIRE(MD::PrivateAccess::isText(TRAIT::latin1ToString("#hashtag")));
+    REQUIRE(MD::PrivateAccess::isText(TRAIT::latin1ToString("2024 year")));
+}
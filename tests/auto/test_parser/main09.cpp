@@ -8,6 +8,11 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 
+// md4qt include.
+#include <md4qt/algo.h>
+#include <md4qt/frozen.h>
+#include <md4qt/html.h>
+
 /*
 *<a>text</a>*
 
@@ -1042,3 +1047,876 @@ TEST_CASE("273")
         REQUIRE(li->items().at(5)->type() == MD::ItemType::RawHtml);
     }
 }
+
+TEST_CASE("274")
+{
+    MD::Parser<TRAIT> parser;
+    parser.setMemoryMappedInput();
+
+    REQUIRE(parser.isMemoryMappedInput());
+
+    std::ofstream file("tests/parser/data/274.md", std::ios::out | std::ios::trunc | std::ios::binary);
+
+    if (file.good()) {
+        const char *str = "Line 1...\r\rLine 2...\r\n\r\nLine 3...\n";
+        file.write(str, strlen(str));
+        file.close();
+
+        auto doc = parser.parse(TRAIT::latin1ToString("tests/parser/data/274.md"));
+
+        REQUIRE(doc->isEmpty() == false);
+        REQUIRE(doc->items().size() == 4);
+
+        const char *lines[] = {"Line 1...", "Line 2...", "Line 3..."};
+
+        for (long long int i = 1; i < 4; ++i) {
+            REQUIRE(doc->items().at(i)->type() == MD::ItemType::Paragraph);
+
+            auto dp = static_cast<MD::Paragraph<TRAIT> *>(doc->items().at(i).get());
+            REQUIRE(dp->startColumn() == 0);
+            REQUIRE(dp->startLine() == (i - 1) * 2);
+            REQUIRE(dp->endColumn() == 8);
+            REQUIRE(dp->endLine() == (i - 1) * 2);
+
+            REQUIRE(dp->items().size() == 1);
+
+            REQUIRE(dp->items().at(0)->type() == MD::ItemType::Text);
+
+            auto t = static_cast<MD::Text<TRAIT> *>(dp->items().at(0).get());
+
+            REQUIRE(t->text() == TRAIT::latin1ToString(lines[i - 1]));
+        }
+    } else
+        REQUIRE(true == false);
+}
+
+#ifdef MD4QT_ICU_STL_SUPPORT
+
+//! Non-seekable stream buffer that gives data by small portions.
+class PipeBuf : public std::streambuf
+{
+public:
+    explicit PipeBuf(const std::string &data)
+        : m_data(data)
+        , m_pos(0)
+    {
+    }
+
+protected:
+    int_type
+    underflow() override
+    {
+        if (m_pos == m_data.size()) {
+            return traits_type::eof();
+        }
+
+        const auto size = std::min<size_t>(1000, m_data.size() - m_pos);
+        std::copy(m_data.data() + m_pos, m_data.data() + m_pos + size, m_buf);
+        m_pos += size;
+        setg(m_buf, m_buf, m_buf + size);
+
+        return traits_type::to_int_type(m_buf[0]);
+    }
+
+private:
+    std::string m_data;
+    size_t m_pos;
+    char m_buf[1000];
+};
+
+TEST_CASE("275")
+{
+    // Line break "\r\n" is on the border of a chunk, and the long line is longer than chunk.
+    const size_t longLine = 64 * 1024 - 12;
+    std::string data = "Line 1...\n\n" + std::string(longLine, 'a') + "\r\n\r";
+    data.append(std::string(longLine * 2, 'b'));
+    data.append("\n\nLine", 6);
+    data.push_back(0);
+    data.append(" 3...");
+
+    PipeBuf buf(data);
+    std::istream stream(&buf);
+
+    MD::Parser<TRAIT> parser;
+
+    auto doc = parser.parse(stream, TRAIT::latin1ToString(""), TRAIT::latin1ToString("275.md"));
+
+    REQUIRE(doc->isEmpty() == false);
+    REQUIRE(doc->items().size() == 5);
+
+    const TRAIT::String texts[] = {TRAIT::latin1ToString("Line 1..."),
+                                   TRAIT::String(std::string(longLine, 'a')),
+                                   TRAIT::String(std::string(longLine * 2, 'b')),
+                                   TRAIT::utf16ToString(u"Line\xFFFD 3...")};
+    const long long int lines[] = {0, 2, 4, 6};
+
+    for (long long int i = 1; i < 5; ++i) {
+        REQUIRE(doc->items().at(i)->type() == MD::ItemType::Paragraph);
+
+        auto dp = static_cast<MD::Paragraph<TRAIT> *>(doc->items().at(i).get());
+        REQUIRE(dp->startLine() == lines[i - 1]);
+        REQUIRE(dp->endLine() == lines[i - 1]);
+        REQUIRE(dp->items().size() == 1);
+        REQUIRE(dp->items().at(0)->type() == MD::ItemType::Text);
+
+        auto t = static_cast<MD::Text<TRAIT> *>(dp->items().at(0).get());
+        REQUIRE(t->text() == texts[i - 1]);
+    }
+}
+
+#endif
+
+TEST_CASE("276")
+{
+    std::string content;
+
+    for (int i = 1; i <= 273; ++i) {
+        char fileName[64];
+        std::snprintf(fileName, sizeof(fileName), "tests/parser/data/%03d.md", i);
+
+        std::ifstream file(fileName, std::ios::in | std::ios::binary);
+
+        if (file.good()) {
+            content.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            content.append("\n\n");
+        }
+    }
+
+    auto parse = [&content](unsigned int threads) {
+        MD::Parser<TRAIT> parser;
+        parser.setThreadsCount(threads);
+
+        REQUIRE(parser.threadsCount() == threads);
+
+#ifdef MD4QT_QT_SUPPORT
+        QTextStream stream(QByteArray::fromStdString(content));
+#else
+        std::istringstream stream(content);
+#endif
+
+        return parser.parse(stream, TRAIT::latin1ToString("tests/parser/data"), TRAIT::latin1ToString("276.md"));
+    };
+
+    const auto doc = parse(1);
+    const auto html = MD::toHtml(doc);
+
+    for (unsigned int threads = 2; threads <= 8; ++threads) {
+        const auto pdoc = parse(threads);
+
+        REQUIRE(pdoc->items().size() == doc->items().size());
+        REQUIRE(pdoc->labeledHeadings().size() == doc->labeledHeadings().size());
+        REQUIRE(pdoc->labeledLinks().size() == doc->labeledLinks().size());
+        REQUIRE(pdoc->footnotesMap().size() == doc->footnotesMap().size());
+        REQUIRE(MD::toHtml(pdoc) == html);
+    }
+}
+
+TEST_CASE("277")
+{
+    static const int c_filesCount = 40;
+
+    for (int i = 0; i < c_filesCount; ++i) {
+        char fileName[64];
+        std::snprintf(fileName, sizeof(fileName), "tests/parser/data/277-%02d.md", i);
+
+        std::ofstream file(fileName, std::ios::out | std::ios::trunc | std::ios::binary);
+
+        REQUIRE(file.good());
+
+        file << "# File " << i << "\n\nText[^1] [back](277-00.md) [self](#file-" << i << ")\n\n";
+
+        for (int j = i * 2 + 1; j <= i * 2 + 2 && j < c_filesCount + 5; ++j) {
+            file << "* [" << j << "](277-" << (j < 10 ? "0" : "") << j << ".md)\n";
+        }
+
+        file << "\n[ref " << i << "][label]\n\n[label]: 277-" << ((i * 7) % c_filesCount < 10 ? "0" : "")
+             << (i * 7) % c_filesCount << ".md\n\n[^1]: Footnote " << i << "\n";
+    }
+
+    const char *fileNames[] = {"tests/parser/data/277-00.md", "tests/parser/data/277-13.md",
+                               "tests/parser/data/042.md", "tests/parser/data/051.md",
+                               "tests/parser/data/243.md"};
+
+    for (const auto &fileName : fileNames) {
+        long long int skipped = 0;
+
+        auto parse = [fileName, &skipped](unsigned int threads) {
+            MD::Parser<TRAIT> parser;
+            parser.setThreadsCount(threads);
+
+            auto doc = parser.parse(TRAIT::latin1ToString(fileName), true);
+
+            skipped = parser.skippedFilesCount();
+
+            return doc;
+        };
+
+        const auto doc = parse(1);
+        const auto html = MD::toHtml(doc);
+        const auto skippedInSequence = skipped;
+
+        for (unsigned int threads = 2; threads <= 4; ++threads) {
+            const auto pdoc = parse(threads);
+
+            REQUIRE(skipped == skippedInSequence);
+
+            REQUIRE(pdoc->items().size() == doc->items().size());
+            REQUIRE(pdoc->labeledHeadings().size() == doc->labeledHeadings().size());
+            REQUIRE(pdoc->labeledLinks().size() == doc->labeledLinks().size());
+            REQUIRE(pdoc->footnotesMap().size() == doc->footnotesMap().size());
+            REQUIRE(MD::toHtml(pdoc) == html);
+        }
+    }
+}
+
+TEST_CASE("278")
+{
+    MD::Parser<TRAIT> parser;
+
+    REQUIRE(parser.skippedFilesCount() == 0);
+
+    parser.parse(TRAIT::latin1ToString("tests/parser/data/042.md"), true);
+    REQUIRE(parser.skippedFilesCount() == 1);
+
+    parser.parse(TRAIT::latin1ToString("tests/parser/data/051.md"), true);
+    REQUIRE(parser.skippedFilesCount() == 2);
+
+    parser.parse(TRAIT::latin1ToString("tests/parser/data/042.md"), false);
+    REQUIRE(parser.skippedFilesCount() == 0);
+}
+
+TEST_CASE("279")
+{
+    std::vector<std::string> lines = {"# Heading 1",
+                                      "",
+                                      "Paragraph with [link](#heading-2).",
+                                      "",
+                                      "* item 1",
+                                      "* item 2",
+                                      "",
+                                      "Text",
+                                      "",
+                                      "> quote",
+                                      "",
+                                      "| a | b |",
+                                      "|---|---|",
+                                      "| c | d |",
+                                      "",
+                                      "## Heading 2",
+                                      "",
+                                      "Reference [link][ref].",
+                                      "",
+                                      "[ref]: https://www.google.com"};
+
+    MD::Parser<TRAIT> parser;
+
+    auto parse = [&lines](const std::function<std::shared_ptr<MD::Document<TRAIT>>(TRAIT::TextStream &)> &f) {
+        std::string content;
+
+        for (const auto &l : lines) {
+            content.append(l);
+            content.push_back('\n');
+        }
+
+#ifdef MD4QT_QT_SUPPORT
+        QTextStream stream(QByteArray::fromStdString(content));
+#else
+        std::istringstream stream(content);
+#endif
+
+        return f(stream);
+    };
+
+    auto full = [&parser, &parse]() {
+        return parse([&parser](TRAIT::TextStream &stream) {
+            return parser.parse(stream, TRAIT::latin1ToString("tests/parser/data"), TRAIT::latin1ToString("279.md"));
+        });
+    };
+
+    auto doc = full();
+
+    auto edit = [&](long long int firstLine, long long int removed, const std::vector<std::string> &added) {
+        lines.erase(lines.begin() + firstLine, lines.begin() + firstLine + removed);
+        lines.insert(lines.begin() + firstLine, added.cbegin(), added.cend());
+
+        const auto old = doc.get();
+
+        doc = parse([&](TRAIT::TextStream &stream) {
+            return parser.reparse(doc,
+                                  stream,
+                                  TRAIT::latin1ToString("tests/parser/data"),
+                                  TRAIT::latin1ToString("279.md"),
+                                  firstLine,
+                                  firstLine + removed - 1,
+                                  firstLine + static_cast<long long int>(added.size()) - 1);
+        });
+
+        const auto expected = full();
+
+        REQUIRE(doc->items().size() == expected->items().size());
+
+        for (size_t i = 0; i < doc->items().size(); ++i) {
+            REQUIRE(doc->items().at(i)->type() == expected->items().at(i)->type());
+            REQUIRE(doc->items().at(i)->startLine() == expected->items().at(i)->startLine());
+            REQUIRE(doc->items().at(i)->endLine() == expected->items().at(i)->endLine());
+            REQUIRE(doc->items().at(i)->startColumn() == expected->items().at(i)->startColumn());
+            REQUIRE(doc->items().at(i)->endColumn() == expected->items().at(i)->endColumn());
+        }
+
+        REQUIRE(doc->labeledHeadings().size() == expected->labeledHeadings().size());
+        REQUIRE(doc->labeledLinks().size() == expected->labeledLinks().size());
+        REQUIRE(doc->footnotesMap().size() == expected->footnotesMap().size());
+        REQUIRE(MD::toHtml(doc) == MD::toHtml(expected));
+
+        return doc.get() == old;
+    };
+
+    // Change text of a paragraph.
+    REQUIRE(edit(7, 1, {"Another *text*"}));
+    // Paragraph becomes setext heading.
+    REQUIRE(edit(8, 0, {"==="}));
+    // Insert new heading.
+    REQUIRE(edit(9, 0, {"", "## Heading 3"}));
+    // Table without header delimiter is a paragraph.
+    REQUIRE(edit(15, 1, {}));
+    // Remove lines.
+    REQUIRE(edit(4, 3, {}));
+    // Definition of a link is changed, so the whole document is parsed.
+    REQUIRE(!edit(18, 1, {"[ref]: https://www.kde.org"}));
+    // Empty document.
+    REQUIRE(!edit(0, static_cast<long long int>(lines.size()), {}));
+}
+
+/*
+Use [google] and [^1].
+
+Plain *text* without definitions.
+
+<div>
+[kde]: https://www.kde.org
+</div>
+
+[google]: https://www.google.com
+
+[^1]: Footnote.
+
+*/
+TEST_CASE("280")
+{
+    MD::Parser<TRAIT> parser;
+
+    auto doc = parser.parse(TRAIT::latin1ToString("tests/parser/data/280.md"));
+
+    REQUIRE(doc->isEmpty() == false);
+    REQUIRE(doc->items().size() == 4);
+
+    REQUIRE(doc->labeledLinks().size() == 1);
+    REQUIRE(doc->footnotesMap().size() == 1);
+
+    {
+        REQUIRE(doc->items().at(1)->type() == MD::ItemType::Paragraph);
+        auto p = static_cast<MD::Paragraph<TRAIT> *>(doc->items().at(1).get());
+        REQUIRE(p->items().size() == 5);
+        REQUIRE(p->items().at(1)->type() == MD::ItemType::Link);
+        auto l = static_cast<MD::Link<TRAIT> *>(p->items().at(1).get());
+        const auto it = doc->labeledLinks().find(l->url());
+        REQUIRE(it != doc->labeledLinks().cend());
+        REQUIRE(it->second->url() == TRAIT::latin1ToString("https://www.google.com"));
+        REQUIRE(p->items().at(3)->type() == MD::ItemType::FootnoteRef);
+    }
+
+    REQUIRE(doc->items().at(2)->type() == MD::ItemType::Paragraph);
+    REQUIRE(doc->items().at(3)->type() == MD::ItemType::RawHtml);
+}
+
+TEST_CASE("281")
+{
+    MD::Parser<TRAIT> parser;
+
+    REQUIRE(parser.isArenaAllocation() == false);
+
+    const auto doc = parser.parse(TRAIT::latin1ToString("tests/parser/data/273.md"));
+
+    parser.setArenaAllocation();
+    REQUIRE(parser.isArenaAllocation());
+
+    std::shared_ptr<MD::Item<TRAIT>> item;
+
+    for (unsigned int threads = 1; threads <= 2; ++threads) {
+        parser.setThreadsCount(threads);
+
+        auto adoc = parser.parse(TRAIT::latin1ToString("tests/parser/data/273.md"));
+
+        REQUIRE(adoc->items().size() == doc->items().size());
+        REQUIRE(adoc->labeledHeadings().size() == doc->labeledHeadings().size());
+        REQUIRE(adoc->labeledLinks().size() == doc->labeledLinks().size());
+        REQUIRE(adoc->footnotesMap().size() == doc->footnotesMap().size());
+        REQUIRE(MD::toHtml(adoc) == MD::toHtml(doc));
+
+        item = adoc->items().back();
+    }
+
+    // Item keeps memory of the arena.
+    REQUIRE(item->type() == doc->items().back()->type());
+    REQUIRE(item->startLine() == doc->items().back()->startLine());
+    REQUIRE(item->endLine() == doc->items().back()->endLine());
+}
+
+TEST_CASE("282")
+{
+    auto arena = std::make_shared<MD::Arena>(64);
+
+    REQUIRE(arena->reservedSize() == 0);
+
+    void *p1 = arena->allocate(10, 1);
+    void *p2 = arena->allocate(8, 8);
+
+    REQUIRE(p1 != p2);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(p2) % 8 == 0);
+    REQUIRE(arena->reservedSize() == 64);
+
+    arena->allocate(100, 16);
+    REQUIRE(arena->reservedSize() == 64 + 116);
+
+    {
+        MD::ArenaScope scope(arena);
+
+        REQUIRE(MD::currentArena() == arena);
+
+        auto t = MD::makeItem<MD::Text<TRAIT>>();
+        t->setText(TRAIT::latin1ToString("text"));
+
+        REQUIRE(t->text() == TRAIT::latin1ToString("text"));
+        REQUIRE(arena->reservedSize() > 64 + 116);
+    }
+
+    REQUIRE(MD::currentArena() == nullptr);
+}
+
+TEST_CASE("283")
+{
+    const typename TRAIT::template Vector<MD::ItemType> types = {MD::ItemType::Heading,
+                                                                 MD::ItemType::Text,
+                                                                 MD::ItemType::Paragraph,
+                                                                 MD::ItemType::LineBreak,
+                                                                 MD::ItemType::Blockquote,
+                                                                 MD::ItemType::ListItem,
+                                                                 MD::ItemType::List,
+                                                                 MD::ItemType::Link,
+                                                                 MD::ItemType::Image,
+                                                                 MD::ItemType::Code,
+                                                                 MD::ItemType::Table,
+                                                                 MD::ItemType::FootnoteRef,
+                                                                 MD::ItemType::Footnote,
+                                                                 MD::ItemType::Anchor,
+                                                                 MD::ItemType::HorizontalLine,
+                                                                 MD::ItemType::RawHtml,
+                                                                 MD::ItemType::Math};
+
+    for (int i = 1; i <= 280; ++i) {
+        const std::string number = (i < 10 ? "00" : (i < 100 ? "0" : "")) + std::to_string(i);
+        const auto fileName = TRAIT::latin1ToString(("tests/parser/data/" + number + ".md").c_str());
+
+        MD::Parser<TRAIT> parser;
+
+        const auto doc = parser.parse(fileName);
+        const auto frozen = MD::freeze(doc);
+
+        REQUIRE(frozen.isEmpty() == doc->isEmpty());
+        REQUIRE(frozen.footnotes().size() == doc->footnotesMap().size());
+        REQUIRE(frozen.labeledLinks().size() == doc->labeledLinks().size());
+        REQUIRE(frozen.labeledHeadings().size() == doc->labeledHeadings().size());
+
+        const auto thawed = MD::thaw(frozen);
+
+        REQUIRE(MD::toHtml(thawed) == MD::toHtml(doc));
+        REQUIRE(MD::toHtml(frozen) == MD::toHtml(doc));
+
+        for (unsigned int level = 0; level <= 3; ++level) {
+            std::vector<std::pair<MD::ItemType, long long int>> expected;
+
+            MD::forEach<TRAIT>(
+                types,
+                doc,
+                [&expected](MD::Item<TRAIT> *item) {
+                    expected.push_back({item->type(), item->startLine() * 10000 + item->startColumn()});
+                },
+                level);
+
+            std::vector<std::pair<MD::ItemType, long long int>> visited;
+
+            MD::forEach<TRAIT>(
+                types,
+                frozen,
+                [&frozen, &visited](long long int idx) {
+                    const auto &n = frozen.node(idx);
+                    visited.push_back({n.m_type, n.m_startLine * 10000LL + n.m_startColumn});
+                },
+                level);
+
+            REQUIRE(visited == expected);
+        }
+    }
+
+    MD::Parser<TRAIT> parser;
+
+    const auto doc = parser.parse(TRAIT::latin1ToString("tests/parser/data/280.md"));
+    const auto frozen = MD::freeze(doc);
+
+    long long int textCount = 0;
+
+    MD::forEach<TRAIT>({MD::ItemType::Text}, frozen, [&frozen, &textCount](long long int idx) {
+        REQUIRE(!frozen.text(idx).isEmpty());
+        ++textCount;
+    });
+
+    REQUIRE(textCount > 0);
+
+    for (const auto &h : frozen.labeledHeadings()) {
+        REQUIRE(frozen.type(h.second) == MD::ItemType::Heading);
+        REQUIRE(frozen.label(h.second) == h.first);
+    }
+}
+
+TEST_CASE("284")
+{
+    MD::Parser<TRAIT> parser;
+
+    REQUIRE(parser.isCollectPhaseTimings() == false);
+
+    parser.parse(TRAIT::latin1ToString("tests/parser/data/273.md"));
+
+    REQUIRE(parser.phaseTimings().total().count() == 0);
+
+    parser.setCollectPhaseTimings();
+    REQUIRE(parser.isCollectPhaseTimings());
+
+    const auto start = std::chrono::steady_clock::now();
+    parser.parse(TRAIT::latin1ToString("tests/parser/data/273.md"));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    const auto &timings = parser.phaseTimings();
+
+    REQUIRE(timings.time(MD::ParsingPhase::Reading).count() > 0);
+    REQUIRE(timings.time(MD::ParsingPhase::Blocks).count() > 0);
+    REQUIRE(timings.time(MD::ParsingPhase::Inlines).count() > 0);
+    REQUIRE(timings.time(MD::ParsingPhase::ParagraphOptimization).count() > 0);
+    REQUIRE(timings.total() <= elapsed);
+
+    parser.setThreadsCount(2);
+    parser.parse(TRAIT::latin1ToString("tests/parser/data/273.md"));
+
+    REQUIRE(parser.phaseTimings().time(MD::ParsingPhase::Inlines).count() > 0);
+
+    parser.setCollectPhaseTimings(false);
+    parser.parse(TRAIT::latin1ToString("tests/parser/data/273.md"));
+
+    REQUIRE(parser.phaseTimings().total().count() == 0);
+}
+
+TEST_CASE("285")
+{
+    const std::string content = u8"Привет **мир**\r\n\r\na\t😀 x\n\n> quote\n";
+
+    auto parse = [&content](bool byteOffsets) {
+        MD::Parser<TRAIT> parser;
+        parser.setRecordByteOffsets(byteOffsets);
+
+        REQUIRE(parser.isRecordByteOffsets() == byteOffsets);
+
+#ifdef MD4QT_QT_SUPPORT
+        QTextStream stream(QByteArray::fromStdString(content));
+#else
+        std::istringstream stream(content);
+#endif
+
+        return parser.parse(stream, TRAIT::latin1ToString("tests/parser/data"), TRAIT::latin1ToString("285.md"));
+    };
+
+    {
+        auto doc = parse(false);
+
+        REQUIRE(doc->items().front()->type() == MD::ItemType::Anchor);
+        REQUIRE(!static_cast<MD::Anchor<TRAIT> *>(doc->items().front().get())->sourceOffsets());
+    }
+
+    auto doc = parse(true);
+
+    REQUIRE(doc->items().size() == 4);
+    REQUIRE(doc->items().front()->type() == MD::ItemType::Anchor);
+
+    const auto offsets = static_cast<MD::Anchor<TRAIT> *>(doc->items().front().get())->sourceOffsets();
+    REQUIRE(offsets);
+    REQUIRE(offsets->linesCount() == 5);
+    REQUIRE(offsets->lineOffset(0) == 0);
+    REQUIRE(offsets->lineOffset(1) == 25);
+    REQUIRE(offsets->lineOffset(2) == 27);
+    REQUIRE(offsets->lineOffset(3) == 36);
+    REQUIRE(offsets->lineOffset(4) == 37);
+    REQUIRE(offsets->lineOffset(5) == -1);
+
+    auto slice = [&content](const std::pair<long long int, long long int> &r) {
+        return content.substr(r.first, r.second - r.first);
+    };
+
+    {
+        REQUIRE(doc->items().at(1)->type() == MD::ItemType::Paragraph);
+        auto p = static_cast<MD::Paragraph<TRAIT> *>(doc->items().at(1).get());
+        REQUIRE(slice(offsets->range(*p)) == u8"Привет **мир**");
+        REQUIRE(p->items().size() == 2);
+        REQUIRE(slice(offsets->range(*p->items().at(0))) == u8"Привет ");
+        REQUIRE(slice(offsets->range(*p->items().at(1))) == u8"мир");
+    }
+
+    {
+        REQUIRE(doc->items().at(2)->type() == MD::ItemType::Paragraph);
+        auto p = static_cast<MD::Paragraph<TRAIT> *>(doc->items().at(2).get());
+        REQUIRE(slice(offsets->range(*p)) == u8"a\t😀 x");
+    }
+
+    {
+        REQUIRE(doc->items().at(3)->type() == MD::ItemType::Blockquote);
+        auto b = static_cast<MD::Blockquote<TRAIT> *>(doc->items().at(3).get());
+        REQUIRE(slice(offsets->range(*b)) == "> quote");
+    }
+
+    REQUIRE(offsets->position(17) == MD::WithPosition(10, 0, 10, 0));
+    REQUIRE(offsets->position(24) == MD::WithPosition(14, 0, 14, 0));
+    REQUIRE(offsets->position(29) == MD::WithPosition(2, 2, 2, 2));
+    REQUIRE(offsets->position(33) == MD::WithPosition(4, 2, 4, 2));
+    REQUIRE(offsets->position(-1).startLine() == -1);
+    REQUIRE(offsets->range(MD::WithPosition()) == std::make_pair(-1ll, -1ll));
+
+    const auto html = MD::toHtml(doc);
+
+    REQUIRE(html == MD::toHtml(parse(false)));
+
+    auto copy = std::static_pointer_cast<MD::Document<TRAIT>>(doc->clone());
+    REQUIRE(static_cast<MD::Anchor<TRAIT> *>(copy->items().front().get())->sourceOffsets() == offsets);
+}
+
+TEST_CASE("286")
+{
+    std::string content;
+
+    for (int i = 0; i < 40; ++i) {
+        content.append("a*b");
+    }
+
+    content.append("\n");
+
+    MD::Parser<TRAIT> parser;
+
+#ifdef MD4QT_QT_SUPPORT
+    QTextStream stream(QByteArray::fromStdString(content));
+#else
+    std::istringstream stream(content);
+#endif
+
+    auto doc = parser.parse(stream, TRAIT::latin1ToString("tests/parser/data"), TRAIT::latin1ToString("286.md"));
+
+    REQUIRE(doc->items().size() == 2);
+    REQUIRE(doc->items().at(1)->type() == MD::ItemType::Paragraph);
+    auto p = static_cast<MD::Paragraph<TRAIT> *>(doc->items().at(1).get());
+    REQUIRE(p->items().size() == 41);
+
+    for (long long int i = 0; i < 41; ++i) {
+        REQUIRE(p->items().at(i)->type() == MD::ItemType::Text);
+        auto t = static_cast<MD::Text<TRAIT> *>(p->items().at(i).get());
+        REQUIRE(t->opts() == (i % 2 ? MD::ItalicText : MD::TextWithoutFormat));
+        REQUIRE(t->text() == TRAIT::latin1ToString(i == 0 ? "a" : (i == 40 ? "b" : "ba")));
+    }
+}
+
+TEST_CASE("287")
+{
+    auto parse = [](const std::string &content, const MD::ParserLimits &limits, int reached) {
+        MD::Parser<TRAIT> parser;
+        parser.setLimits(limits);
+
+#ifdef MD4QT_QT_SUPPORT
+        QTextStream stream(QByteArray::fromStdString(content));
+#else
+        std::istringstream stream(content);
+#endif
+
+        auto doc = parser.parse(stream, TRAIT::latin1ToString("tests/parser/data"), TRAIT::latin1ToString("287.md"));
+
+        REQUIRE(parser.reachedLimits() == reached);
+
+        return doc;
+    };
+
+    auto text = [](MD::Item<TRAIT> *item, long long int i) {
+        REQUIRE(item->type() == MD::ItemType::Paragraph);
+        auto p = static_cast<MD::Paragraph<TRAIT> *>(item);
+        REQUIRE(p->items().size() > i);
+        REQUIRE(p->items().at(i)->type() == MD::ItemType::Text);
+
+        return static_cast<MD::Text<TRAIT> *>(p->items().at(i).get());
+    };
+
+    {
+        auto doc = parse("> > > a\n", {}, MD::NoLimit);
+
+        REQUIRE(doc->items().size() == 2);
+        REQUIRE(doc->items().at(1)->type() == MD::ItemType::Blockquote);
+        auto b = static_cast<MD::Blockquote<TRAIT> *>(doc->items().at(1).get());
+        REQUIRE(b->items().size() == 1);
+        REQUIRE(b->items().at(0)->type() == MD::ItemType::Blockquote);
+        b = static_cast<MD::Blockquote<TRAIT> *>(b->items().at(0).get());
+        REQUIRE(b->items().size() == 1);
+        REQUIRE(b->items().at(0)->type() == MD::ItemType::Blockquote);
+    }
+
+    MD::ParserLimits limits;
+    limits.m_maxNestingDepth = 2;
+
+    {
+        auto doc = parse("> > > a\n", limits, MD::NestingDepthLimit);
+
+        REQUIRE(doc->items().size() == 2);
+        REQUIRE(doc->items().at(1)->type() == MD::ItemType::Blockquote);
+        auto b = static_cast<MD::Blockquote<TRAIT> *>(doc->items().at(1).get());
+        REQUIRE(b->items().size() == 1);
+        REQUIRE(b->items().at(0)->type() == MD::ItemType::Blockquote);
+        b = static_cast<MD::Blockquote<TRAIT> *>(b->items().at(0).get());
+        REQUIRE(b->items().size() == 1);
+        REQUIRE(text(b->items().at(0).get(), 0)->text() == TRAIT::latin1ToString("> a"));
+    }
+
+    {
+        auto doc = parse("- a\n  - b\n    - c\n", limits, MD::NestingDepthLimit);
+
+        REQUIRE(doc->items().size() == 2);
+        REQUIRE(doc->items().at(1)->type() == MD::ItemType::List);
+        auto l = static_cast<MD::List<TRAIT> *>(doc->items().at(1).get());
+        REQUIRE(l->items().size() == 1);
+        auto i = static_cast<MD::ListItem<TRAIT> *>(l->items().at(0).get());
+        REQUIRE(i->items().size() == 2);
+        REQUIRE(i->items().at(1)->type() == MD::ItemType::List);
+        l = static_cast<MD::List<TRAIT> *>(i->items().at(1).get());
+        REQUIRE(l->items().size() == 1);
+        i = static_cast<MD::ListItem<TRAIT> *>(l->items().at(0).get());
+        REQUIRE(i->items().size() == 2);
+        REQUIRE(text(i->items().at(0).get(), 0)->text() == TRAIT::latin1ToString("b"));
+        REQUIRE(text(i->items().at(1).get(), 0)->text() == TRAIT::latin1ToString("- c"));
+    }
+
+    limits = {};
+    limits.m_maxDelimiters = 2;
+
+    {
+        auto doc = parse("*a* *b* c\n\n*d*\n", limits, MD::DelimitersLimit);
+
+        REQUIRE(doc->items().size() == 3);
+        auto t = text(doc->items().at(1).get(), 0);
+        REQUIRE(t->text() == TRAIT::latin1ToString("a"));
+        REQUIRE(t->opts() == MD::ItalicText);
+        t = text(doc->items().at(1).get(), 1);
+        REQUIRE(t->text() == TRAIT::latin1ToString("*b* c"));
+        REQUIRE(t->opts() == MD::TextWithoutFormat);
+        REQUIRE(text(doc->items().at(2).get(), 0)->opts() == MD::ItalicText);
+    }
+
+    limits = {};
+    limits.m_maxSteps = 3;
+
+    {
+        auto doc = parse("*a*\n\n*b*\n", limits, MD::StepsLimit);
+
+        REQUIRE(doc->items().size() == 3);
+        REQUIRE(text(doc->items().at(1).get(), 0)->opts() == MD::ItalicText);
+        REQUIRE(text(doc->items().at(2).get(), 0)->text() == TRAIT::latin1ToString("*b*"));
+    }
+
+    limits = {};
+    limits.m_maxDocumentSize = 6;
+
+    {
+        auto doc = parse("abc\ndef\n", limits, MD::DocumentSizeLimit);
+
+        REQUIRE(doc->items().size() == 2);
+        REQUIRE(text(doc->items().at(1).get(), 0)->text() == TRAIT::latin1ToString("abc"));
+        REQUIRE(text(doc->items().at(1).get(), 1)->text() == TRAIT::latin1ToString("de"));
+    }
+
+    limits = {};
+    limits.m_maxTime = std::chrono::milliseconds(1);
+
+    {
+        std::string content;
+
+        for (int i = 0; i < 10000; ++i) {
+            content.append("*a*\n\n");
+        }
+
+        auto doc = parse(content, limits, MD::TimeLimit);
+
+        REQUIRE(doc->items().size() == 10001);
+        REQUIRE(text(doc->items().back().get(), 0)->text() == TRAIT::latin1ToString("*a*"));
+    }
+}
+
+/*
+*a
+[x]: /u
+
+[x]
+
+*/
+TEST_CASE("288")
+{
+    for (const auto &delim : {"*", "_", "**", "~~"}) {
+        const auto content = std::string(delim) + "a\n[x]: /u\n\n[x]\n";
+
+        MD::Parser<TRAIT> parser;
+
+#ifdef MD4QT_QT_SUPPORT
+        QTextStream stream(QByteArray::fromStdString(content));
+#else
+        std::istringstream stream(content);
+#endif
+
+        auto doc = parser.parse(stream, TRAIT::latin1ToString("tests/parser/data"), TRAIT::latin1ToString("288.md"));
+
+        // Link reference definition can't interrupt a paragraph.
+        REQUIRE(doc->labeledLinks().empty());
+        REQUIRE(doc->items().size() == 3);
+
+        REQUIRE(doc->items().at(1)->type() == MD::ItemType::Paragraph);
+        auto p = static_cast<MD::Paragraph<TRAIT> *>(doc->items().at(1).get());
+        REQUIRE(p->startLine() == 0);
+        REQUIRE(p->endLine() == 1);
+        REQUIRE(p->items().size() == 2);
+
+        {
+            REQUIRE(p->items().at(0)->type() == MD::ItemType::Text);
+            auto t = static_cast<MD::Text<TRAIT> *>(p->items().at(0).get());
+            REQUIRE(t->opts() == MD::TextWithoutFormat);
+            REQUIRE(t->isSpaceBefore());
+            REQUIRE(t->isSpaceAfter());
+            REQUIRE(t->text() == TRAIT::latin1ToString(delim) + TRAIT::latin1ToString("a"));
+        }
+
+        {
+            REQUIRE(p->items().at(1)->type() == MD::ItemType::Text);
+            auto t = static_cast<MD::Text<TRAIT> *>(p->items().at(1).get());
+            REQUIRE(t->opts() == MD::TextWithoutFormat);
+            REQUIRE(t->isSpaceBefore());
+            REQUIRE(t->isSpaceAfter());
+            REQUIRE(t->text() == TRAIT::latin1ToString("[x]: /u"));
+            REQUIRE(t->startColumn() == 0);
+            REQUIRE(t->startLine() == 1);
+            REQUIRE(t->endColumn() == 6);
+            REQUIRE(t->endLine() == 1);
+        }
+
+        REQUIRE(doc->items().at(2)->type() == MD::ItemType::Paragraph);
+        p = static_cast<MD::Paragraph<TRAIT> *>(doc->items().at(2).get());
+        REQUIRE(p->items().size() == 1);
+        REQUIRE(p->items().at(0)->type() == MD::ItemType::Text);
+        auto t = static_cast<MD::Text<TRAIT> *>(p->items().at(0).get());
+        REQUIRE(t->text() == TRAIT::latin1ToString("[x]"));
+    }
+}
@@ -9,20 +9,446 @@
 #include <md4qt/doc.h>
 #include <md4qt/parser.h>
 #include <md4qt/html.h>
+#include <md4qt/poscache.h>
 
 #include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QTemporaryDir>
 #include <QtTest>
 #include <QObject>
 
 #include <cmark-gfm-core-extensions.h>
+#include <cmark-gfm-extension_api.h>
 #include <cmark-gfm.h>
 #include <registry.h>
 
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace MD
+{
+
+struct PrivateAccess {
+    //! Classify the line like the parser does outside of lists.
+    static int whatIsTheLine(Parser<QStringTrait> &p, QStringTrait::InternalString &line)
+    {
+        return static_cast<int>(p.whatIsTheLine(line));
+    }
+};
+
+} /* namespace MD */
+
+//! Kind of generated Markdown.
+enum class Corpus {
+    //! Deep blockquotes and lists.
+    Nested,
+    //! One huge table.
+    Table,
+    //! Text with a lot of emphases.
+    Emphasis,
+    //! Text with a lot of links, images and reference links.
+    Links,
+    //! HTML blocks and inline HTML.
+    Html
+}; // enum class Corpus
+
+//! Measured phase.
+enum class Phase {
+    //! Whole parsing of a file.
+    Parse,
+    //! Reading of lines.
+    Reading,
+    //! Splitting into blocks and parsing of blocks.
+    Blocks,
+    //! Parsing of inline text.
+    Inlines,
+    //! Optimization of paragraphs.
+    ParagraphOptimization,
+    //! MD::PosCache::initialize().
+    PosCache,
+    //! MD::toHtml().
+    ToHtml,
+    //! Parsing with cmark-gfm.
+    CmarkGfm
+}; // enum class Phase
+
+//! \return Block of Markdown of the given kind.
+static QByteArray corpusBlock(Corpus kind, int i)
+{
+    const auto n = QByteArray::number(i);
+
+    switch (kind) {
+    case Corpus::Nested: {
+        QByteArray res;
+        QByteArray quote;
+
+        for (int depth = 0; depth < 8; ++depth) {
+            quote.append("> ");
+            res.append(quote + "Quote " + n + " on the level " + QByteArray::number(depth) + " with *emphasis*.\n");
+        }
+
+        res.append("\n");
+
+        QByteArray indent;
+
+        for (int depth = 0; depth < 8; ++depth) {
+            res.append(indent + "- Item " + n + " on the level " + QByteArray::number(depth) + "\n");
+            res.append(indent + "  1. Ordered item with `code`\n");
+            indent.append("     ");
+        }
+
+        res.append("\n> - Item in quote\n>   > Quote in item " + n + "\n>   > - Item in quote in item\n\n");
+
+        return res;
+    }
+
+    case Corpus::Table:
+        return "| " + n + " | *cell* | **bold** | `code` | [link](http://example.com/" + n + ") | text | 1.0 | ~~del~~ |\n";
+
+    case Corpus::Emphasis:
+        return "Text *italic " + n + "* and **bold** and ***both*** and _under_ and __score__ "
+               "with ~~strike~~ and **nested *italic* in bold** and *unclosed and **mixed* delims** "
+               "and ***a** b* and _a *b_ c* and `code *not emphasis*` at the end.\n\n";
+
+    case Corpus::Links:
+        return "Inline [link " + n + "](http://example.com/" + n + " \"title\") and ![image](a" + n + ".png) "
+               "and <http://autolink.org/" + n + "> and www.github.com and [reference][ref" + n + "] "
+               "and [collapsed][] and [shortcut] and [link with `code` and *emphasis*](#anchor).\n\n"
+               "[ref" + n + "]: http://example.com/ref/" + n + " 'Title'\n"
+               "[collapsed]: http://example.com/collapsed\n"
+               "[shortcut]: http://example.com/shortcut\n\n";
+
+    case Corpus::Html:
+        return "<div class=\"block" + n + "\">\n<p>Paragraph in HTML</p>\n</div>\n\n"
+               "Text with <span class=\"x\">inline</span> <b>HTML</b> and <!-- comment " + n + " --> "
+               "and <img src=\"a.png\"/> and &amp; &copy; entities.\n\n"
+               "<table>\n<tr><td>\n\n*Markdown* in HTML\n\n</td></tr>\n</table>\n\n";
+    }
+
+    return {};
+}
+
+//! \return Markdown of the given kind at least of the given size.
+static QByteArray generateCorpus(Corpus kind, qsizetype size)
+{
+    QByteArray res;
+    res.reserve(size + 1024);
+
+    if (kind == Corpus::Table) {
+        res.append("| Number | Italic | Bold | Code | Link | Text | Float | Strike |\n"
+                   "|:-------|:------:|-----:|------|------|------|-------|--------|\n");
+    }
+
+    for (int i = 0; res.size() < size; ++i) {
+        res.append(corpusBlock(kind, i));
+    }
+
+    return res;
+}
+
+//! Kind of lines for classification benchmark.
+enum class Lines {
+    //! Paragraph's text only.
+    Text,
+    //! Paragraph's text with every fourth line being a start of some block.
+    Mixed,
+    //! Starts of blocks only.
+    Blocks
+}; // enum class Lines
+
+//! \return Lines of the given kind for classification benchmark.
+static std::vector<MD::QStringTrait::InternalString> generateLines(Lines kind, int count)
+{
+    static const QStringList text = {QStringLiteral("Lorem ipsum dolor sit amet, consectetur adipiscing elit,"),
+                                     QStringLiteral("  sed do eiusmod tempor incididunt ut labore et dolore magna aliqua."),
+                                     QStringLiteral("Ut enim ad minim veniam, quis nostrud *exercitation* ullamco"),
+                                     QStringLiteral(" laboris nisi ut aliquip ex ea commodo [consequat](https://kde.org).")};
+    static const QStringList blocks = {QStringLiteral("# Heading"),
+                                       QStringLiteral("> Blockquote"),
+                                       QStringLiteral("- List item"),
+                                       QStringLiteral("1. Ordered list item"),
+                                       QStringLiteral("```cpp"),
+                                       QStringLiteral("[^1]: Footnote"),
+                                       QStringLiteral("    Indented code"),
+                                       QStringLiteral("---")};
+
+    std::vector<MD::QStringTrait::InternalString> res;
+    res.reserve(count);
+
+    for (int i = 0; i < count; ++i) {
+        switch (kind) {
+        case Lines::Text:
+            res.push_back(text.at(i % text.size()));
+            break;
+
+        case Lines::Mixed:
+            res.push_back(i % 4 == 3 ? blocks.at((i / 4) % blocks.size()) : text.at(i % text.size()));
+            break;
+
+        case Lines::Blocks:
+            res.push_back(blocks.at(i % blocks.size()));
+            break;
+        }
+    }
+
+    return res;
+}
+
+//! \return Minimal time of a few runs of the function.
+template<class Func>
+static std::chrono::nanoseconds measure(Func f)
+{
+    auto best = std::chrono::nanoseconds::max();
+    std::chrono::nanoseconds spent(0);
+
+    for (int i = 0; i < 100 && (i < 3 || spent < std::chrono::seconds(1)); ++i) {
+        const auto start = std::chrono::steady_clock::now();
+
+        f();
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        best = std::min<std::chrono::nanoseconds>(best, elapsed);
+        spent += elapsed;
+    }
+
+    return best;
+}
+
+//! Parse file with cmark-gfm with GitHub extensions.
+static void parseWithCmarkGfm(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (file.open(QIODevice::ReadOnly)) {
+        const auto md = file.readAll();
+
+        file.close();
+
+        cmark_gfm_core_extensions_ensure_registered();
+
+        auto parser = cmark_parser_new(CMARK_OPT_FOOTNOTES);
+
+        for (const char *name : {"table", "strikethrough", "autolink", "tasklist"}) {
+            auto extension = cmark_find_syntax_extension(name);
+
+            if (extension) {
+                cmark_parser_attach_syntax_extension(parser, extension);
+            }
+        }
+
+        cmark_parser_feed(parser, md.constData(), md.size());
+
+        auto doc = cmark_parser_finish(parser);
+
+        cmark_node_free(doc);
+        cmark_parser_free(parser);
+    }
+}
+
 class MdBenchmark : public QObject
 {
 	Q_OBJECT
 
+private:
+    //! Times of parsing phases of the fastest run.
+    struct PhaseTimes {
+        std::chrono::nanoseconds m_parse = std::chrono::nanoseconds::max();
+        std::chrono::nanoseconds m_phases[static_cast<int>(MD::ParsingPhase::PhasesCount)] = {};
+    };
+
+    const PhaseTimes &phaseTimes(const QString &fileName)
+    {
+        auto it = m_phaseTimes.find(fileName);
+
+        if (it == m_phaseTimes.end()) {
+            PhaseTimes times;
+            MD::Parser<MD::QStringTrait> parser;
+            parser.setCollectPhaseTimings();
+
+            measure([&]() {
+                const auto start = std::chrono::steady_clock::now();
+
+                parser.parse(fileName, false);
+
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+
+                if (elapsed < times.m_parse) {
+                    times.m_parse = elapsed;
+
+                    for (int i = 0; i < static_cast<int>(MD::ParsingPhase::PhasesCount); ++i) {
+                        times.m_phases[i] = parser.phaseTimings().time(static_cast<MD::ParsingPhase>(i));
+                    }
+                }
+            });
+
+            it = m_phaseTimes.insert(fileName, times);
+        }
+
+        return *it;
+    }
+
+    //! Corpora, name and file name.
+    QVector<QPair<QString, QString>> m_corpora;
+    //! Directory for generated corpora.
+    QTemporaryDir m_dir;
+    //! Cache of phases times.
+    QHash<QString, PhaseTimes> m_phaseTimes;
+
 private Q_SLOTS:
+    void initTestCase()
+    {
+        QVERIFY(m_dir.isValid());
+
+        m_corpora.append({QStringLiteral("complex"), QStringLiteral("tests/manual/complex.md")});
+
+        const QVector<QPair<QString, Corpus>> kinds = {{QStringLiteral("nested"), Corpus::Nested},
+                                                       {QStringLiteral("table"), Corpus::Table},
+                                                       {QStringLiteral("emphasis"), Corpus::Emphasis},
+                                                       {QStringLiteral("links"), Corpus::Links},
+                                                       {QStringLiteral("html"), Corpus::Html}};
+
+        const QVector<QPair<QString, qsizetype>> sizes = {{QStringLiteral("64K"), 64 * 1024},
+                                                          {QStringLiteral("512K"), 512 * 1024},
+                                                          {QStringLiteral("4M"), 4 * 1024 * 1024}};
+
+        for (const auto &kind : kinds) {
+            for (const auto &size : sizes) {
+                const auto name = kind.first + QStringLiteral("-") + size.first;
+                const auto fileName = m_dir.filePath(name + QStringLiteral(".md"));
+
+                QFile file(fileName);
+                QVERIFY(file.open(QIODevice::WriteOnly));
+                file.write(generateCorpus(kind.second, size.second));
+                file.close();
+
+                m_corpora.append({name, fileName});
+            }
+        }
+    }
+
+    void corpus_data()
+    {
+        QTest::addColumn<QString>("fileName");
+        QTest::addColumn<int>("phase");
+
+        const QVector<QPair<QString, Phase>> phases = {{QStringLiteral("parse"), Phase::Parse},
+                                                       {QStringLiteral("reading"), Phase::Reading},
+                                                       {QStringLiteral("blocks"), Phase::Blocks},
+                                                       {QStringLiteral("inlines"), Phase::Inlines},
+                                                       {QStringLiteral("optimization"), Phase::ParagraphOptimization},
+                                                       {QStringLiteral("poscache"), Phase::PosCache},
+                                                       {QStringLiteral("to_html"), Phase::ToHtml},
+                                                       {QStringLiteral("cmark_gfm"), Phase::CmarkGfm}};
+
+        for (const auto &c : std::as_const(m_corpora)) {
+            for (const auto &p : phases) {
+                QTest::newRow(qPrintable(c.first + QStringLiteral("/") + p.first)) << c.second << static_cast<int>(p.second);
+            }
+        }
+    }
+
+    //! Throughput of phases on corpora, in bytes of Markdown per second.
+    void corpus()
+    {
+        QFETCH(QString, fileName);
+        QFETCH(int, phase);
+
+        const auto bytes = QFileInfo(fileName).size();
+        std::chrono::nanoseconds time(0);
+
+        switch (static_cast<Phase>(phase)) {
+        case Phase::Parse:
+            time = phaseTimes(fileName).m_parse;
+            break;
+
+        case Phase::Reading:
+            time = phaseTimes(fileName).m_phases[static_cast<int>(MD::ParsingPhase::Reading)];
+            break;
+
+        case Phase::Blocks:
+            time = phaseTimes(fileName).m_phases[static_cast<int>(MD::ParsingPhase::Blocks)];
+            break;
+
+        case Phase::Inlines:
+            time = phaseTimes(fileName).m_phases[static_cast<int>(MD::ParsingPhase::Inlines)];
+            break;
+
+        case Phase::ParagraphOptimization:
+            time = phaseTimes(fileName).m_phases[static_cast<int>(MD::ParsingPhase::ParagraphOptimization)];
+            break;
+
+        case Phase::PosCache: {
+            MD::Parser<MD::QStringTrait> parser;
+            const auto doc = parser.parse(fileName, false);
+
+            time = measure([&]() {
+                MD::PosCache<MD::QStringTrait> cache;
+                cache.initialize(doc);
+            });
+        } break;
+
+        case Phase::ToHtml: {
+            MD::Parser<MD::QStringTrait> parser;
+            const auto doc = parser.parse(fileName, false);
+
+            time = measure([&]() {
+                MD::toHtml(doc);
+            });
+        } break;
+
+        case Phase::CmarkGfm:
+            time = measure([&]() {
+                parseWithCmarkGfm(fileName);
+            });
+            break;
+        }
+
+        const double seconds = std::max<double>(time.count(), 1.0) / 1000000000.0;
+
+        QTest::setBenchmarkResult(bytes / seconds, QTest::BytesPerSecond);
+
+        qInfo("%s: %.2f ms, %.1f MB/s", QTest::currentDataTag(), seconds * 1000.0, bytes / seconds / (1024.0 * 1024.0));
+    }
+
+    void line_classification_data()
+    {
+        QTest::addColumn<int>("kind");
+
+        QTest::newRow("text") << static_cast<int>(Lines::Text);
+        QTest::newRow("mixed") << static_cast<int>(Lines::Mixed);
+        QTest::newRow("blocks") << static_cast<int>(Lines::Blocks);
+    }
+
+    //! Throughput of classification of lines, in lines per second.
+    void line_classification()
+    {
+        QFETCH(int, kind);
+
+        static const int count = 100000;
+
+        auto lines = generateLines(static_cast<Lines>(kind), count);
+        MD::Parser<MD::QStringTrait> parser;
+        int sum = 0;
+
+        const auto time = measure([&]() {
+            for (auto &line : lines) {
+                sum += MD::PrivateAccess::whatIsTheLine(parser, line);
+            }
+        });
+
+        QVERIFY(sum > 0);
+
+        const double seconds = std::max<double>(time.count(), 1.0) / 1000000000.0;
+
+        QTest::setBenchmarkResult(count / seconds, QTest::Events);
+
+        qInfo("%s: %.2f ms, %.1f M lines/s", QTest::currentDataTag(), seconds * 1000.0, count / seconds / 1000000.0);
+    }
+
     void md4qt_with_icu()
     {
         QBENCHMARK {
@@ -41,6 +467,26 @@ private Q_SLOTS:
         }
     }
 
+    void md4qt_with_qt6_mmap()
+    {
+        QBENCHMARK {
+            MD::Parser<MD::QStringTrait> parser;
+            parser.setMemoryMappedInput();
+
+            parser.parse(QStringLiteral("tests/manual/complex.md"), false);
+        }
+    }
+
+    void md4qt_with_qt6_arena()
+    {
+        QBENCHMARK {
+            MD::Parser<MD::QStringTrait> parser;
+            parser.setArenaAllocation();
+
+            parser.parse(QStringLiteral("tests/manual/complex.md"), false);
+        }
+    }
+
     void md4qt_to_html()
     {
         MD::Parser<MD::QStringTrait> parser;
@@ -0,0 +1,300 @@
+/*
+    SPDX-FileCopyrightText: 2022-2024 Igor Mironchik <igor.mironchik@gmail.com>
+    SPDX-License-Identifier: MIT
+*/
+
+// doctest include.
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+// md4qt include.
+#include <md4qt/html.h>
+#include <md4qt/parser.h>
+
+// C++ include.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <sstream>
+#include <string>
+
+//! Count of repetitions of a pattern in the smaller input.
+static const int s_size = 10000;
+//! The bigger input is 2^s_doublings times bigger than the smaller one.
+static const int s_doublings = 2;
+//! Allowed ratio of times of inputs per doubling of size, linear gives 2, quadratic gives 4.
+static const double s_maxRatioPerDoubling = 2.5;
+//! Times less than this are treated as this to not fail on noise, in milliseconds.
+static const double s_minTime = 1.0;
+//! No input should be parsed longer, in milliseconds.
+static const double s_timeout = 30000.0;
+
+inline std::string
+repeat(const std::string &s, int n)
+{
+    std::string res;
+    res.reserve(s.size() * n);
+
+    for (int i = 0; i < n; ++i) {
+        res.append(s);
+    }
+
+    return res;
+}
+
+//! \return Time of parsing and converting to HTML of the given Markdown, in milliseconds.
+inline double
+measure(const std::string &md, const MD::ParserLimits &limits = {})
+{
+    double best = 0.0;
+
+    for (int i = 0; i < 3; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+
+#ifdef MD4QT_QT_SUPPORT
+        QTextStream stream(QByteArray::fromStdString(md));
+#else
+        std::istringstream stream(md);
+#endif
+
+        MD::Parser<TRAIT> parser;
+        parser.setLimits(limits);
+
+        const auto doc = parser.parse(stream, TRAIT::latin1ToString("tests/pathological"),
+            TRAIT::latin1ToString("pathological.md"));
+
+        REQUIRE(doc);
+
+        const auto html = MD::toHtml(doc);
+
+        const double time = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+
+        best = (i == 0 ? time : std::min(best, time));
+
+        if (time > s_timeout) {
+            break;
+        }
+    }
+
+    return best;
+}
+
+//! Check that time of parsing grows linearly with size of the input.
+inline void
+checkScaling(const std::string &name, const std::function<std::string(int)> &generate)
+{
+    const auto small = std::max(measure(generate(s_size)), s_minTime);
+    const auto big = measure(generate(s_size << s_doublings));
+    const auto maxRatio = std::pow(s_maxRatioPerDoubling, s_doublings);
+
+    INFO(name << ": " << small << " ms, " << big << " ms");
+
+    REQUIRE(big < s_timeout);
+    REQUIRE(big / small < maxRatio);
+}
+
+//! Emphases.
+TEST_CASE("001")
+{
+    checkScaling("*a**a*", [](int n) {
+        return repeat("*a**a*", n) + "\n";
+    });
+
+    checkScaling("a*b", [](int n) {
+        return repeat("a*b", n) + "\n";
+    });
+
+    checkScaling("many emph openers with no closers", [](int n) {
+        return repeat("_a ", n) + "\n";
+    });
+
+    checkScaling("many emph closers with no openers", [](int n) {
+        return repeat("a_ ", n) + "\n";
+    });
+
+    checkScaling("mismatched openers and closers", [](int n) {
+        return repeat("*a_ ", n) + "\n";
+    });
+
+    checkScaling("openers and closers multiple of 3", [](int n) {
+        return "a**b" + repeat("c* ", n) + "\n";
+    });
+
+    checkScaling("_a_b", [](int n) {
+        return repeat("_a_b ", n) + "\n";
+    });
+
+    checkScaling("strikethrough", [](int n) {
+        return repeat("~a~~b", n) + "\n";
+    });
+
+    checkScaling("nested strong emph", [](int n) {
+        return repeat("*a **a ", n) + "b" + repeat(" a** a*", n) + "\n";
+    });
+}
+
+//! Links and images.
+TEST_CASE("002")
+{
+    checkScaling("many link openers with no closers", [](int n) {
+        return repeat("[a", n) + "\n";
+    });
+
+    checkScaling("many link closers with no openers", [](int n) {
+        return repeat("a]", n) + "\n";
+    });
+
+    checkScaling("unmatched [", [](int n) {
+        return repeat("[", n) + "a\n";
+    });
+
+    checkScaling("nested brackets", [](int n) {
+        return repeat("[", n) + "a" + repeat("]", n) + "\n";
+    });
+
+    checkScaling("link openers and emph closers", [](int n) {
+        return repeat("[ a_", n) + "\n";
+    });
+
+    checkScaling("pattern [ (](", [](int n) {
+        return repeat("[ (](", n) + "\n";
+    });
+
+    checkScaling("pattern ![[]()", [](int n) {
+        return repeat("![[]()", n) + "\n";
+    });
+
+    checkScaling("unclosed links A", [](int n) {
+        return repeat("[a](<b", n) + "\n";
+    });
+
+    checkScaling("unclosed links B", [](int n) {
+        return repeat("[a](b", n) + "\n";
+    });
+
+    checkScaling("many references", [](int n) {
+        std::string md;
+
+        for (int i = 0; i < n; ++i) {
+            md.append("[a" + std::to_string(i) + "]: /u\n");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            md.append("[a" + std::to_string(i) + "] ");
+        }
+
+        return md + "\n";
+    });
+
+    checkScaling("many footnotes", [](int n) {
+        std::string md;
+
+        for (int i = 0; i < n; ++i) {
+            md.append("[^" + std::to_string(i) + "]: a\n");
+        }
+
+        return md;
+    });
+
+    checkScaling("unclosed autolinks", [](int n) {
+        return repeat("<a", n) + "\n";
+    });
+}
+
+//! Code, HTML and others.
+TEST_CASE("003")
+{
+    checkScaling("backticks", [](int n) {
+        std::string md;
+
+        for (int i = 1; md.size() < static_cast<size_t>(n) * 10; ++i) {
+            md.append("e" + std::string(i, '`'));
+        }
+
+        return md + "\n";
+    });
+
+    checkScaling("unclosed code spans", [](int n) {
+        return repeat("`a", n) + "\n";
+    });
+
+    checkScaling("unclosed HTML comment", [](int n) {
+        return "<!-- " + repeat("a\n", n);
+    });
+
+    checkScaling("unclosed inline HTML comment", [](int n) {
+        return "a <!-- " + repeat("b ", n) + "\n";
+    });
+
+    checkScaling("unclosed HTML tags", [](int n) {
+        return "a " + repeat("<a ", n) + "\n";
+    });
+
+    checkScaling("entities", [](int n) {
+        return repeat("&a", n) + "\n";
+    });
+
+    checkScaling("table", [](int n) {
+        return repeat("|a", n) + "\n" + repeat("|-", n) + "\n" + repeat("|b", n) + "\n";
+    });
+
+    checkScaling("many lines", [](int n) {
+        return repeat("a *b* [c](d) `e`\n", n);
+    });
+}
+
+//! Nested links, text of each link is parsed once.
+TEST_CASE("004")
+{
+    const auto md = repeat("[", 100) + "a" + repeat("](b)", 100) + "\n";
+
+    REQUIRE(measure(md) < s_timeout);
+}
+
+//! Unfinished code in a footnote.
+TEST_CASE("005")
+{
+    REQUIRE(measure("```\n[^1]:\n") < s_timeout);
+    REQUIRE(measure("[^1]:\n```\n[^1]:\n") < s_timeout);
+}
+
+//! Limits of parsing.
+TEST_CASE("006")
+{
+    MD::ParserLimits limits;
+    limits.m_maxNestingDepth = 64;
+
+    REQUIRE(measure(repeat("> ", 10000) + "a\n", limits) < s_timeout);
+    REQUIRE(measure(repeat("- ", 10000) + "a\n", limits) < s_timeout);
+
+    limits = {};
+    limits.m_maxTime = std::chrono::milliseconds(100);
+
+    const auto time = measure(repeat("*a **a ", 4000) + "b" + repeat(" a** a*", 4000) + "\n", limits);
+
+    INFO("nested strong with time limit: " << time << " ms");
+
+    REQUIRE(time < 5000.0);
+}
+
+//! Blockquotes and lists.
+TEST_CASE("007")
+{
+    checkScaling("list items with nested lists", [](int n) {
+        return repeat("- a\n  - b\n\n", n);
+    });
+
+    checkScaling("nested lists with many items", [](int n) {
+        return repeat("- a\n  - b\n    - c\n      - d\n", n);
+    });
+
+    checkScaling("nested blockquotes", [](int n) {
+        return repeat("> > > > a\n> > > >\n", n);
+    });
+
+    checkScaling("blockquotes in lists", [](int n) {
+        return repeat("- > a\n  > b\n", n);
+    });
+}